@@ -38,6 +38,19 @@
 
 #define BLOCK_SIZE 10240
 
+/* Number of pages decoded ahead of the one being read, and the
+ * upper bound on compressed data kept around for them. */
+#define PREFETCH_N_PAGES   4
+#define PREFETCH_MAX_BYTES (64 * 1024 * 1024)
+
+/* Solid archives can only be decompressed from their start, so their
+ * pages are extracted once, in the background, to a mapped temporary
+ * file, provided they fit in this much disk space. */
+#define EXTRACT_MAX_BYTES  ((gint64) 512 * 1024 * 1024)
+
+/* Bytes fed to the image loader between cancellation checks */
+#define DECODE_CHUNK_SIZE  (64 * 1024)
+
 typedef struct _ComicsDocumentClass ComicsDocumentClass;
 
 struct _ComicsDocumentClass
@@ -52,8 +65,36 @@ struct _ComicsDocument
 	gchar         *archive_path;
 	gchar         *archive_uri;
 	GPtrArray     *page_names;
+
+	/* Extraction of solid archives */
+	GThread       *extract_thread;
+	GMutex         extract_lock;
+	gint           extract_cancelled;
+	GHashTable    *extracted_pages;
+
+	/* Decode-ahead */
+	EvArchive     *prefetch_archive;
+	GThreadPool   *prefetch_pool;
+	GMutex         prefetch_lock;
+	GHashTable    *prefetch_cache;
+	gsize          prefetch_size;
+	gint           prefetch_page;
+	gdouble        prefetch_scale;
+	guint          prefetch_hits;
+	guint          prefetch_misses;
 };
 
+typedef struct {
+	GBytes    *data;
+	GdkPixbuf *pixbuf;
+	gdouble    scale;
+} ComicsPrefetchEntry;
+
+typedef struct {
+	goffset offset;
+	gsize   size;
+} ComicsExtractedEntry;
+
 EV_BACKEND_REGISTER (ComicsDocument, comics_document)
 
 #define FORMAT_UNKNOWN     0
@@ -143,13 +184,217 @@ is_apple_double (const char *name)
 	return ret;
 }
 
+static gboolean
+comics_document_should_extract (ComicsDocument *comics_document,
+				gint64          size)
+{
+	if (!ev_archive_get_is_solid (comics_document->archive))
+		return FALSE;
+
+	if (size > EXTRACT_MAX_BYTES) {
+		g_debug ("Not extracting archive: larger than %" G_GINT64_FORMAT " bytes",
+			 EXTRACT_MAX_BYTES);
+		return FALSE;
+	}
+
+	return size > 0;
+}
+
+static gboolean
+comics_document_extract_entry (EvArchive *archive,
+			       int        fd,
+			       gint64     size,
+			       GError   **error)
+{
+	char buf[BLOCK_SIZE];
+
+	while (size > 0) {
+		gssize read;
+
+		read = ev_archive_read_data (archive, buf, MIN (BLOCK_SIZE, size), error);
+		if (read <= 0) {
+			if (read == 0)
+				g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+						     "Unexpected end of data");
+			return FALSE;
+		}
+
+		if (write (fd, buf, read) != read) {
+			int errsv = errno;
+
+			g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+				     "Failed to write extracted data: %s", g_strerror (errsv));
+			return FALSE;
+		}
+		size -= read;
+	}
+
+	return TRUE;
+}
+
+static GHashTable *
+comics_document_map_extracted (int          fd,
+			       GHashTable  *entries,
+			       GError     **error)
+{
+	GMappedFile *mapped_file;
+	GBytes *bytes;
+	GHashTable *pages;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	mapped_file = g_mapped_file_new_from_fd (fd, FALSE, error);
+	if (!mapped_file)
+		return NULL;
+
+	bytes = g_mapped_file_get_bytes (mapped_file);
+	g_mapped_file_unref (mapped_file);
+
+	pages = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+				       (GDestroyNotify) g_bytes_unref);
+	g_hash_table_iter_init (&iter, entries);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		ComicsExtractedEntry *entry = value;
+
+		g_hash_table_insert (pages, key,
+				     g_bytes_new_from_bytes (bytes, entry->offset, entry->size));
+	}
+	g_bytes_unref (bytes);
+
+	return pages;
+}
+
+/* Called from the extraction thread: writes all the pages to a
+ * temporary file in a single pass over the archive, and maps it once
+ * done. Until then, pages are read from the archive as usual.
+ */
+static gpointer
+comics_document_extract_func (gpointer user_data)
+{
+	ComicsDocument *comics_document = COMICS_DOCUMENT (user_data);
+	EvArchive *archive;
+	GHashTable *wanted;
+	GHashTable *entries;
+	GHashTable *pages = NULL;
+	gchar *filename = NULL;
+	goffset offset = 0;
+	guint i;
+	int fd;
+	GError *error = NULL;
+
+	fd = ev_mkstemp ("comics.XXXXXX", &filename, &error);
+	if (fd == -1) {
+		g_debug ("Not extracting archive: %s", error->message);
+		g_error_free (error);
+		return NULL;
+	}
+
+	wanted = g_hash_table_new (g_str_hash, g_str_equal);
+	for (i = 0; i < comics_document->page_names->len; i++)
+		g_hash_table_add (wanted, g_ptr_array_index (comics_document->page_names, i));
+	entries = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+
+	archive = ev_archive_new ();
+	ev_archive_set_archive_type (archive,
+				     ev_archive_get_archive_type (comics_document->archive));
+	if (!ev_archive_open_filename (archive, comics_document->archive_path, &error)) {
+		g_debug ("Not extracting archive: %s", error->message);
+		g_error_free (error);
+		goto out;
+	}
+
+	while (g_hash_table_size (wanted) > 0 &&
+	       !g_atomic_int_get (&comics_document->extract_cancelled)) {
+		ComicsExtractedEntry *entry;
+		gpointer name;
+		gint64 size;
+
+		if (!ev_archive_read_next_header (archive, &error)) {
+			if (error != NULL) {
+				g_debug ("Stopped extracting archive: %s", error->message);
+				g_clear_error (&error);
+			}
+			break;
+		}
+
+		if (!g_hash_table_lookup_extended (wanted, ev_archive_get_entry_pathname (archive),
+						   &name, NULL))
+			continue;
+		g_hash_table_remove (wanted, name);
+
+		size = ev_archive_get_entry_size (archive);
+		if (size <= 0)
+			continue;
+
+		if (!comics_document_extract_entry (archive, fd, size, &error)) {
+			g_debug ("Stopped extracting archive: %s", error->message);
+			g_clear_error (&error);
+			break;
+		}
+
+		entry = g_new (ComicsExtractedEntry, 1);
+		entry->offset = offset;
+		entry->size = size;
+		g_hash_table_insert (entries, name, entry);
+		offset += size;
+	}
+
+	/* Keep the pages extracted before an error, the others are
+	 * still read from the archive.
+	 */
+	if (g_hash_table_size (entries) > 0 &&
+	    !g_atomic_int_get (&comics_document->extract_cancelled)) {
+		pages = comics_document_map_extracted (fd, entries, &error);
+		if (!pages) {
+			g_debug ("Failed to map extracted archive: %s", error->message);
+			g_error_free (error);
+		}
+	}
+
+	if (pages) {
+		g_mutex_lock (&comics_document->extract_lock);
+		comics_document->extracted_pages = pages;
+		g_mutex_unlock (&comics_document->extract_lock);
+	}
+
+out:
+	g_object_unref (archive);
+	g_hash_table_destroy (entries);
+	g_hash_table_destroy (wanted);
+	/* The mapping, if any, keeps the data alive */
+	close (fd);
+	ev_tmp_filename_unlink (filename);
+	g_free (filename);
+
+	return NULL;
+}
+
+static GBytes *
+comics_document_get_extracted_page (ComicsDocument *comics_document,
+				    gint            index)
+{
+	GBytes *data = NULL;
+
+	g_mutex_lock (&comics_document->extract_lock);
+	if (comics_document->extracted_pages)
+		data = g_hash_table_lookup (comics_document->extracted_pages,
+					    g_ptr_array_index (comics_document->page_names, index));
+	if (data)
+		g_bytes_ref (data);
+	g_mutex_unlock (&comics_document->extract_lock);
+
+	return data;
+}
+
 static GPtrArray *
 comics_document_list (ComicsDocument  *comics_document,
+		      gboolean        *extract,
 		      GError         **error)
 {
 	GPtrArray *array = NULL;
 	gboolean has_encrypted_files, has_unsupported_images;
 	GHashTable *supported_extensions = NULL;
+	gint64 total_size = 0;
 
 	if (!ev_archive_open_filename (comics_document->archive, comics_document->archive_path, error)) {
 		if (*error != NULL) {
@@ -215,8 +460,11 @@ comics_document_list (ComicsDocument  *comics_document,
 
 		g_debug ("Adding '%s' to the list of files in the comics", name);
 		g_ptr_array_add (array, g_strdup (name));
+		total_size += MAX (ev_archive_get_entry_size (comics_document->archive), 0);
 	}
 
+	*extract = comics_document_should_extract (comics_document, total_size);
+
 	if (array->len == 0) {
 		g_ptr_array_free (array, TRUE);
 		array = NULL;
@@ -310,6 +558,7 @@ comics_document_load (EvDocument *document,
 {
 	ComicsDocument *comics_document = COMICS_DOCUMENT (document);
 	gchar *mime_type;
+	gboolean extract = FALSE;
 	GFile *file;
 
 	file = g_file_new_for_uri (uri);
@@ -336,14 +585,22 @@ comics_document_load (EvDocument *document,
 	}
 	g_free (mime_type);
 
+	ev_archive_set_archive_type (comics_document->prefetch_archive,
+				     ev_archive_get_archive_type (comics_document->archive));
+
 	/* Get list of files in archive */
-	comics_document->page_names = comics_document_list (comics_document, error);
+	comics_document->page_names = comics_document_list (comics_document, &extract, error);
 	if (!comics_document->page_names)
 		return FALSE;
 
         /* Now sort the pages */
         g_ptr_array_sort (comics_document->page_names, sort_page_names);
 
+	if (extract)
+		comics_document->extract_thread =
+			g_thread_new ("comics-extract", comics_document_extract_func,
+				      comics_document);
+
 	return TRUE;
 }
 
@@ -385,6 +642,42 @@ get_page_size_prepared_cb (GdkPixbufLoader *loader,
 	info->width = width;
 }
 
+static gboolean
+comics_document_get_extracted_page_size (ComicsDocument *comics_document,
+					 gint            index,
+					 PixbufInfo     *info)
+{
+	GdkPixbufLoader *loader;
+	GBytes *data;
+	const guchar *buf;
+	gsize left;
+
+	data = comics_document_get_extracted_page (comics_document, index);
+	if (!data)
+		return FALSE;
+
+	loader = gdk_pixbuf_loader_new ();
+	g_signal_connect (loader, "size-prepared",
+			  G_CALLBACK (get_page_size_prepared_cb),
+			  info);
+
+	buf = g_bytes_get_data (data, &left);
+	while (left > 0 && !info->got_info) {
+		gsize count = MIN (BLOCK_SIZE, left);
+
+		if (!gdk_pixbuf_loader_write (loader, buf, count, NULL))
+			break;
+		buf += count;
+		left -= count;
+	}
+
+	gdk_pixbuf_loader_close (loader, NULL);
+	g_object_unref (loader);
+	g_bytes_unref (data);
+
+	return TRUE;
+}
+
 static void
 comics_document_get_page_size (EvDocument *document,
 			       EvPage     *page,
@@ -397,6 +690,10 @@ comics_document_get_page_size (EvDocument *document,
 	PixbufInfo info;
 	GError *error = NULL;
 
+	info.got_info = FALSE;
+	if (comics_document_get_extracted_page_size (comics_document, page->index, &info))
+		goto done;
+
 	if (!ev_archive_open_filename (comics_document->archive, comics_document->archive_path, &error)) {
 		g_warning ("Fatal error opening archive: %s", error->message);
 		g_error_free (error);
@@ -404,7 +701,6 @@ comics_document_get_page_size (EvDocument *document,
 	}
 
 	loader = gdk_pixbuf_loader_new ();
-	info.got_info = FALSE;
 	g_signal_connect (loader, "size-prepared",
 			  G_CALLBACK (get_page_size_prepared_cb),
 			  &info);
@@ -451,13 +747,16 @@ comics_document_get_page_size (EvDocument *document,
 
 	gdk_pixbuf_loader_close (loader, NULL);
 	g_object_unref (loader);
+	ev_archive_reset (comics_document->archive);
 
+done:
 	if (info.got_info) {
 		if (width)
 			*width = info.width;
 		if (height)
 			*height = info.height;
 	}
+	return;
 
 out:
 	ev_archive_reset (comics_document->archive);
@@ -475,29 +774,25 @@ render_pixbuf_size_prepared_cb (GdkPixbufLoader *loader,
 	gdk_pixbuf_loader_set_size (loader, scaled_width, scaled_height);
 }
 
-static GdkPixbuf *
-comics_document_render_pixbuf (EvDocument      *document,
-			       EvRenderContext *rc)
+static GBytes *
+comics_document_read_page (ComicsDocument *comics_document,
+			   gint            index)
 {
-	GdkPixbufLoader *loader;
-	GdkPixbuf *tmp_pixbuf;
-	GdkPixbuf *rotated_pixbuf = NULL;
-	ComicsDocument *comics_document = COMICS_DOCUMENT (document);
 	const char *page_path;
+	GBytes *data;
 	GError *error = NULL;
 
+	data = comics_document_get_extracted_page (comics_document, index);
+	if (data)
+		return data;
+
 	if (!ev_archive_open_filename (comics_document->archive, comics_document->archive_path, &error)) {
 		g_warning ("Fatal error opening archive: %s", error->message);
 		g_error_free (error);
 		goto out;
 	}
 
-	loader = gdk_pixbuf_loader_new ();
-	g_signal_connect (loader, "size-prepared",
-			  G_CALLBACK (render_pixbuf_size_prepared_cb),
-			  rc);
-
-	page_path = g_ptr_array_index (comics_document->page_names, rc->page->index);
+	page_path = g_ptr_array_index (comics_document->page_names, index);
 
 	while (1) {
 		const char *name;
@@ -525,27 +820,347 @@ comics_document_render_pixbuf (EvDocument      *document,
 				} else {
 					g_warning ("Read an empty file from the archive");
 				}
+				g_free (buf);
 			} else {
-				gdk_pixbuf_loader_write (loader, (guchar *) buf, size, NULL);
+				data = g_bytes_new_take (buf, size);
 			}
-			g_free (buf);
+			break;
+		}
+	}
+
+out:
+	ev_archive_reset (comics_document->archive);
+	return data;
+}
+
+static GdkPixbuf *
+comics_document_decode_page (GBytes          *data,
+			     EvRenderContext *rc)
+{
+	GdkPixbufLoader *loader;
+	GdkPixbuf *pixbuf;
+	const guchar *buf;
+	gsize size, offset;
+
+	loader = gdk_pixbuf_loader_new ();
+	g_signal_connect (loader, "size-prepared",
+			  G_CALLBACK (render_pixbuf_size_prepared_cb),
+			  rc);
+
+	/* Feed the loader in chunks, so that a cancelled render stops early */
+	buf = g_bytes_get_data (data, &size);
+	for (offset = 0; offset < size; offset += DECODE_CHUNK_SIZE) {
+		if (ev_render_context_is_cancelled (rc)) {
 			gdk_pixbuf_loader_close (loader, NULL);
+			g_object_unref (loader);
+			return NULL;
+		}
+		if (!gdk_pixbuf_loader_write (loader, buf + offset,
+					      MIN (DECODE_CHUNK_SIZE, size - offset),
+					      NULL))
+			break;
+	}
+	gdk_pixbuf_loader_close (loader, NULL);
+
+	pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+	if (pixbuf)
+		g_object_ref (pixbuf);
+	g_object_unref (loader);
+
+	return pixbuf;
+}
+
+static void
+comics_prefetch_entry_free (ComicsPrefetchEntry *entry)
+{
+	g_bytes_unref (entry->data);
+	g_clear_object (&entry->pixbuf);
+	g_slice_free (ComicsPrefetchEntry, entry);
+}
+
+/* Whether the decoded page of @entry has the size @rc asks for. The
+ * viewer asks for a target size, other renders only for a scale.
+ */
+static gboolean
+comics_prefetch_entry_fits (ComicsPrefetchEntry *entry,
+			    EvRenderContext     *rc)
+{
+	gint width, height;
+
+	if (!entry->pixbuf)
+		return FALSE;
+
+	if (rc->target_width < 0 || rc->target_height < 0)
+		return entry->scale == rc->scale;
+
+	/* With a target size, the page size isn't used */
+	ev_render_context_compute_scaled_size (rc, 0, 0, &width, &height);
+
+	return gdk_pixbuf_get_width (entry->pixbuf) == width &&
+		gdk_pixbuf_get_height (entry->pixbuf) == height;
+}
+
+static void
+comics_document_prefetch_lookup (ComicsDocument  *comics_document,
+				 EvRenderContext *rc,
+				 GBytes         **data,
+				 GdkPixbuf      **pixbuf)
+{
+	ComicsPrefetchEntry *entry;
+
+	g_mutex_lock (&comics_document->prefetch_lock);
+	entry = g_hash_table_lookup (comics_document->prefetch_cache,
+				     GINT_TO_POINTER (rc->page->index));
+	if (entry) {
+		*data = g_bytes_ref (entry->data);
+		if (comics_prefetch_entry_fits (entry, rc))
+			*pixbuf = g_object_ref (entry->pixbuf);
+	}
+	g_mutex_unlock (&comics_document->prefetch_lock);
+}
+
+/* Decodes @data and adds it to the cache, unless the reader moved on
+ * in the meantime. Returns %FALSE once the cache is full.
+ */
+static gboolean
+comics_document_prefetch_add (ComicsDocument  *comics_document,
+			      gint             page,
+			      gint             index,
+			      GBytes          *data,
+			      EvRenderContext *rc)
+{
+	ComicsPrefetchEntry *entry;
+	gsize size = g_bytes_get_size (data);
+	gboolean retval = TRUE;
+
+	entry = g_slice_new0 (ComicsPrefetchEntry);
+	entry->data = g_bytes_ref (data);
+	entry->scale = rc->scale;
+	entry->pixbuf = comics_document_decode_page (entry->data, rc);
+
+	g_mutex_lock (&comics_document->prefetch_lock);
+	if (comics_document->prefetch_size + size > PREFETCH_MAX_BYTES) {
+		retval = FALSE;
+	} else if (comics_document->prefetch_page == page &&
+		   !g_hash_table_contains (comics_document->prefetch_cache, GINT_TO_POINTER (index))) {
+		g_hash_table_insert (comics_document->prefetch_cache,
+				     GINT_TO_POINTER (index), entry);
+		comics_document->prefetch_size += size;
+		entry = NULL;
+	}
+	g_mutex_unlock (&comics_document->prefetch_lock);
+
+	if (entry)
+		comics_prefetch_entry_free (entry);
+
+	return retval;
+}
+
+/* Called from the prefetch thread: decompresses the pages following
+ * the one being read in a single pass over the archive, and decodes
+ * them at the scale the reader is currently using.
+ */
+static void
+comics_document_prefetch_func (gpointer data,
+			       gpointer user_data)
+{
+	ComicsDocument *comics_document = COMICS_DOCUMENT (user_data);
+	EvArchive *archive = comics_document->prefetch_archive;
+	EvRenderContext *rc;
+	GHashTable *wanted;
+	GHashTableIter iter;
+	gpointer key, value;
+	gint page = GPOINTER_TO_INT (data) - 1;
+	gint n_pages = comics_document->page_names->len;
+	gint i;
+	GError *error = NULL;
+
+	wanted = g_hash_table_new (g_str_hash, g_str_equal);
+
+	g_mutex_lock (&comics_document->prefetch_lock);
+	/* A newer request superseded this one */
+	if (page != comics_document->prefetch_page) {
+		g_mutex_unlock (&comics_document->prefetch_lock);
+		g_hash_table_destroy (wanted);
+		return;
+	}
+
+	for (i = page + 1; i <= page + PREFETCH_N_PAGES && i < n_pages; i++) {
+		if (g_hash_table_contains (comics_document->prefetch_cache, GINT_TO_POINTER (i)))
+			continue;
+		g_hash_table_insert (wanted,
+				     g_ptr_array_index (comics_document->page_names, i),
+				     GINT_TO_POINTER (i + 1));
+	}
+	rc = ev_render_context_new (NULL, 0, comics_document->prefetch_scale);
+	g_mutex_unlock (&comics_document->prefetch_lock);
+
+	/* Extracted pages only need decoding */
+	if (comics_document->extract_thread) {
+		g_hash_table_iter_init (&iter, wanted);
+		while (g_hash_table_iter_next (&iter, &key, &value) &&
+		       g_atomic_int_get (&comics_document->prefetch_page) == page) {
+			GBytes *page_data;
+			gboolean full;
+
+			page_data = comics_document_get_extracted_page (comics_document,
+									GPOINTER_TO_INT (value) - 1);
+			if (!page_data)
+				continue;
+
+			full = !comics_document_prefetch_add (comics_document, page,
+							      GPOINTER_TO_INT (value) - 1,
+							      page_data, rc);
+			g_bytes_unref (page_data);
+			g_hash_table_iter_remove (&iter);
+			if (full)
+				break;
+		}
+	}
+
+	if (g_hash_table_size (wanted) == 0)
+		goto out;
+
+	if (!ev_archive_open_filename (archive, comics_document->archive_path, &error)) {
+		g_debug ("Failed to open archive for prefetching: %s", error->message);
+		g_error_free (error);
+		goto out;
+	}
+
+	while (g_hash_table_size (wanted) > 0 &&
+	       g_atomic_int_get (&comics_document->prefetch_page) == page) {
+		GBytes *page_data;
+		const char *name;
+		gint index;
+		gint64 size;
+		gboolean full;
+		char *buf;
+
+		if (!ev_archive_read_next_header (archive, &error)) {
+			if (error != NULL) {
+				g_debug ("Failed to prefetch from archive: %s", error->message);
+				g_clear_error (&error);
+			}
+			break;
+		}
+
+		name = ev_archive_get_entry_pathname (archive);
+		index = GPOINTER_TO_INT (g_hash_table_lookup (wanted, name)) - 1;
+		if (index < 0)
+			continue;
+		g_hash_table_remove (wanted, name);
+
+		size = ev_archive_get_entry_size (archive);
+		if (size <= 0)
+			continue;
+
+		buf = g_malloc (size);
+		if (ev_archive_read_data (archive, buf, size, &error) <= 0) {
+			g_debug ("Failed to prefetch page %d: %s", index,
+				 error ? error->message : "empty file");
+			g_clear_error (&error);
+			g_free (buf);
+			continue;
+		}
+
+		page_data = g_bytes_new_take (buf, size);
+		full = !comics_document_prefetch_add (comics_document, page, index, page_data, rc);
+		g_bytes_unref (page_data);
+		if (full)
 			break;
+	}
+
+	ev_archive_reset (archive);
+out:
+	g_object_unref (rc);
+	g_hash_table_destroy (wanted);
+}
+
+/* Drops the pages the reader moved away from and queues
+ * decoding of the ones following @index.
+ */
+static void
+comics_document_prefetch (ComicsDocument *comics_document,
+			  gint            index,
+			  gdouble         scale)
+{
+	GHashTableIter iter;
+	gpointer key;
+	ComicsPrefetchEntry *entry;
+
+	g_mutex_lock (&comics_document->prefetch_lock);
+	if (comics_document->prefetch_page == index &&
+	    comics_document->prefetch_scale == scale) {
+		g_mutex_unlock (&comics_document->prefetch_lock);
+		return;
+	}
+
+	g_atomic_int_set (&comics_document->prefetch_page, index);
+
+	g_hash_table_iter_init (&iter, comics_document->prefetch_cache);
+	while (g_hash_table_iter_next (&iter, &key, (gpointer *) &entry)) {
+		gint i = GPOINTER_TO_INT (key);
+
+		if (i < index || i > index + PREFETCH_N_PAGES) {
+			comics_document->prefetch_size -= g_bytes_get_size (entry->data);
+			g_hash_table_iter_remove (&iter);
+		} else if (comics_document->prefetch_scale != scale) {
+			/* Keep the data, the pixbuf is decoded again on demand */
+			g_clear_object (&entry->pixbuf);
 		}
 	}
+	comics_document->prefetch_scale = scale;
+	g_mutex_unlock (&comics_document->prefetch_lock);
+
+	if ((guint) index + 1 < comics_document->page_names->len)
+		g_thread_pool_push (comics_document->prefetch_pool,
+				    GINT_TO_POINTER (index + 1), NULL);
+}
+
+/* @reading is %FALSE for thumbnails, which don't move the decode-ahead
+ * window, since the sidebar renders pages far from the one being read.
+ */
+static GdkPixbuf *
+comics_document_render_pixbuf (EvDocument      *document,
+			       EvRenderContext *rc,
+			       gboolean         reading)
+{
+	ComicsDocument *comics_document = COMICS_DOCUMENT (document);
+	GdkPixbuf *tmp_pixbuf = NULL;
+	GdkPixbuf *rotated_pixbuf = NULL;
+	GBytes *data = NULL;
+
+	comics_document_prefetch_lookup (comics_document, rc, &data, &tmp_pixbuf);
+	if (reading) {
+		/* Renders are serialized by the document mutex */
+		if (tmp_pixbuf)
+			comics_document->prefetch_hits++;
+		else
+			comics_document->prefetch_misses++;
+		g_debug ("Page %d %s, %u prefetch hits, %u misses", rc->page->index,
+			 tmp_pixbuf ? "prefetched" : "not prefetched",
+			 comics_document->prefetch_hits, comics_document->prefetch_misses);
+	}
+	if (!tmp_pixbuf) {
+		if (!data)
+			data = comics_document_read_page (comics_document, rc->page->index);
+		if (data)
+			tmp_pixbuf = comics_document_decode_page (data, rc);
+	}
+	g_clear_pointer (&data, g_bytes_unref);
 
-	tmp_pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
 	if (tmp_pixbuf) {
 		if ((rc->rotation % 360) == 0)
 			rotated_pixbuf = g_object_ref (tmp_pixbuf);
 		else
 			rotated_pixbuf = gdk_pixbuf_rotate_simple (tmp_pixbuf,
 								   360 - rc->rotation);
+		g_object_unref (tmp_pixbuf);
 	}
-	g_object_unref (loader);
 
-out:
-	ev_archive_reset (comics_document->archive);
+	if (reading)
+		comics_document_prefetch (comics_document, rc->page->index, rc->scale);
+
 	return rotated_pixbuf;
 }
 
@@ -556,7 +1171,32 @@ comics_document_render (EvDocument      *document,
 	GdkPixbuf       *pixbuf;
 	cairo_surface_t *surface;
 
-	pixbuf = comics_document_render_pixbuf (document, rc);
+	pixbuf = comics_document_render_pixbuf (document, rc, TRUE);
+	if (!pixbuf)
+		return NULL;
+	surface = ev_document_misc_surface_from_pixbuf (pixbuf);
+	g_object_unref (pixbuf);
+
+	return surface;
+}
+
+static GdkPixbuf *
+comics_document_get_thumbnail (EvDocument      *document,
+			       EvRenderContext *rc)
+{
+	return comics_document_render_pixbuf (document, rc, FALSE);
+}
+
+static cairo_surface_t *
+comics_document_get_thumbnail_surface (EvDocument      *document,
+				       EvRenderContext *rc)
+{
+	GdkPixbuf       *pixbuf;
+	cairo_surface_t *surface;
+
+	pixbuf = comics_document_render_pixbuf (document, rc, FALSE);
+	if (!pixbuf)
+		return NULL;
 	surface = ev_document_misc_surface_from_pixbuf (pixbuf);
 	g_object_unref (pixbuf);
 
@@ -568,6 +1208,24 @@ comics_document_finalize (GObject *object)
 {
 	ComicsDocument *comics_document = COMICS_DOCUMENT (object);
 
+	/* Make a running prefetch stop at the next page, drop the
+	 * queued ones and wait for it.
+	 */
+	g_atomic_int_set (&comics_document->prefetch_page, -1);
+	g_thread_pool_free (comics_document->prefetch_pool, TRUE, TRUE);
+	g_hash_table_destroy (comics_document->prefetch_cache);
+	g_mutex_clear (&comics_document->prefetch_lock);
+	g_clear_object (&comics_document->prefetch_archive);
+
+	if (comics_document->extract_thread) {
+		g_atomic_int_set (&comics_document->extract_cancelled, TRUE);
+		g_thread_join (comics_document->extract_thread);
+	}
+	g_mutex_clear (&comics_document->extract_lock);
+
+	/* Unmaps the extracted pages; keys belong to page_names */
+	g_clear_pointer (&comics_document->extracted_pages, g_hash_table_destroy);
+
 	if (comics_document->page_names) {
                 g_ptr_array_foreach (comics_document->page_names, (GFunc) g_free, NULL);
                 g_ptr_array_free (comics_document->page_names, TRUE);
@@ -593,10 +1251,23 @@ comics_document_class_init (ComicsDocumentClass *klass)
 	ev_document_class->get_n_pages = comics_document_get_n_pages;
 	ev_document_class->get_page_size = comics_document_get_page_size;
 	ev_document_class->render = comics_document_render;
+	ev_document_class->get_thumbnail = comics_document_get_thumbnail;
+	ev_document_class->get_thumbnail_surface = comics_document_get_thumbnail_surface;
 }
 
 static void
 comics_document_init (ComicsDocument *comics_document)
 {
 	comics_document->archive = ev_archive_new ();
+	g_mutex_init (&comics_document->extract_lock);
+
+	comics_document->prefetch_archive = ev_archive_new ();
+	comics_document->prefetch_cache =
+		g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+				       (GDestroyNotify) comics_prefetch_entry_free);
+	comics_document->prefetch_page = -1;
+	g_mutex_init (&comics_document->prefetch_lock);
+	comics_document->prefetch_pool =
+		g_thread_pool_new (comics_document_prefetch_func,
+				   comics_document, 1, FALSE, NULL);
 }
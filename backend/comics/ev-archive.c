@@ -24,9 +24,16 @@
 #include <archive_entry.h>
 #include <unarr/unarr.h>
 #include <gio/gio.h>
+#include <string.h>
 
 #define BUFFER_SIZE (64 * 1024)
 
+/* RAR 1.5 to 4.x main archive header, following the signature */
+#define RAR_SIGNATURE      "Rar!\x1a\x07\x00"
+#define RAR_SIGNATURE_SIZE 7
+#define RAR_MAIN_HEAD      0x73
+#define RAR_MHD_SOLID      0x0008
+
 struct _EvArchive {
 	GObject parent_instance;
 	EvArchiveType type;
@@ -38,6 +45,8 @@ struct _EvArchive {
 	/* unarr */
 	ar_stream *unarr_stream;
 	ar_archive *unarr;
+
+	gboolean solid;
 };
 
 G_DEFINE_TYPE(EvArchive, ev_archive, G_TYPE_OBJECT);
@@ -124,6 +133,22 @@ ev_archive_set_archive_type (EvArchive *archive,
 	return TRUE;
 }
 
+static gboolean
+unarr_is_solid (ar_stream *stream)
+{
+	guchar header[RAR_SIGNATURE_SIZE + 5];
+
+	if (ar_read (stream, header, sizeof (header)) != sizeof (header))
+		return FALSE;
+	if (memcmp (header, RAR_SIGNATURE, RAR_SIGNATURE_SIZE) != 0)
+		return FALSE;
+	/* CRC (2 bytes), type (1 byte), flags (2 bytes, little endian) */
+	if (header[RAR_SIGNATURE_SIZE + 2] != RAR_MAIN_HEAD)
+		return FALSE;
+
+	return (header[RAR_SIGNATURE_SIZE + 3] | header[RAR_SIGNATURE_SIZE + 4] << 8) & RAR_MHD_SOLID;
+}
+
 gboolean
 ev_archive_open_filename (EvArchive   *archive,
 			  const char  *path,
@@ -145,6 +170,8 @@ ev_archive_open_filename (EvArchive   *archive,
 					     "Error opening archive");
 			return FALSE;
 		}
+		/* ar_open_rar_archive() seeks back to the start */
+		archive->solid = unarr_is_solid (archive->unarr_stream);
 		archive->unarr = ar_open_rar_archive (archive->unarr_stream);
 		if (archive->unarr == NULL) {
 			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
@@ -161,6 +188,10 @@ ev_archive_open_filename (EvArchive   *archive,
 				     "Error opening archive: %s", archive_error_string (archive->libar));
 			return FALSE;
 		}
+		/* 7z only records this in its header, which is usually
+		 * compressed itself, but solid is the default there.
+		 */
+		archive->solid = archive->type == EV_ARCHIVE_TYPE_7Z;
 		return TRUE;
 	}
 
@@ -284,6 +315,17 @@ ev_archive_get_entry_is_encrypted (EvArchive *archive)
 	return FALSE;
 }
 
+/* Whether the entries are compressed as a single stream, so reading
+ * one means decompressing all the ones before it. Only valid once
+ * the archive was opened. */
+gboolean
+ev_archive_get_is_solid (EvArchive *archive)
+{
+	g_return_val_if_fail (EV_IS_ARCHIVE (archive), FALSE);
+
+	return archive->solid;
+}
+
 gssize
 ev_archive_read_data (EvArchive *archive,
 		      void      *buf,
@@ -19,14 +19,19 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include "ev-archive.h"
 
+#define BUFFER_SIZE (64 * 1024)
+
 static void
 usage (const char *prog)
 {
 	g_print ("- Lists file in a supported archive format\n");
-	g_print ("Usage: %s archive-type filename\n", prog);
+	g_print ("Usage: %s [--benchmark] archive-type filename\n", prog);
 	g_print ("Where archive-type is one of rar, zip, 7z or tar\n");
+	g_print ("With --benchmark, all the files are decompressed and timed\n");
 }
 
 static EvArchiveType
@@ -47,6 +52,30 @@ str_to_archive_type (const char *str)
 	return EV_ARCHIVE_TYPE_NONE;
 }
 
+static gboolean
+decompress_entry (EvArchive *ar,
+		  gint64     size,
+		  GError   **error)
+{
+	char *buf;
+	gboolean retval = TRUE;
+
+	buf = g_malloc (BUFFER_SIZE);
+	while (size > 0) {
+		gssize read;
+
+		read = ev_archive_read_data (ar, buf, MIN (BUFFER_SIZE, size), error);
+		if (read <= 0) {
+			retval = (read == 0);
+			break;
+		}
+		size -= read;
+	}
+	g_free (buf);
+
+	return retval;
+}
+
 int
 main (int argc, char **argv)
 {
@@ -54,6 +83,15 @@ main (int argc, char **argv)
 	EvArchiveType ar_type;
 	GError *error = NULL;
 	gboolean printed_header = FALSE;
+	gboolean benchmark = FALSE;
+	GTimer *timer = NULL;
+	gint64 total_size = 0;
+
+	if (argc == 4 && strcmp (argv[1], "--benchmark") == 0) {
+		benchmark = TRUE;
+		argc--;
+		argv++;
+	}
 
 	if (argc != 3) {
 		usage (argv[0]);
@@ -77,10 +115,14 @@ main (int argc, char **argv)
 		goto out;
 	}
 
+	if (benchmark)
+		timer = g_timer_new ();
+
 	while (1) {
 		const char *name;
 		gboolean is_encrypted;
 		gint64 size;
+		gdouble elapsed = 0;
 
 		if (!ev_archive_read_next_header (ar, &error)) {
 			if (error != NULL) {
@@ -95,14 +137,45 @@ main (int argc, char **argv)
 		is_encrypted = ev_archive_get_entry_is_encrypted (ar);
 		size = ev_archive_get_entry_size (ar);
 
+		if (benchmark && !is_encrypted) {
+			gdouble start = g_timer_elapsed (timer, NULL);
+
+			if (!decompress_entry (ar, size, &error)) {
+				g_warning ("Failed to decompress '%s': %s", name,
+					   error ? error->message : "unexpected end of data");
+				g_clear_error (&error);
+				goto out;
+			}
+			elapsed = g_timer_elapsed (timer, NULL) - start;
+			total_size += size;
+		}
+
 		if (!printed_header) {
-			g_print ("P\tSIZE\tNAME\n");
+			if (benchmark)
+				g_print ("P\tSIZE\tTIME (ms)\tNAME\n");
+			else
+				g_print ("P\tSIZE\tNAME\n");
 			printed_header = TRUE;
 		}
 
-		g_print ("%c\t%"G_GINT64_FORMAT"\t%s\n",
-			 is_encrypted ? 'P' : ' ',
-			 size, name);
+		if (benchmark) {
+			g_print ("%c\t%"G_GINT64_FORMAT"\t%.2f\t%s\n",
+				 is_encrypted ? 'P' : ' ',
+				 size, elapsed * 1000, name);
+		} else {
+			g_print ("%c\t%"G_GINT64_FORMAT"\t%s\n",
+				 is_encrypted ? 'P' : ' ',
+				 size, name);
+		}
+	}
+
+	if (benchmark) {
+		gdouble elapsed = g_timer_elapsed (timer, NULL);
+
+		g_print ("Decompressed %"G_GINT64_FORMAT" bytes in %.3f s (%.2f MiB/s)\n",
+			 total_size, elapsed,
+			 elapsed > 0 ? total_size / elapsed / (1024 * 1024) : 0);
+		g_timer_destroy (timer);
 	}
 
 	ev_archive_reset (ar);
@@ -111,6 +184,7 @@ main (int argc, char **argv)
 	return 0;
 
 out:
+	g_clear_pointer (&timer, g_timer_destroy);
 	g_clear_object (&ar);
 	return 1;
 }
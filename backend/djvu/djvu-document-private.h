@@ -41,6 +41,10 @@ struct _DjvuDocument {
 	ddjvu_fileinfo_t *fileinfo_pages;
 	gint		  n_pages;
 	GHashTable	 *file_ids;
+
+	/* Most recently used decoded pages, including the ones
+	 * being decoded ahead of the reader */
+	GQueue           *pages;
 };
 
 int  djvu_document_get_n_pages (EvDocument   *document);
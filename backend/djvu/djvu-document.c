@@ -67,6 +67,19 @@ EV_BACKEND_REGISTER_WITH_CODE (DjvuDocument, djvu_document,
 
 #define EV_DJVU_ERROR ev_djvu_error_quark ()
 
+/* Number of pages following the rendered one that are decoded ahead */
+#define DECODE_AHEAD_N_PAGES 2
+/* Maximum number of decoded pages kept around */
+#define PAGE_CACHE_SIZE 6
+
+/* Rows rendered between cancellation checks */
+#define RENDER_BAND_HEIGHT 256
+
+typedef struct {
+	gint          index;
+	ddjvu_page_t *d_page;
+} DjvuCachedPage;
+
 static GQuark
 ev_djvu_error_quark (void)
 {
@@ -145,6 +158,22 @@ djvu_wait_for_message (DjvuDocument *djvu_document, ddjvu_message_tag_t message,
 		ddjvu_message_pop (ctx);
 }
 
+static void
+djvu_cached_page_free (DjvuCachedPage *cached)
+{
+	ddjvu_page_release (cached->d_page);
+	g_slice_free (DjvuCachedPage, cached);
+}
+
+static void
+djvu_document_clear_pages (DjvuDocument *djvu_document)
+{
+	DjvuCachedPage *cached;
+
+	while ((cached = g_queue_pop_head (djvu_document->pages)))
+		djvu_cached_page_free (cached);
+}
+
 static gboolean
 djvu_document_load (EvDocument  *document,
 		    const char  *uri,
@@ -180,6 +209,7 @@ djvu_document_load (EvDocument  *document,
 		return FALSE;
 	}
 
+	djvu_document_clear_pages (djvu_document);
 	if (djvu_document->d_document)
 	    ddjvu_document_release (djvu_document->d_document);
 
@@ -331,6 +361,56 @@ djvu_document_get_page_size (EvDocument   *document,
 				width, height, NULL);
 }
 
+/* Returns the page @index, creating it if it isn't in the cache yet.
+ * Creating a page makes ddjvuapi start decoding it in its own
+ * thread, so this doesn't block.
+ */
+static ddjvu_page_t *
+djvu_document_get_page (DjvuDocument *djvu_document,
+			gint          index)
+{
+	DjvuCachedPage *cached;
+	GList          *l;
+
+	for (l = djvu_document->pages->head; l; l = l->next) {
+		cached = (DjvuCachedPage *) l->data;
+
+		if (cached->index == index) {
+			g_queue_unlink (djvu_document->pages, l);
+			g_queue_push_head_link (djvu_document->pages, l);
+
+			return cached->d_page;
+		}
+	}
+
+	cached = g_slice_new (DjvuCachedPage);
+	cached->index = index;
+	cached->d_page = ddjvu_page_create_by_pageno (djvu_document->d_document, index);
+	if (!cached->d_page) {
+		g_slice_free (DjvuCachedPage, cached);
+		return NULL;
+	}
+	g_queue_push_head (djvu_document->pages, cached);
+
+	while (g_queue_get_length (djvu_document->pages) > PAGE_CACHE_SIZE)
+		djvu_cached_page_free (g_queue_pop_tail (djvu_document->pages));
+
+	return cached->d_page;
+}
+
+/* Starts decoding the pages following @index, so that they are ready
+ * by the time the reader turns the page.
+ */
+static void
+djvu_document_decode_ahead (DjvuDocument *djvu_document,
+			    gint          index)
+{
+	gint i;
+
+	for (i = 1; i <= DECODE_AHEAD_N_PAGES && index + i < djvu_document->n_pages; i++)
+		djvu_document_get_page (djvu_document, index + i);
+}
+
 static cairo_surface_t *
 djvu_document_render (EvDocument      *document, 
 		      EvRenderContext *rc)
@@ -346,11 +426,23 @@ djvu_document_render (EvDocument      *document,
 	gint buffer_modified;
 	double page_width, page_height;
 	gint transformed_width, transformed_height;
+	gint y;
 
-	d_page = ddjvu_page_create_by_pageno (djvu_document->d_document, rc->page->index);
-	
-	while (!ddjvu_page_decoding_done (d_page))
+	d_page = djvu_document_get_page (djvu_document, rc->page->index);
+	if (!d_page)
+		return NULL;
+
+	/* The following pages are decoded while this one is rendered.
+	 * Getting the current page again keeps it at the head of the cache.
+	 */
+	djvu_document_decode_ahead (djvu_document, rc->page->index);
+	djvu_document_get_page (djvu_document, rc->page->index);
+
+	while (!ddjvu_page_decoding_done (d_page)) {
+		if (ev_render_context_is_cancelled (rc))
+			return NULL;
 		djvu_handle_events(djvu_document, TRUE, NULL);
+	}
 
 	document_get_page_size (djvu_document, rc->page->index, &page_width, &page_height, NULL);
 	rotation = ddjvu_page_get_initial_rotation (d_page);
@@ -393,23 +485,27 @@ djvu_document_render (EvDocument      *document,
 	rrect = prect;
 
 	ddjvu_page_set_rotation (d_page, rotation);
-	
-	buffer_modified = ddjvu_page_render (d_page, DDJVU_RENDER_COLOR,
-					     &prect,
-					     &rrect,
-					     djvu_document->d_format,
-					     rowstride,
-					     pixels);
-
-	if (!buffer_modified) {
-		cairo_t *cr = cairo_create (surface);
-
-		cairo_set_source_rgb (cr, 1.0, 1.0, 1.0);
-		cairo_paint (cr);
-		cairo_destroy (cr);
-	} else {
-		cairo_surface_mark_dirty (surface);
+
+	/* Render in bands, so that a cancelled render stops early */
+	cairo_surface_flush (surface);
+	for (y = 0; y < transformed_height; y += RENDER_BAND_HEIGHT) {
+		if (ev_render_context_is_cancelled (rc)) {
+			cairo_surface_destroy (surface);
+			return NULL;
+		}
+
+		rrect.y = y;
+		rrect.h = MIN (RENDER_BAND_HEIGHT, transformed_height - y);
+		buffer_modified = ddjvu_page_render (d_page, DDJVU_RENDER_COLOR,
+						     &prect,
+						     &rrect,
+						     djvu_document->d_format,
+						     rowstride,
+						     pixels + (gsize) y * rowstride);
+		if (!buffer_modified)
+			memset (pixels + (gsize) y * rowstride, 0xff, (gsize) rrect.h * rowstride);
 	}
+	cairo_surface_mark_dirty (surface);
 
 	return surface;
 }
@@ -527,6 +623,9 @@ djvu_document_finalize (GObject *object)
 {
 	DjvuDocument *djvu_document = DJVU_DOCUMENT (object);
 
+	djvu_document_clear_pages (djvu_document);
+	g_queue_free (djvu_document->pages);
+
 	if (djvu_document->d_document)
 	    ddjvu_document_release (djvu_document->d_document);
 	    
@@ -839,14 +938,18 @@ djvu_document_init (DjvuDocument *djvu_document)
 	djvu_document->d_context = ddjvu_context_create ("Evince");
 	djvu_document->d_format = ddjvu_format_create (DDJVU_FORMAT_RGBMASK32, 4, masks);
 	ddjvu_format_set_row_order (djvu_document->d_format, 1);
+	/* Rectangles are measured from the top, pages are rendered in bands */
+	ddjvu_format_set_y_direction (djvu_document->d_format, 1);
 
 	djvu_document->thumbs_format = ddjvu_format_create (DDJVU_FORMAT_RGB24, 0, 0);
 	ddjvu_format_set_row_order (djvu_document->thumbs_format, 1);
+	ddjvu_format_set_y_direction (djvu_document->thumbs_format, 1);
 
 	djvu_document->ps_filename = NULL;
 	djvu_document->opts = g_string_new ("");
 	
 	djvu_document->d_document = NULL;
+	djvu_document->pages = g_queue_new ();
 }
 
 static GList *
@@ -79,11 +79,16 @@ dvi_cairo_draw_glyph (DviContext  *dvi,
 				 w, h);
 		cairo_stroke (cairo_device->cr);
 	} else {
-		cairo_translate (cairo_device->cr, x, y);
-		cairo_set_source_surface (cairo_device->cr,
-					  (cairo_surface_t *) glyph->data,
-					  0, 0);
-		cairo_paint (cairo_device->cr);
+		/* Glyphs are cached as alpha masks, painted with
+		 * the color they were shrunk for.
+		 */
+		cairo_set_source_rgb (cairo_device->cr,
+				      ((ch->fg >> 16) & 0xff) / 255.,
+				      ((ch->fg >> 8) & 0xff) / 255.,
+				      ((ch->fg >> 0) & 0xff) / 255.);
+		cairo_mask_surface (cairo_device->cr,
+				    (cairo_surface_t *) glyph->data,
+				    x, y);
 	}
 
 	cairo_restore (cairo_device->cr);
@@ -233,7 +238,7 @@ dvi_cairo_create_image (void *device_data,
 			Uint  height,
 			Uint  bpp)
 {
-	return cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+	return cairo_image_surface_create (CAIRO_FORMAT_A8, width, height);
 }
 
 static void
@@ -242,21 +247,49 @@ dvi_cairo_free_image (void *ptr)
 	cairo_surface_destroy ((cairo_surface_t *)ptr);
 }
 
+static void
+dvi_cairo_ref_image (void *ptr)
+{
+	cairo_surface_reference ((cairo_surface_t *)ptr);
+}
+
+/* Images are A8 masks, so only the alpha of the colors
+ * from dvi_cairo_alloc_colors() is kept.
+ */
 static void
 dvi_cairo_put_pixel (void *image, int x, int y, Ulong color)
 {
 	cairo_surface_t *surface;
 	gint             rowstride;
-	guint32         *p;
+	guchar          *p;
 
 	surface = (cairo_surface_t *) image;
 
 	rowstride = cairo_image_surface_get_stride (surface);
-	p = (guint32*) (cairo_image_surface_get_data (surface) + y * rowstride + x * 4);
+	p = cairo_image_surface_get_data (surface) + y * rowstride + x;
 
         /* per cairo docs, must flush before modifying outside of cairo */
         cairo_surface_flush(surface);
-	*p = color;
+	*p = color >> 24;
+}
+
+static void
+dvi_cairo_put_row (void *image, int y, const Ulong *colors, int count)
+{
+	cairo_surface_t *surface;
+	guchar          *p;
+	int              x;
+
+	surface = (cairo_surface_t *) image;
+
+	p = cairo_image_surface_get_data (surface) +
+		y * cairo_image_surface_get_stride (surface);
+
+	/* The surface is not drawn with cairo until image_done */
+	if (y == 0)
+		cairo_surface_flush (surface);
+	for (x = 0; x < count; x++)
+		p[x] = colors[x] >> 24;
 }
 
 static void
@@ -285,7 +318,9 @@ mdvi_cairo_device_init (DviDevice *device)
 	device->alloc_colors = dvi_cairo_alloc_colors;
 	device->create_image = dvi_cairo_create_image;
 	device->free_image = dvi_cairo_free_image;
+	device->ref_image = dvi_cairo_ref_image;
 	device->put_pixel = dvi_cairo_put_pixel;
+	device->put_row = dvi_cairo_put_row;
         device->image_done = dvi_cairo_image_done;
 	device->set_color = dvi_cairo_set_color;
 #ifdef HAVE_SPECTRE
@@ -40,7 +40,11 @@
 #endif
 #include <stdlib.h>
 
-static GMutex dvi_context_mutex;
+/* Fonts and glyphs are shared by all the MDVI contexts */
+static GMutex dvi_font_mutex;
+
+/* Maximum number of pages of a document rendered at the same time */
+#define MAX_RENDER_CONTEXTS 4
 
 enum {
 	PROP_0,
@@ -58,6 +62,15 @@ struct _DviDocument
 
 	DviContext *context;
 	DviPageSpec *spec;
+
+	/* Contexts over the same file used for rendering, each one
+	 * with its own page state and cairo device. They include
+	 * the main context.
+	 */
+	GMutex contexts_lock;
+	GCond contexts_cond;
+	GList *contexts;
+	GQueue idle_contexts;
 	DviParams *params;
 	
 	/* To let document scale we should remember width and height */
@@ -83,6 +96,95 @@ EV_BACKEND_REGISTER_WITH_CODE (DviDocument, dvi_document,
       EV_BACKEND_IMPLEMENT_INTERFACE (EV_TYPE_FILE_EXPORTER, dvi_document_file_exporter_iface_init);
      });
 
+static void
+dvi_document_lock_fonts (void)
+{
+	g_mutex_lock (&dvi_font_mutex);
+}
+
+static void
+dvi_document_unlock_fonts (void)
+{
+	g_mutex_unlock (&dvi_font_mutex);
+}
+
+/* Must be called with the font mutex held */
+static DviContext *
+dvi_document_create_context (DviDocument *dvi_document,
+			     const gchar *filename)
+{
+	DviContext *context;
+
+	context = mdvi_init_context (dvi_document->params, dvi_document->spec, filename);
+	if (context)
+		mdvi_cairo_device_init (&context->device);
+
+	return context;
+}
+
+/* Must be called with the font mutex held */
+static void
+dvi_document_free_contexts (DviDocument *dvi_document)
+{
+	GList *l;
+
+	for (l = dvi_document->contexts; l; l = g_list_next (l)) {
+		DviContext *context = (DviContext *) l->data;
+
+		mdvi_cairo_device_free (&context->device);
+		mdvi_destroy_context (context);
+	}
+	g_list_free (dvi_document->contexts);
+	dvi_document->contexts = NULL;
+	g_queue_clear (&dvi_document->idle_contexts);
+	dvi_document->context = NULL;
+}
+
+/* Returns a context no other thread is rendering with, creating
+ * a new one if needed, or waiting for one to be released.
+ */
+static DviContext *
+dvi_document_acquire_context (DviDocument *dvi_document)
+{
+	DviContext *context;
+
+	g_mutex_lock (&dvi_document->contexts_lock);
+	while (g_queue_is_empty (&dvi_document->idle_contexts) &&
+	       g_list_length (dvi_document->contexts) >= MAX_RENDER_CONTEXTS)
+		g_cond_wait (&dvi_document->contexts_cond, &dvi_document->contexts_lock);
+
+	context = g_queue_pop_head (&dvi_document->idle_contexts);
+	if (!context) {
+		g_mutex_lock (&dvi_font_mutex);
+		context = dvi_document_create_context (dvi_document,
+						       dvi_document->context->filename);
+		g_mutex_unlock (&dvi_font_mutex);
+
+		/* Fall back to waiting for a context to be released */
+		if (!context) {
+			while (g_queue_is_empty (&dvi_document->idle_contexts))
+				g_cond_wait (&dvi_document->contexts_cond,
+					     &dvi_document->contexts_lock);
+			context = g_queue_pop_head (&dvi_document->idle_contexts);
+		} else {
+			dvi_document->contexts = g_list_prepend (dvi_document->contexts, context);
+		}
+	}
+	g_mutex_unlock (&dvi_document->contexts_lock);
+
+	return context;
+}
+
+static void
+dvi_document_release_context (DviDocument *dvi_document,
+			      DviContext  *context)
+{
+	g_mutex_lock (&dvi_document->contexts_lock);
+	g_queue_push_head (&dvi_document->idle_contexts, context);
+	g_cond_signal (&dvi_document->contexts_cond);
+	g_mutex_unlock (&dvi_document->contexts_lock);
+}
+
 static gboolean
 dvi_document_load (EvDocument  *document,
 		   const char  *uri,
@@ -95,23 +197,26 @@ dvi_document_load (EvDocument  *document,
 	if (!filename)
         	return FALSE;
 	
-	g_mutex_lock (&dvi_context_mutex);
-	if (dvi_document->context)
-		mdvi_destroy_context (dvi_document->context);
+	g_mutex_lock (&dvi_document->contexts_lock);
+	g_mutex_lock (&dvi_font_mutex);
+	dvi_document_free_contexts (dvi_document);
 
-	dvi_document->context = mdvi_init_context(dvi_document->params, dvi_document->spec, filename);
-	g_mutex_unlock (&dvi_context_mutex);
+	dvi_document->context = dvi_document_create_context (dvi_document, filename);
+	g_mutex_unlock (&dvi_font_mutex);
 	g_free (filename);
 	
 	if (!dvi_document->context) {
+		g_mutex_unlock (&dvi_document->contexts_lock);
     		g_set_error_literal (error,
                                      EV_DOCUMENT_ERROR,
                                      EV_DOCUMENT_ERROR_INVALID,
                                      _("DVI document has incorrect format"));
         	return FALSE;
 	}
-	
-	mdvi_cairo_device_init (&dvi_document->context->device);
+
+	dvi_document->contexts = g_list_prepend (NULL, dvi_document->context);
+	g_queue_push_head (&dvi_document->idle_contexts, dvi_document->context);
+	g_mutex_unlock (&dvi_document->contexts_lock);
 	
 	
 	dvi_document->base_width = dvi_document->context->dvi_page_w * dvi_document->context->params.conv 
@@ -164,41 +269,44 @@ dvi_document_render (EvDocument      *document,
 	cairo_surface_t *surface;
 	cairo_surface_t *rotated_surface;
 	DviDocument *dvi_document = DVI_DOCUMENT(document);
+	DviContext *context;
 	gdouble xscale, yscale;
 	gint required_width, required_height;
 	gint proposed_width, proposed_height;
 	gint xmargin = 0, ymargin = 0;
 
-	/* We should protect our context since it's not 
-	 * thread safe. The work to the future - 
-	 * let context render page independently
+	/* Contexts are not thread safe, but several pages can
+	 * be rendered at once with a context each. Only glyph
+	 * handling is serialized, by MDVI itself.
 	 */
-	g_mutex_lock (&dvi_context_mutex);
-	
-	mdvi_setpage (dvi_document->context, rc->page->index);
+	context = dvi_document_acquire_context (dvi_document);
+
+	g_mutex_lock (&dvi_font_mutex);
+	mdvi_setpage (context, rc->page->index);
 	
 	ev_render_context_compute_scales (rc, dvi_document->base_width, dvi_document->base_height,
 					  &xscale, &yscale);
-	mdvi_set_shrink (dvi_document->context, 
+	mdvi_set_shrink (context, 
 			 (int)((dvi_document->params->hshrink - 1) / xscale) + 1,
 			 (int)((dvi_document->params->vshrink - 1) / yscale) + 1);
+	g_mutex_unlock (&dvi_font_mutex);
 
 	ev_render_context_compute_scaled_size (rc, dvi_document->base_width, dvi_document->base_height,
 					       &required_width, &required_height);
-	proposed_width = dvi_document->context->dvi_page_w * dvi_document->context->params.conv;
-	proposed_height = dvi_document->context->dvi_page_h * dvi_document->context->params.vconv;
+	proposed_width = context->dvi_page_w * context->params.conv;
+	proposed_height = context->dvi_page_h * context->params.vconv;
 	
 	if (required_width >= proposed_width)
 	    xmargin = (required_width - proposed_width) / 2;
 	if (required_height >= proposed_height)
 	    ymargin = (required_height - proposed_height) / 2;
 	    
-	mdvi_cairo_device_set_margins (&dvi_document->context->device, xmargin, ymargin);
-	mdvi_cairo_device_set_scale (&dvi_document->context->device, xscale, yscale);
-	mdvi_cairo_device_render (dvi_document->context);
-	surface = mdvi_cairo_device_get_surface (&dvi_document->context->device);
+	mdvi_cairo_device_set_margins (&context->device, xmargin, ymargin);
+	mdvi_cairo_device_set_scale (&context->device, xscale, yscale);
+	mdvi_cairo_device_render (context);
+	surface = mdvi_cairo_device_get_surface (&context->device);
 
-	g_mutex_unlock (&dvi_context_mutex);
+	dvi_document_release_context (dvi_document, context);
 
 	rotated_surface = ev_document_misc_surface_rotate_and_scale (surface,
 								     required_width,
@@ -214,12 +322,11 @@ dvi_document_finalize (GObject *object)
 {	
 	DviDocument *dvi_document = DVI_DOCUMENT(object);
 	
-	g_mutex_lock (&dvi_context_mutex);
-	if (dvi_document->context) {
-		mdvi_cairo_device_free (&dvi_document->context->device);
-		mdvi_destroy_context (dvi_document->context);
-	}
-	g_mutex_unlock (&dvi_context_mutex);
+	g_mutex_lock (&dvi_font_mutex);
+	dvi_document_free_contexts (dvi_document);
+	g_mutex_unlock (&dvi_font_mutex);
+	g_mutex_clear (&dvi_document->contexts_lock);
+	g_cond_clear (&dvi_document->contexts_cond);
 
 	if (dvi_document->params)
 		g_free (dvi_document->params);
@@ -256,6 +363,7 @@ dvi_document_class_init (DviDocumentClass *klass)
 
 	mdvi_register_special ("Color", "color", NULL, dvi_document_do_color_special, 1);
 	mdvi_register_fonts ();
+	mdvi_set_font_lock (dvi_document_lock_fonts, dvi_document_unlock_fonts);
 
 	ev_document_class->load = dvi_document_load;
 	ev_document_class->save = dvi_document_save;
@@ -521,6 +629,9 @@ static void
 dvi_document_init (DviDocument *dvi_document)
 {
 	dvi_document->context = NULL;
+	g_mutex_init (&dvi_document->contexts_lock);
+	g_cond_init (&dvi_document->contexts_cond);
+	g_queue_init (&dvi_document->idle_contexts);
 	dvi_document_init_params (dvi_document);
 
 	dvi_document->exporter_filename = NULL;
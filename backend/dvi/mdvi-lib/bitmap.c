@@ -20,6 +20,7 @@
 
 #include <config.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "mdvi.h"
 #include "color.h"
@@ -62,6 +63,10 @@ static BmUnit bit_masks[] = {
 
 /* sampling and shrinking routines shamelessly stolen from xdvi */
 
+#if defined(__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
+#define bm_popcount(u)	__builtin_popcount(u)
+#else
+/* sample_count[j] = number of bits set in j */
 static int sample_count[] = {
 	0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
 	1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
@@ -81,6 +86,12 @@ static int sample_count[] = {
 	4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8
 };
 
+#define bm_popcount(u)	(sample_count[(u) & 0xff] + \
+	sample_count[((u) >> 8) & 0xff] + \
+	sample_count[((u) >> 16) & 0xff] + \
+	sample_count[((u) >> 24) & 0xff])
+#endif
+
 /* bit_swap[j] = j with all bits inverted (i.e. msb -> lsb) */
 static Uchar bit_swap[] = {
 	0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0,
@@ -374,345 +385,215 @@ void	bitmap_set_row(BITMAP *bm, int row, int col, int count, int state)
 }
 
 /*
- * Now several `flipping' operations
+ * Now several `flipping' operations. They all work on whole units:
+ * rows are mirrored by reversing the bits of each unit, and rotations
+ * are done by transposing blocks of BITMAP_BITS x BITMAP_BITS pixels.
  */
 
-void bitmap_flip_horizontally(BITMAP *bm)
+#ifdef WORD_BIG_ENDIAN
+#define SHIFT_TO_FIRST(u,n)	((u) << (n))
+#define SHIFT_TO_LAST(u,n)	((u) >> (n))
+#define BLOCK_ROW(i)		(BITMAP_BITS - 1 - (i))
+#else
+#define SHIFT_TO_FIRST(u,n)	((u) >> (n))
+#define SHIFT_TO_LAST(u,n)	((u) << (n))
+#define BLOCK_ROW(i)		(i)
+#endif
+
+/* reverses the order of the pixels in a unit */
+static BmUnit bm_unit_reverse(BmUnit u)
 {
-	BITMAP	nb;
-	BmUnit	*fptr, *tptr;
-	BmUnit	fmask, tmask;
-	int	w, h;
+	return ((BmUnit)bit_swap[u & 0xff] << 24) |
+	       ((BmUnit)bit_swap[(u >> 8) & 0xff] << 16) |
+	       ((BmUnit)bit_swap[(u >> 16) & 0xff] << 8) |
+	       (BmUnit)bit_swap[u >> 24];
+}
 
-	nb.width = bm->width;
-	nb.height = bm->height;
-	nb.stride = bm->stride;
-	nb.data = mdvi_calloc(bm->height, bm->stride);
-		
-	fptr = bm->data;
-	tptr = __bm_unit_ptr(&nb, nb.width-1, 0);
-	for(h = 0; h < bm->height; h++) {
-		BmUnit	*fline, *tline;
-		
-		fline = fptr; 
-		tline = tptr;
-		fmask = FIRSTMASK;
-		tmask = FIRSTMASKAT(nb.width-1);
-		for(w = 0; w < bm->width; w++) {
-			if(*fline & fmask)
-				*tline |= tmask;
-			if(fmask == LASTMASK) {
-				fmask = FIRSTMASK;
-				fline++;
-			} else
-				NEXTMASK(fmask);
-			if(tmask == FIRSTMASK) {
-				tmask = LASTMASK;
-				tline--;
-			} else
-				PREVMASK(tmask);
+/* copies a row of `width' pixels, clearing the unused bits */
+static void bm_copy_row(BmUnit *from, BmUnit *to, int width)
+{
+	int	units = ROUND(width, BITMAP_BITS);
+
+	memcpy(to, from, units * BITMAP_BYTES);
+	if(width % BITMAP_BITS)
+		to[units - 1] &= SEGMENT(width % BITMAP_BITS, 0);
+}
+
+/* copies a row of `width' pixels in reverse order */
+static void bm_mirror_row(BmUnit *from, BmUnit *to, int width)
+{
+	int	units = ROUND(width, BITMAP_BITS);
+	int	pad = units * BITMAP_BITS - width;
+	BmUnit	curr, next;
+	int	i;
+
+	if(units == 0)
+		return;
+	/* 
+	 * reversing the whole units leaves `pad' unused columns at the
+	 * start of the row, so the pixels are moved back by that much 
+	 */
+	next = bm_unit_reverse(from[units - 1]);
+	for(i = 0; i < units; i++) {
+		curr = next;
+		next = (i + 1 < units) ? bm_unit_reverse(from[units - 2 - i]) : 0;
+		if(pad)
+			to[i] = SHIFT_TO_FIRST(curr, pad) |
+				SHIFT_TO_LAST(next, BITMAP_BITS - pad);
+		else
+			to[i] = curr;
+	}
+}
+
+/*
+ * transposes a block of BITMAP_BITS x BITMAP_BITS pixels in which bit `j'
+ * of a[i] is pixel (i, j), by swapping ever smaller sub-blocks across
+ * the diagonal
+ */
+static void bm_transpose_block(BmUnit *a)
+{
+	BmUnit	m, t;
+	int	j, k;
+
+	m = 0x0000ffff;
+	for(j = 16; j; j >>= 1, m ^= m << j) {
+		for(k = 0; k < BITMAP_BITS; k = ((k | j) + 1) & ~j) {
+			t = ((a[k] >> j) ^ a[k + j]) & m;
+			a[k] ^= t << j;
+			a[k + j] ^= t;
 		}
-		fptr = bm_offset(fptr, bm->stride);
-		tptr = bm_offset(tptr, bm->stride);
 	}
-	DEBUG((DBG_BITMAP_OPS, "flip_horizontally (%d,%d) -> (%d,%d)\n",
-		bm->width, bm->height, nb.width, nb.height));
+}
+
+/* pixel (x, y) of `bm' becomes pixel (y, x) of `nb' */
+static void bm_transpose(BITMAP *bm, BITMAP *nb)
+{
+	BmUnit	block[BITMAP_BITS];
+	int	x, y, i;
+	int	rows, cols;
+
+	for(y = 0; y < bm->height; y += BITMAP_BITS) {
+		rows = Min(BITMAP_BITS, bm->height - y);
+		for(x = 0; x < bm->width; x += BITMAP_BITS) {
+			cols = Min(BITMAP_BITS, bm->width - x);
+			for(i = 0; i < rows; i++)
+				block[BLOCK_ROW(i)] = *__bm_unit_ptr(bm, x, y + i);
+			for(; i < BITMAP_BITS; i++)
+				block[BLOCK_ROW(i)] = 0;
+			bm_transpose_block(block);
+			for(i = 0; i < cols; i++)
+				*__bm_unit_ptr(nb, y, x + i) = block[BLOCK_ROW(i)];
+		}
+	}
+}
+
+/* 
+ * transposes the bitmap if requested, then mirrors its rows and/or
+ * puts them in reverse order
+ */
+static void bm_transform(BITMAP *bm, int transpose, 
+	int horizontally, int vertically)
+{
+	BITMAP	nb;
+	BmUnit	*fptr, *tptr, *data;
+	int	stride;
+	int	h;
+
+	if(transpose) {
+		nb.width = bm->height;
+		nb.height = bm->width;
+		nb.stride = BM_BYTES_PER_LINE(&nb);
+		nb.data = mdvi_calloc(nb.height, nb.stride);
+		bm_transpose(bm, &nb);
+	} else
+		nb = *bm;
+
+	if(horizontally || vertically) {
+		data = mdvi_calloc(nb.height, nb.stride);
+		fptr = nb.data;
+		if(vertically) {
+			tptr = bm_offset(data, (nb.height - 1) * nb.stride);
+			stride = -nb.stride;
+		} else {
+			tptr = data;
+			stride = nb.stride;
+		}
+		for(h = 0; h < nb.height; h++) {
+			if(horizontally)
+				bm_mirror_row(fptr, tptr, nb.width);
+			else
+				bm_copy_row(fptr, tptr, nb.width);
+			fptr = bm_offset(fptr, nb.stride);
+			tptr = bm_offset(tptr, stride);
+		}
+		if(transpose)
+			mdvi_free(nb.data);
+		nb.data = data;
+	}
+
 	mdvi_free(bm->data);
-	bm->data = nb.data;
+	*bm = nb;
+}
+
+void bitmap_flip_horizontally(BITMAP *bm)
+{
+	DEBUG((DBG_BITMAP_OPS, "flip_horizontally (%d,%d) -> (%d,%d)\n",
+		bm->width, bm->height, bm->width, bm->height));
+	bm_transform(bm, 0, 1, 0);
 	if(SHOW_OP_DATA)
 		bitmap_print(stderr, bm);
 }
 
 void	bitmap_flip_vertically(BITMAP *bm)
 {
-	BITMAP	nb;
-	BmUnit	*fptr, *tptr;
-	BmUnit	fmask;
-	int	w, h;
-
-	nb.width = bm->width;
-	nb.height = bm->height;
-	nb.stride = bm->stride;
-	nb.data = mdvi_calloc(bm->height, bm->stride);
-	
-	fptr = bm->data;
-	tptr = __bm_unit_ptr(&nb, 0, nb.height-1);
-	for(h = 0; h < bm->height; h++) {
-		BmUnit	*fline, *tline;
-		
-		fline = fptr; 
-		tline = tptr;
-		fmask = FIRSTMASK;
-		for(w = 0; w < bm->width; w++) {
-			if(*fline & fmask)
-				*tline |= fmask;
-			if(fmask == LASTMASK) {
-				fmask = FIRSTMASK;
-				fline++;
-				tline++;
-			} else
-				NEXTMASK(fmask);
-		}
-		fptr = bm_offset(fptr, bm->stride);
-		tptr = (BmUnit *)((char *)tptr - bm->stride);
-	}
 	DEBUG((DBG_BITMAP_OPS, "flip_vertically (%d,%d) -> (%d,%d)\n",
-		bm->width, bm->height, nb.width, nb.height));
-	mdvi_free(bm->data);
-	bm->data = nb.data;
+		bm->width, bm->height, bm->width, bm->height));
+	bm_transform(bm, 0, 0, 1);
 	if(SHOW_OP_DATA)
 		bitmap_print(stderr, bm);
 }
 
 void	bitmap_flip_diagonally(BITMAP *bm)
 {
-	BITMAP	nb;
-	BmUnit	*fptr, *tptr;
-	BmUnit	fmask, tmask;
-	int	w, h;
-	
-	nb.width = bm->width;
-	nb.height = bm->height;
-	nb.stride = bm->stride;
-	nb.data = mdvi_calloc(bm->height, bm->stride);
-	
-	fptr = bm->data;
-	tptr = __bm_unit_ptr(&nb, nb.width-1, nb.height-1);
-	for(h = 0; h < bm->height; h++) {
-		BmUnit	*fline, *tline;
-		
-		fline = fptr; 
-		tline = tptr;
-		fmask = FIRSTMASK;
-		tmask = FIRSTMASKAT(nb.width-1);
-		for(w = 0; w < bm->width; w++) {
-			if(*fline & fmask)
-				*tline |= tmask;
-			if(fmask == LASTMASK) {
-				fmask = FIRSTMASK;
-				fline++;
-			} else
-				NEXTMASK(fmask);
-			if(tmask == FIRSTMASK) {
-				tmask = LASTMASK;
-				tline--;
-			} else
-				PREVMASK(tmask);
-		}
-		fptr = bm_offset(fptr, bm->stride);
-		tptr = bm_offset(tptr, -nb.stride);
-	}
 	DEBUG((DBG_BITMAP_OPS, "flip_diagonally (%d,%d) -> (%d,%d)\n",
-		bm->width, bm->height, nb.width, nb.height));
-	mdvi_free(bm->data);
-	bm->data = nb.data;
+		bm->width, bm->height, bm->width, bm->height));
+	bm_transform(bm, 0, 1, 1);
 	if(SHOW_OP_DATA)
 		bitmap_print(stderr, bm);
 }
 
 void	bitmap_rotate_clockwise(BITMAP *bm)
 {
-	BITMAP	nb;
-	BmUnit	*fptr, *tptr;
-	BmUnit	fmask, tmask;
-	int	w, h;
-	
-	nb.width = bm->height;
-	nb.height = bm->width;
-	nb.stride = BM_BYTES_PER_LINE(&nb);
-	nb.data = mdvi_calloc(nb.height, nb.stride);
-	
-	fptr = bm->data;
-	tptr = __bm_unit_ptr(&nb, nb.width - 1, 0);
-	
-	tmask = FIRSTMASKAT(nb.width-1);
-	for(h = 0; h < bm->height; h++) {
-		BmUnit	*fline, *tline;
-		
-		fmask = FIRSTMASK;
-		fline = fptr;
-		tline = tptr;
-		for(w = 0; w < bm->width; w++) {
-			if(*fline & fmask)
-				*tline |= tmask;
-			if(fmask == LASTMASK) {
-				fmask = FIRSTMASK;
-				fline++;
-			} else
-				NEXTMASK(fmask);
-			/* go to next row */
-			tline = bm_offset(tline, nb.stride);
-		}
-		fptr = bm_offset(fptr, bm->stride);
-		if(tmask == FIRSTMASK) {
-			tmask = LASTMASK;
-			tptr--;
-		} else
-			PREVMASK(tmask);
-	}
-
 	DEBUG((DBG_BITMAP_OPS, "rotate_clockwise (%d,%d) -> (%d,%d)\n",
-		bm->width, bm->height, nb.width, nb.height));
-	mdvi_free(bm->data);
-	bm->data = nb.data;
-	bm->width = nb.width;
-	bm->height = nb.height;	
-	bm->stride = nb.stride;
+		bm->width, bm->height, bm->height, bm->width));
+	bm_transform(bm, 1, 1, 0);
 	if(SHOW_OP_DATA)
 		bitmap_print(stderr, bm);
 }
 
 void	bitmap_rotate_counter_clockwise(BITMAP *bm)
 {
-	BITMAP	nb;
-	BmUnit	*fptr, *tptr;
-	BmUnit	fmask, tmask;
-	int	w, h;
-	
-	nb.width = bm->height;
-	nb.height = bm->width;
-	nb.stride = BM_BYTES_PER_LINE(&nb);
-	nb.data = mdvi_calloc(nb.height, nb.stride);
-	
-	fptr = bm->data;
-	tptr = __bm_unit_ptr(&nb, 0, nb.height - 1);
-
-	tmask = FIRSTMASK;
-	for(h = 0; h < bm->height; h++) {
-		BmUnit	*fline, *tline;
-		
-		fmask = FIRSTMASK;
-		fline = fptr;
-		tline = tptr;
-		for(w = 0; w < bm->width; w++) {
-			if(*fline & fmask)
-				*tline |= tmask;
-			if(fmask == LASTMASK) {
-				fmask = FIRSTMASK;
-				fline++;
-			} else
-				NEXTMASK(fmask);
-			/* go to previous row */
-			tline = bm_offset(tline, -nb.stride);
-		}
-		fptr = bm_offset(fptr, bm->stride);
-		if(tmask == LASTMASK) {
-			tmask = FIRSTMASK;
-			tptr++;
-		} else
-			NEXTMASK(tmask);
-	}
-
 	DEBUG((DBG_BITMAP_OPS, "rotate_counter_clockwise (%d,%d) -> (%d,%d)\n",
-		bm->width, bm->height, nb.width, nb.height));
-	mdvi_free(bm->data);
-	bm->data = nb.data;
-	bm->width = nb.width;
-	bm->height = nb.height;	
-	bm->stride = nb.stride;
+		bm->width, bm->height, bm->height, bm->width));
+	bm_transform(bm, 1, 0, 1);
 	if(SHOW_OP_DATA)
 		bitmap_print(stderr, bm);
 }
 
 void	bitmap_flip_rotate_clockwise(BITMAP *bm)
 {
-	BITMAP	nb;
-	BmUnit	*fptr, *tptr;
-	BmUnit	fmask, tmask;
-	int	w, h;
-	
-	nb.width = bm->height;
-	nb.height = bm->width;
-	nb.stride = BM_BYTES_PER_LINE(&nb);
-	nb.data = mdvi_calloc(nb.height, nb.stride);
-	
-	fptr = bm->data;
-	tptr = __bm_unit_ptr(&nb, nb.width-1, nb.height-1);
-
-	tmask = FIRSTMASKAT(nb.width-1);	
-	for(h = 0; h < bm->height; h++) {
-		BmUnit	*fline, *tline;
-
-		fmask = FIRSTMASK;
-		fline = fptr;
-		tline = tptr;
-		for(w = 0; w < bm->width; w++) {
-			if(*fline & fmask)
-				*tline |= tmask;
-			if(fmask == LASTMASK) {
-				fmask = FIRSTMASK;
-				fline++;
-			} else
-				NEXTMASK(fmask);
-			/* go to previous line */
-			tline = bm_offset(tline, -nb.stride);
-		}
-		fptr = bm_offset(fptr, bm->stride);
-		if(tmask == FIRSTMASK) {
-			tmask = LASTMASK;
-			tptr--;
-		} else
-			PREVMASK(tmask);
-	}
 	DEBUG((DBG_BITMAP_OPS, "flip_rotate_clockwise (%d,%d) -> (%d,%d)\n",
-		bm->width, bm->height, nb.width, nb.height));
-	mdvi_free(bm->data);
-	bm->data = nb.data;
-	bm->width = nb.width;
-	bm->height = nb.height;	
-	bm->stride = nb.stride;
+		bm->width, bm->height, bm->height, bm->width));
+	bm_transform(bm, 1, 1, 1);
 	if(SHOW_OP_DATA)
 		bitmap_print(stderr, bm);
 }
 
 void	bitmap_flip_rotate_counter_clockwise(BITMAP *bm)
 {
-	BITMAP	nb;
-	BmUnit	*fptr, *tptr;
-	BmUnit	fmask, tmask;
-	int	w, h;
-	
-	nb.width = bm->height;
-	nb.height = bm->width;
-	nb.stride = BM_BYTES_PER_LINE(&nb);
-	nb.data = mdvi_calloc(nb.height, nb.stride);
-	
-	fptr = bm->data;
-	tptr = nb.data;
-	tmask = FIRSTMASK;
-	
-	for(h = 0; h < bm->height; h++) {
-		BmUnit	*fline, *tline;
-
-		fmask = FIRSTMASK;
-		fline = fptr;
-		tline = tptr;
-		for(w = 0; w < bm->width; w++) {
-			if(*fline & fmask)
-				*tline |= tmask;
-			if(fmask == LASTMASK) {
-				fmask = FIRSTMASK;
-				fline++;
-			} else
-				NEXTMASK(fmask);
-			/* go to next line */
-			tline = bm_offset(tline, nb.stride);
-		}
-		fptr = bm_offset(fptr, bm->stride);
-		if(tmask == LASTMASK) {
-			tmask = FIRSTMASK;
-			tptr++;
-		} else
-			NEXTMASK(tmask);
-	}
-
 	DEBUG((DBG_BITMAP_OPS, "flip_rotate_counter_clockwise (%d,%d) -> (%d,%d)\n",
-		bm->width, bm->height, nb.width, nb.height));
-	mdvi_free(bm->data);
-	bm->data = nb.data;
-	bm->width = nb.width;
-	bm->height = nb.height;	
-	bm->stride = nb.stride;
+		bm->width, bm->height, bm->height, bm->width));
+	bm_transform(bm, 1, 0, 0);
 	if(SHOW_OP_DATA)
 		bitmap_print(stderr, bm);
 }
@@ -752,50 +633,30 @@ void	bitmap_transform(BITMAP *map, DviOrientation orient)
  * Count the number of non-zero bits in a box of dimensions w x h, starting
  * at column `step' in row `data'.
  * 
- * Shamelessly stolen from xdvi.
+ * Originally from xdvi, now counting whole units at a time.
  */
 static int do_sample(BmUnit *data, int stride, int step, int w, int h)
 {
 	BmUnit	*ptr, *end, *cp;
-	int	shift, n;
-	int	bits_left;
+	BmUnit	mask;
+	int	col, n;
 	int	wid;
 	
 	ptr = data + step / BITMAP_BITS;
 	end = bm_offset(data, h * stride);
-	shift = FIRSTSHIFTAT(step);
-	bits_left = w;
+	col = step % BITMAP_BITS;
 	n = 0;
-	while(bits_left) {
-#ifndef WORD_BIG_ENDIAN
-		wid = BITMAP_BITS - shift;
-#else
-		wid = shift;
-#endif
-		if(wid > bits_left)
-			wid = bits_left;
-		if(wid > 8)
-			wid = 8;
-#ifdef WORD_BIG_ENDIAN
-		shift -= wid;
-#endif
+	while(w > 0) {
+		/* the part of the box within this unit */
+		wid = BITMAP_BITS - col;
+		if(wid > w)
+			wid = w;
+		mask = SEGMENT(wid, col);
 		for(cp = ptr; cp < end; cp = bm_offset(cp, stride))
-			n += sample_count[(*cp >> shift) & bit_masks[wid]];
-#ifndef WORD_BIG_ENDIAN
-		shift += wid;
-#endif
-#ifdef WORD_BIG_ENDIAN
-		if(shift == 0) {
-			shift = BITMAP_BITS;
-			ptr++;
-		}
-#else
-		if(shift == BITMAP_BITS) {
-			shift = 0;
-			ptr++;
-		}
-#endif
-		bits_left -= wid;
+			n += bm_popcount(*cp & mask);
+		w -= wid;
+		col = 0;
+		ptr++;
 	}
 	return n;
 }
@@ -933,6 +794,7 @@ void	mdvi_shrink_glyph_grey(DviContext *dvi, DviFont *font,
 	Ulong	*pixels;
 	int	npixels;
 	Ulong	colortab[2];
+	Ulong	*row;
 	int	hs, vs;
 	DviDevice *dev;
 
@@ -990,6 +852,11 @@ void	mdvi_shrink_glyph_grey(DviContext *dvi, DviFont *font,
 	dest->w = w;
 	dest->h = h;
 
+	/* glyphs are written a row at a time when the device can */
+	row = NULL;
+	if(dev->put_row)
+		row = xnalloc(Ulong, w);
+
 	y = 0;
 	old_ptr = map->data;
 	rows_left = glyph->h;
@@ -1009,23 +876,42 @@ void	mdvi_shrink_glyph_grey(DviContext *dvi, DviFont *font,
 			if(npixels - 1 != samplemax)
 				sampleval = ((npixels-1) * sampleval) / samplemax;
 			ASSERT(sampleval < npixels);
-			dev->put_pixel(image, x, y, pixels[sampleval]);
+			if(row)
+				row[x] = pixels[sampleval];
+			else
+				dev->put_pixel(image, x, y, pixels[sampleval]);
 			cols_left -= cols;
 			cols = hs;
 			x++;
 		}
-		for(; x < w; x++)
-			dev->put_pixel(image, x, y, pixels[0]);
+		for(; x < w; x++) {
+			if(row)
+				row[x] = pixels[0];
+			else
+				dev->put_pixel(image, x, y, pixels[0]);
+		}
+		if(row)
+			dev->put_row(image, y, row, w);
 		old_ptr = bm_offset(old_ptr, rows * map->stride);
 		rows_left -= rows;
 		rows = vs;
 		y++;
 	}
 	
+	if(row) {
+		for(x = 0; x < w; x++)
+			row[x] = pixels[0];
+	}
 	for(; y < h; y++) {
+		if(row) {
+			dev->put_row(image, y, row, w);
+			continue;
+		}
 		for(x = 0; x < w; x++)
 			dev->put_pixel(image, x, y, pixels[0]);
 	}
+	if(row)
+		mdvi_free(row);
 
         dev->image_done(image);
 	DEBUG((DBG_BITMAPS, "shrink_glyph_grey: (%dw,%dh,%dx,%dy) -> (%dw,%dh,%dx,%dy)\n",
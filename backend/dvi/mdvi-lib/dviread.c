@@ -562,17 +562,16 @@ int mdvi_configure(DviContext *dvi, DviParamCode option, ...)
 		case MDVI_SET_YDPI:
 			np.vdpi = va_arg(ap, Uint);
 			break;
+		/* font_get_glyph() rescales glyphs made with other
+		 * shrink factors, so they don't need to be reset */
 		case MDVI_SET_SHRINK:
 			np.hshrink = np.vshrink = va_arg(ap, Uint);
-			reset_font = MDVI_FONTSEL_GREY|MDVI_FONTSEL_BITMAP;
 			break;
 		case MDVI_SET_XSHRINK:
 			np.hshrink = va_arg(ap, Uint);
-			reset_font = MDVI_FONTSEL_GREY|MDVI_FONTSEL_BITMAP;
 			break;
 		case MDVI_SET_YSHRINK:
 			np.vshrink = va_arg(ap, Uint);
-			reset_font = MDVI_FONTSEL_GREY|MDVI_FONTSEL_BITMAP;
 			break;
 		case MDVI_SET_ORIENTATION:
 			np.orientation = va_arg(ap, DviOrientation);
@@ -891,8 +890,10 @@ DviContext *mdvi_init_context(DviParams *par, DviPageSpec *spec, const char *fil
 	dvi->device.alloc_colors = dummy_alloc_colors;
 	dvi->device.create_image = dummy_create_image;
 	dvi->device.free_image   = dummy_free_image;
+	dvi->device.ref_image    = NULL;
 	dvi->device.dev_destroy  = dummy_dev_destroy;
 	dvi->device.put_pixel    = dummy_dev_putpixel;
+	dvi->device.put_row      = NULL;
 	dvi->device.refresh      = dummy_dev_refresh;
 	dvi->device.set_color    = dummy_dev_set_color;
 	dvi->device.device_data  = NULL;
@@ -1020,7 +1021,9 @@ again:
 	
 	/* check if we need to reload the file */
 	if(!reloaded && get_mtime(fileno(dvi->in)) > dvi->modtime) {
+		mdvi_lock_fonts();
 		mdvi_reload(dvi, &dvi->params);
+		mdvi_unlock_fonts();
 		/* we have to reopen the file, again */
 		reloaded = 1;
 		goto again;
@@ -1246,7 +1249,9 @@ int	set_char(DviContext *dvi, int opcode)
 	int	num;
 	int	h;
 	int	hh;
+	int	draw;
 	DviFontChar *ch;
+	DviFontChar glyph;
 	DviFont	*font;
 	
 	if(opcode < 128)
@@ -1258,35 +1263,56 @@ int	set_char(DviContext *dvi, int opcode)
 		return -1;
 	}
 	font = dvi->currfont->ref;
+	/* other contexts may change the glyph once the fonts are unlocked,
+	 * so it's drawn from a copy, holding a reference on its image */
+	mdvi_lock_fonts();
 	ch = font_get_glyph(dvi, font, num);
 	if(ch == NULL || ch->missing) {
 		/* try to display something anyway */
 		ch = FONTCHAR(font, num);
 		if(!glyph_present(ch)) {
+			mdvi_unlock_fonts();
 			dviwarn(dvi, 
 			_("requested character %d does not exist in `%s'\n"), 
 				num, font->fontname);
 			return 0;
 		}
-		draw_box(dvi, ch);
-	} else if(dvi->curr_layer <= dvi->params.layer) {
-		if(ISVIRTUAL(font))
-			mdvi_run_macro(dvi, (Uchar *)font->private + 
-				ch->offset, ch->width);
-		else if(ch->width && ch->height)
-			dvi->device.draw_glyph(dvi, ch, 
+		glyph = *ch;
+		mdvi_unlock_fonts();
+		draw_box(dvi, &glyph);
+	} else {
+		draw = dvi->curr_layer <= dvi->params.layer &&
+			!ISVIRTUAL(font) && ch->width && ch->height;
+		glyph = *ch;
+		if(draw && dvi->device.ref_image == NULL) {
+			/* the image can't be kept, draw it right away */
+			dvi->device.draw_glyph(dvi, &glyph, 
+				dvi->pos.hh, dvi->pos.vv);
+			draw = 0;
+		} else if(draw && MDVI_GLYPH_NONEMPTY(glyph.grey.data))
+			dvi->device.ref_image(glyph.grey.data);
+		mdvi_unlock_fonts();
+		if(draw) {
+			dvi->device.draw_glyph(dvi, &glyph, 
 				dvi->pos.hh, dvi->pos.vv);
+			if(MDVI_GLYPH_NONEMPTY(glyph.grey.data))
+				dvi->device.free_image(glyph.grey.data);
+		} else if(dvi->curr_layer <= dvi->params.layer && ISVIRTUAL(font)) {
+			/* the macro gets the glyphs it draws by itself */
+			mdvi_run_macro(dvi, (Uchar *)font->private + 
+				glyph.offset, glyph.width);
+		}
 	}
 	if(opcode >= DVI_PUT1 && opcode <= DVI_PUT4) {
 		SHOWCMD((dvi, "putchar", opcode - DVI_PUT1 + 1,
 			"char %d (%s)\n",
 			num, dvi->currfont->ref->fontname));
 	} else {
-		h = dvi->pos.h + ch->tfmwidth;
-		hh = dvi->pos.hh + pixel_round(dvi, ch->tfmwidth);
+		h = dvi->pos.h + glyph.tfmwidth;
+		hh = dvi->pos.hh + pixel_round(dvi, glyph.tfmwidth);
 		SHOWCMD((dvi, "setchar", num, "(%d,%d) h:=%d%c%d=%d, hh:=%d (%s)\n",
 			dvi->pos.hh, dvi->pos.vv,
-			DBGSUM(dvi->pos.h, ch->tfmwidth, h), hh,
+			DBGSUM(dvi->pos.h, glyph.tfmwidth, h), hh,
 			font->fontname));
 		dvi->pos.h  = h;
 		dvi->pos.hh = hh;
@@ -23,6 +23,8 @@
 #include "private.h"
 
 static ListHead fontlist;
+static void (*font_lock_func) __PROTO((void)) = NULL;
+static void (*font_unlock_func) __PROTO((void)) = NULL;
 
 extern char *_mdvi_fallback_font;
 
@@ -343,6 +345,77 @@ static int load_one_glyph(DviContext *dvi, DviFont *font, int code)
 	return 0;
 }
 
+void	mdvi_set_font_lock(void (*lock)(void), void (*unlock)(void))
+{
+	font_lock_func = lock;
+	font_unlock_func = unlock;
+}
+
+void	mdvi_lock_fonts(void)
+{
+	if(font_lock_func)
+		font_lock_func();
+}
+
+void	mdvi_unlock_fonts(void)
+{
+	if(font_unlock_func)
+		font_unlock_func();
+}
+
+/* keeps the current grey glyph of a character for later reuse */
+static void font_cache_grey(DviDevice *dev, DviFontChar *ch)
+{
+	DviScaledGlyph *sg, **prev;
+	int	n;
+
+	if(MDVI_GLYPH_NONEMPTY(ch->grey.data)) {
+		sg = xalloc(DviScaledGlyph);
+		sg->hshrink = ch->hshrink;
+		sg->vshrink = ch->vshrink;
+		sg->fg = ch->fg;
+		sg->bg = ch->bg;
+		sg->grey = ch->grey;
+		sg->next = ch->scaled;
+		ch->scaled = sg;
+	}
+	ch->grey.data = NULL;
+
+	/* drop the least recently used ones */
+	for(prev = &ch->scaled, n = 0; (sg = *prev); n++) {
+		if(n < MDVI_MAX_SCALED_GLYPHS) {
+			prev = &sg->next;
+			continue;
+		}
+		*prev = sg->next;
+		if(dev->free_image)
+			dev->free_image(sg->grey.data);
+		mdvi_free(sg);
+	}
+}
+
+/* brings back the grey glyph kept for the current shrink factors
+ * and colors, if there is one */
+static int font_uncache_grey(DviContext *dvi, DviFontChar *ch)
+{
+	DviScaledGlyph *sg, **prev;
+
+	for(prev = &ch->scaled; (sg = *prev); prev = &sg->next) {
+		if(sg->hshrink == dvi->params.hshrink &&
+		   sg->vshrink == dvi->params.vshrink &&
+		   sg->fg == dvi->curr_fg && 
+		   sg->bg == dvi->curr_bg) {
+			*prev = sg->next;
+			ch->grey = sg->grey;
+			ch->fg = sg->fg;
+			ch->bg = sg->bg;
+			mdvi_free(sg);
+			return 1;
+		}
+	}
+	return 0;
+}
+
 DviFontChar *font_get_glyph(DviContext *dvi, DviFont *font, int code)
 {
 	DviFontChar *ch;
@@ -366,6 +439,17 @@ again:
 	/* yes, we have to do this again */
 	ch = FONTCHAR(font, code);
 
+	/* the scaled glyphs may have been made at another zoom level, 
+	 * or by a context using other shrink factors. This is checked
+	 * first so that they aren't drawn unshrunk either */
+	if(ch->hshrink != dvi->params.hshrink || 
+	   ch->vshrink != dvi->params.vshrink) {
+		font_reset_one_glyph(&dvi->device, ch, MDVI_FONTSEL_BITMAP);
+		font_cache_grey(&dvi->device, ch);
+		ch->hshrink = dvi->params.hshrink;
+		ch->vshrink = dvi->params.vshrink;
+	}
+
 	/* Got the glyph. If we also have the right scaled glyph, do no more */
 	if(!ch->width || !ch->height ||
 	   font->finfo->getglyph == NULL ||
@@ -383,13 +467,9 @@ again:
 		   ch->fg == dvi->curr_fg && 
 		   ch->bg == dvi->curr_bg)
 		   	return ch;
-		if(ch->grey.data &&
-		   !MDVI_GLYPH_ISEMPTY(ch->grey.data)) {
-			if(dvi->device.free_image)
-				dvi->device.free_image(ch->grey.data);
-			ch->grey.data = NULL;
-		}
-		font->finfo->shrink1(dvi, font, ch, &ch->grey);
+		font_cache_grey(&dvi->device, ch);
+		if(!font_uncache_grey(dvi, ch))
+			font->finfo->shrink1(dvi, font, ch, &ch->grey);
 	} else if(!ch->shrunk.data)
 		font->finfo->shrink0(dvi, font, ch, &ch->shrunk);
 
@@ -411,6 +491,14 @@ void	font_reset_one_glyph(DviDevice *dev, DviFontChar *ch, int what)
 				dev->free_image(ch->grey.data);
 		}
 		ch->grey.data = NULL;
+		while(ch->scaled) {
+			DviScaledGlyph *sg = ch->scaled;
+
+			ch->scaled = sg->next;
+			if(dev->free_image)
+				dev->free_image(sg->grey.data);
+			mdvi_free(sg);
+		}
 	}
 	if(what & MDVI_FONTSEL_GLYPH) {
 		if(MDVI_GLYPH_NONEMPTY(ch->glyph.data))
@@ -31,6 +31,7 @@
 typedef struct _DviGlyph DviGlyph;
 typedef struct _DviDevice DviDevice;
 typedef struct _DviFontChar DviFontChar;
+typedef struct _DviScaledGlyph DviScaledGlyph;
 typedef struct _DviFontRef DviFontRef;
 typedef struct _DviFontInfo DviFontInfo;
 typedef struct _DviFont DviFont;
@@ -98,7 +99,10 @@ typedef void *(*DviCreateImage)	__PROTO((void *device_data,
 				         Uint height,
 				         Uint bpp));
 typedef void (*DviFreeImage)	__PROTO((void *image));
+typedef void (*DviRefImage)	__PROTO((void *image));
 typedef void (*DviPutPixel)	__PROTO((void *image, int x, int y, Ulong color));
+typedef void (*DviPutRow)	__PROTO((void *image, int y, 
+					 const Ulong *colors, int count));
 typedef void (*DviImageDone)    __PROTO((void *image));
 typedef void (*DviDevDestroy)   __PROTO((void *data));
 typedef void (*DviRefresh)      __PROTO((DviContext *dvi, void *device_data));
@@ -114,7 +118,9 @@ struct _DviDevice {
 	DviColorScale	alloc_colors;
 	DviCreateImage	create_image;
 	DviFreeImage	free_image;
+	DviRefImage	ref_image;	/* optional, undone by free_image */
 	DviPutPixel	put_pixel;
+	DviPutRow	put_row;	/* optional, faster than put_pixel */
         DviImageDone    image_done;
 	DviDevDestroy	dev_destroy;
 	DviRefresh	refresh;
@@ -196,11 +202,27 @@ struct _DviFontChar {
 #endif
 	Ulong	fg;
 	Ulong	bg;
+	Uint	hshrink;	/* shrink factors of `shrunk' and `grey' */
+	Uint	vshrink;
 	BITMAP	*glyph_data;
 	/* data for shrunk bitimaps */
 	DviGlyph glyph;
 	DviGlyph shrunk;
 	DviGlyph grey;
+	/* grey glyphs made for other shrink factors or colors */
+	DviScaledGlyph *scaled;
+};
+
+/* at most this many of them are kept for each character */
+#define MDVI_MAX_SCALED_GLYPHS	4
+
+struct _DviScaledGlyph {
+	DviScaledGlyph *next;
+	Uint	hshrink;
+	Uint	vshrink;
+	Ulong	fg;
+	Ulong	bg;
+	DviGlyph grey;
 };
 
 struct _DviFontRef {
@@ -588,6 +610,15 @@ extern int font_reopen __PROTO((DviFont *));
 /* reads a glyph from a font, and makes all necessary transformations */
 extern DviFontChar* font_get_glyph __PROTO((DviContext *, DviFont *, int));
 
+/* 
+ * fonts are shared by all contexts; for contexts to be used from several
+ * threads at once, the application provides a lock that MDVI takes while
+ * it loads, shrinks and draws glyphs
+ */
+extern void mdvi_set_font_lock __PROTO((void (*)(void), void (*)(void)));
+extern void mdvi_lock_fonts __PROTO((void));
+extern void mdvi_unlock_fonts __PROTO((void));
+
 /* transform a glyph according to the given orientation */
 extern void font_transform_glyph __PROTO((DviOrientation, DviGlyph *));
 
@@ -425,6 +425,9 @@ static int t1_load_font(DviParams *params, DviFont *font)
 		font->chars[i].glyph.data = NULL;
 		font->chars[i].shrunk.data = NULL;
 		font->chars[i].grey.data = NULL;
+		font->chars[i].scaled = NULL;
+		font->chars[i].hshrink = 0;
+		font->chars[i].vshrink = 0;
 	}
 	
 	return 0;
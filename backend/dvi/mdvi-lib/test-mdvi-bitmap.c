@@ -0,0 +1,413 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Checks the bitmap transformations and the glyph shrinking routines
+ * against bit-at-a-time reference versions, using the glyphs of PK
+ * fonts, and measures how long both take.
+ *
+ * Usage: test-mdvi-bitmap FONT.pk...
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "mdvi.h"
+
+#define N_ITERATIONS	20
+
+extern DviFontInfo pk_font_info;
+
+static const int shrink_factors[] = { 2, 3, 4, 5, 6, 8 };
+
+#define N_SHRINK_FACTORS \
+	(int)(sizeof(shrink_factors) / sizeof(shrink_factors[0]))
+
+typedef void (*Transform) __PROTO((BITMAP *));
+
+static const struct {
+	const char *name;
+	Transform func;
+	int	transpose;
+	int	horizontally;
+	int	vertically;
+} transforms[] = {
+	{ "flip_horizontally", bitmap_flip_horizontally, 0, 1, 0 },
+	{ "flip_vertically", bitmap_flip_vertically, 0, 0, 1 },
+	{ "flip_diagonally", bitmap_flip_diagonally, 0, 1, 1 },
+	{ "rotate_clockwise", bitmap_rotate_clockwise, 1, 1, 0 },
+	{ "rotate_counter_clockwise", bitmap_rotate_counter_clockwise, 1, 0, 1 },
+	{ "flip_rotate_clockwise", bitmap_flip_rotate_clockwise, 1, 1, 1 },
+	{ "flip_rotate_counter_clockwise", bitmap_flip_rotate_counter_clockwise, 1, 0, 0 }
+};
+
+#define N_TRANSFORMS	(int)(sizeof(transforms) / sizeof(transforms[0]))
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* reference versions, one pixel at a time */
+
+static int ref_getpixel(BITMAP *bm, int x, int y)
+{
+	return (*__bm_unit_ptr(bm, x, y) & FIRSTMASKAT(x)) != 0;
+}
+
+static void ref_setpixel(BITMAP *bm, int x, int y)
+{
+	*__bm_unit_ptr(bm, x, y) |= FIRSTMASKAT(x);
+}
+
+static BITMAP *ref_transform(BITMAP *bm, int transpose,
+	int horizontally, int vertically)
+{
+	BITMAP	*nb;
+	int	x, y, tx, ty;
+
+	if(transpose)
+		nb = bitmap_alloc(bm->height, bm->width);
+	else
+		nb = bitmap_alloc(bm->width, bm->height);
+	for(y = 0; y < bm->height; y++) {
+		for(x = 0; x < bm->width; x++) {
+			if(!ref_getpixel(bm, x, y))
+				continue;
+			tx = transpose ? y : x;
+			ty = transpose ? x : y;
+			if(horizontally)
+				tx = nb->width - 1 - tx;
+			if(vertically)
+				ty = nb->height - 1 - ty;
+			ref_setpixel(nb, tx, ty);
+		}
+	}
+	return nb;
+}
+
+static int ref_sample(BITMAP *bm, int x0, int y0, int w, int h)
+{
+	int	x, y, n = 0;
+
+	for(y = y0; y < y0 + h; y++)
+		for(x = x0; x < x0 + w; x++)
+			n += ref_getpixel(bm, x, y);
+	return n;
+}
+
+/*
+ * Grey levels of each cell of a glyph shrunk by hs x vs, with the same
+ * cell layout as mdvi_shrink_glyph_grey(). Returns the number of cells.
+ */
+static int ref_shrink_grey(DviGlyph *glyph, int hs, int vs, Uchar *levels)
+{
+	BITMAP	*map = (BITMAP *)glyph->data;
+	int	x, y, w, h;
+	int	init_cols, init_rows;
+	int	row, rows, col, cols;
+	int	cx, cy;
+
+	x = (int)glyph->x / hs;
+	init_cols = (int)glyph->x - x * hs;
+	if(init_cols <= 0)
+		init_cols += hs;
+	else
+		x++;
+	w = x + ROUND((int)glyph->w - glyph->x, hs);
+
+	y = ((int)glyph->y + 1) / vs;
+	init_rows = (int)glyph->y + 1 - y * vs;
+	if(init_rows <= 0) {
+		init_rows += vs;
+		y--;
+	}
+	h = y + ROUND((int)glyph->h - (int)glyph->y - 1, vs) + 1;
+
+	memset(levels, 0, w * h);
+	for(row = 0, rows = init_rows, cy = 0; row < (int)glyph->h && cy < h;
+	    row += rows, rows = vs, cy++) {
+		if(row + rows > (int)glyph->h)
+			rows = glyph->h - row;
+		for(col = 0, cols = init_cols, cx = 0; col < (int)glyph->w && cx < w;
+		    col += cols, cols = hs, cx++) {
+			if(col + cols > (int)glyph->w)
+				cols = glyph->w - col;
+			levels[cy * w + cx] = ref_sample(map, col, row, cols, rows);
+		}
+	}
+	return w * h;
+}
+
+static int bitmaps_equal(BITMAP *a, BITMAP *b)
+{
+	int	x, y;
+
+	if(a->width != b->width || a->height != b->height)
+		return 0;
+	for(y = 0; y < a->height; y++)
+		for(x = 0; x < a->width; x++)
+			if(ref_getpixel(a, x, y) != ref_getpixel(b, x, y))
+				return 0;
+	return 1;
+}
+
+/*
+ * a device that keeps glyph images as one byte per pixel, holding the
+ * number of pixels set in each cell
+ */
+
+typedef struct {
+	int	width;
+	int	height;
+	Uchar	*data;
+} TestImage;
+
+static int test_alloc_colors(void *device_data, Ulong *pixels, int npixels,
+	Ulong fg, Ulong bg, double gamma, int density)
+{
+	int	i;
+
+	for(i = 0; i < npixels; i++)
+		pixels[i] = i;
+	return npixels;
+}
+
+static void *test_create_image(void *device_data, Uint w, Uint h, Uint bpp)
+{
+	TestImage *image = xalloc(TestImage);
+
+	image->width = w;
+	image->height = h;
+	image->data = mdvi_calloc(w, h);
+	return image;
+}
+
+static void test_free_image(void *ptr)
+{
+	TestImage *image = (TestImage *)ptr;
+
+	mdvi_free(image->data);
+	mdvi_free(image);
+}
+
+static void test_put_pixel(void *ptr, int x, int y, Ulong color)
+{
+	TestImage *image = (TestImage *)ptr;
+
+	image->data[y * image->width + x] = color;
+}
+
+static void test_put_row(void *ptr, int y, const Ulong *colors, int count)
+{
+	TestImage *image = (TestImage *)ptr;
+	int	x;
+
+	for(x = 0; x < count; x++)
+		image->data[y * image->width + x] = colors[x];
+}
+
+static void test_image_done(void *ptr)
+{
+}
+
+static int load_font(const char *filename, DviFont *font)
+{
+	DviParams params;
+	int	code;
+
+	memzero(&params, sizeof(DviParams));
+	memzero(font, sizeof(DviFont));
+	font->fontname = (char *)filename;
+	font->filename = (char *)filename;
+	font->search.info = &pk_font_info;
+	font->in = fopen(filename, "rb");
+	if(font->in == NULL || pk_font_info.load(&params, font) < 0) {
+		fprintf(stderr, "%s: could not load font\n", filename);
+		return -1;
+	}
+	for(code = font->loc; code <= font->hic; code++) {
+		if(glyph_present(FONTCHAR(font, code)))
+			pk_font_info.getglyph(&params, font, code);
+	}
+	fclose(font->in);
+	font->in = NULL;
+	return 0;
+}
+
+static int is_glyph(DviFontChar *ch)
+{
+	return glyph_present(ch) && ch->loaded &&
+		MDVI_GLYPH_NONEMPTY(ch->glyph.data);
+}
+
+static int test_transforms(DviFont *font)
+{
+	double	fast = 0, slow = 0, start;
+	int	i, code, iter;
+	int	failures = 0;
+
+	for(i = 0; i < N_TRANSFORMS; i++) {
+		for(code = font->loc; code <= font->hic; code++) {
+			DviFontChar *ch = FONTCHAR(font, code);
+			BITMAP	*bm, *ref;
+
+			if(!is_glyph(ch))
+				continue;
+			bm = bitmap_copy((BITMAP *)ch->glyph.data);
+			ref = ref_transform(bm, transforms[i].transpose,
+				transforms[i].horizontally, transforms[i].vertically);
+			transforms[i].func(bm);
+			if(!bitmaps_equal(bm, ref)) {
+				fprintf(stderr, "%s: %s differs for character %d\n",
+					font->filename, transforms[i].name, code);
+				failures++;
+			}
+			bitmap_destroy(bm);
+			bitmap_destroy(ref);
+		}
+	}
+
+	for(iter = 0; iter < N_ITERATIONS; iter++) {
+		for(code = font->loc; code <= font->hic; code++) {
+			DviFontChar *ch = FONTCHAR(font, code);
+			BITMAP	*bm;
+
+			if(!is_glyph(ch))
+				continue;
+			for(i = 0; i < N_TRANSFORMS; i++) {
+				bm = bitmap_copy((BITMAP *)ch->glyph.data);
+				start = now();
+				transforms[i].func(bm);
+				fast += now() - start;
+				bitmap_destroy(bm);
+
+				bm = (BITMAP *)ch->glyph.data;
+				start = now();
+				bm = ref_transform(bm, transforms[i].transpose,
+					transforms[i].horizontally,
+					transforms[i].vertically);
+				slow += now() - start;
+				bitmap_destroy(bm);
+			}
+		}
+	}
+	printf("%s: transforms %.3fs, reference %.3fs\n",
+		font->filename, fast, slow);
+
+	return failures;
+}
+
+static int test_shrink(DviFont *font, DviContext *dvi)
+{
+	Uchar	*levels;
+	int	i, code, iter;
+	int	failures = 0;
+
+	levels = mdvi_malloc(65536);
+	for(i = 0; i < N_SHRINK_FACTORS; i++) {
+		double	fast = 0, slow = 0, start;
+		int	hs = shrink_factors[i];
+
+		dvi->params.hshrink = dvi->params.vshrink = hs;
+		for(code = font->loc; code <= font->hic; code++) {
+			DviFontChar *ch = FONTCHAR(font, code);
+			DviGlyph grey;
+			TestImage *image;
+			int	n;
+
+			if(!is_glyph(ch))
+				continue;
+			if((ROUND(ch->glyph.w, hs) + 1) * (ROUND(ch->glyph.h, hs) + 1) > 65536)
+				continue;
+			mdvi_shrink_glyph_grey(dvi, font, ch, &grey);
+			image = (TestImage *)grey.data;
+			n = ref_shrink_grey(&ch->glyph, hs, hs, levels);
+			if(n != image->width * image->height ||
+			   memcmp(levels, image->data, n) != 0) {
+				fprintf(stderr, "%s: character %d shrunk by %d differs\n",
+					font->filename, code, hs);
+				failures++;
+			}
+			test_free_image(image);
+		}
+
+		for(iter = 0; iter < N_ITERATIONS; iter++) {
+			for(code = font->loc; code <= font->hic; code++) {
+				DviFontChar *ch = FONTCHAR(font, code);
+				DviGlyph grey;
+
+				if(!is_glyph(ch))
+					continue;
+				if((ROUND(ch->glyph.w, hs) + 1) * (ROUND(ch->glyph.h, hs) + 1) > 65536)
+					continue;
+				start = now();
+				mdvi_shrink_glyph_grey(dvi, font, ch, &grey);
+				fast += now() - start;
+				test_free_image(grey.data);
+
+				start = now();
+				ref_shrink_grey(&ch->glyph, hs, hs, levels);
+				slow += now() - start;
+			}
+		}
+		printf("%s: shrink by %d %.3fs, reference %.3fs\n",
+			font->filename, hs, fast, slow);
+	}
+	mdvi_free(levels);
+
+	return failures;
+}
+
+int main(int argc, char **argv)
+{
+	static DviContext dvi;
+	int	failures = 0;
+	int	i;
+
+	if(argc < 2) {
+		fprintf(stderr, "Usage: %s FONT.pk...\n", argv[0]);
+		return 1;
+	}
+
+	dvi.params.density = 50;
+	dvi.params.gamma = 1.0;
+	dvi.device.alloc_colors = test_alloc_colors;
+	dvi.device.create_image = test_create_image;
+	dvi.device.free_image = test_free_image;
+	dvi.device.put_pixel = test_put_pixel;
+	dvi.device.put_row = test_put_row;
+	dvi.device.image_done = test_image_done;
+
+	for(i = 1; i < argc; i++) {
+		DviFont	font;
+
+		if(load_font(argv[i], &font) < 0) {
+			failures++;
+			continue;
+		}
+		failures += test_transforms(&font);
+		failures += test_shrink(&font, &dvi);
+	}
+
+	return failures ? 1 : 0;
+}
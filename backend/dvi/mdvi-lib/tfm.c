@@ -135,6 +135,9 @@ int	get_tfm_chars(DviParams *params, DviFont *font, TFMInfo *info, int loaded)
 		ch->glyph.data  = NULL;
 		ch->grey.data   = NULL;
 		ch->shrunk.data = NULL;
+		ch->scaled      = NULL;
+		ch->hshrink     = 0;
+		ch->vshrink     = 0;
 		ch->loaded      = loaded;
 	}
 
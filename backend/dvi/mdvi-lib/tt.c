@@ -319,6 +319,9 @@ static int tt_load_font(DviParams *params, DviFont *font)
 		font->chars[i].glyph.data = NULL;
 		font->chars[i].shrunk.data = NULL;
 		font->chars[i].grey.data = NULL;
+		font->chars[i].scaled = NULL;
+		font->chars[i].hshrink = 0;
+		font->chars[i].vshrink = 0;
 	}
 	
 	if(info->fmfname == NULL)
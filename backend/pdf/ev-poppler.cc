@@ -447,6 +447,11 @@ pdf_document_render (EvDocument      *document,
 	double width_points, height_points;
 	gint width, height;
 
+	/* poppler can't abort a render once started, so the cancellation
+	 * can only be honoured here. */
+	if (ev_render_context_is_cancelled (rc))
+		return NULL;
+
 	poppler_page = POPPLER_PAGE (rc->page->backend_page);
 
 	poppler_page_get_size (poppler_page,
@@ -2511,15 +2516,12 @@ pdf_document_text_get_text_layout (EvDocumentText  *selection,
 }
 
 static PangoAttrList *
-pdf_document_text_get_text_attrs (EvDocumentText *document_text,
-				  EvPage         *page)
+create_attrs_list_from_poppler_text_attributes (PopplerPage *poppler_page)
 {
 	GList         *backend_attrs_list,  *l;
 	PangoAttrList *attrs_list;
 
-	g_return_val_if_fail (POPPLER_IS_PAGE (page->backend_page), NULL);
-
-	backend_attrs_list = poppler_page_get_text_attributes (POPPLER_PAGE (page->backend_page));
+	backend_attrs_list = poppler_page_get_text_attributes (poppler_page);
 	if (!backend_attrs_list)
 		return NULL;
 
@@ -2562,6 +2564,96 @@ pdf_document_text_get_text_attrs (EvDocumentText *document_text,
 	return attrs_list;
 }
 
+static PangoAttrList *
+pdf_document_text_get_text_attrs (EvDocumentText *document_text,
+				  EvPage         *page)
+{
+	g_return_val_if_fail (POPPLER_IS_PAGE (page->backend_page), NULL);
+
+	return create_attrs_list_from_poppler_text_attributes (POPPLER_PAGE (page->backend_page));
+}
+
+/* The glyph selection of the whole page covers every line from its
+ * first to its last character, which is what the layout areas cover
+ * too, since poppler fills the gaps between words with the areas of
+ * the spaces. Building the mapping from them avoids computing the
+ * selection region of the page.
+ */
+static cairo_region_t *
+create_region_from_text_layout (EvRectangle *areas,
+				guint        n_areas)
+{
+	cairo_region_t *retval;
+	guint           i;
+
+	retval = cairo_region_create ();
+
+	for (i = 0; i < n_areas; i++) {
+		cairo_rectangle_int_t rect;
+
+		rect.x = (gint) (MIN (areas[i].x1, areas[i].x2) + 0.5);
+		rect.y = (gint) (MIN (areas[i].y1, areas[i].y2) + 0.5);
+		rect.width  = (gint) (MAX (areas[i].x1, areas[i].x2) + 0.5) - rect.x;
+		rect.height = (gint) (MAX (areas[i].y1, areas[i].y2) + 0.5) - rect.y;
+		if (rect.width > 0 && rect.height > 0)
+			cairo_region_union_rectangle (retval, &rect);
+	}
+
+	return retval;
+}
+
+static gboolean
+pdf_document_text_get_text_data (EvDocumentText  *document_text,
+				 EvPage          *page,
+				 gchar          **text,
+				 EvRectangle    **areas,
+				 guint           *n_areas,
+				 cairo_region_t **text_mapping,
+				 PangoAttrList  **text_attrs)
+{
+	PopplerPage *poppler_page;
+	EvRectangle *layout = NULL;
+	guint        n_layout = 0;
+	gboolean     retval = FALSE;
+
+	g_return_val_if_fail (POPPLER_IS_PAGE (page->backend_page), FALSE);
+
+	poppler_page = POPPLER_PAGE (page->backend_page);
+
+	/* The text, the layout and the attributes all come from the
+	 * text page poppler keeps for the page, so that it's only
+	 * built once, and the mapping comes from the layout.
+	 */
+	if (text) {
+		*text = poppler_page_get_text (poppler_page);
+		retval |= *text != NULL;
+	}
+
+	if (areas || text_mapping) {
+		if (poppler_page_get_text_layout (poppler_page,
+						  (PopplerRectangle **)&layout,
+						  &n_layout))
+			retval = TRUE;
+	}
+
+	if (text_mapping)
+		*text_mapping = create_region_from_text_layout (layout, n_layout);
+
+	if (areas) {
+		*areas = layout;
+		*n_areas = n_layout;
+	} else {
+		g_free (layout);
+	}
+
+	if (text_attrs) {
+		*text_attrs = create_attrs_list_from_poppler_text_attributes (poppler_page);
+		retval |= *text_attrs != NULL;
+	}
+
+	return retval;
+}
+
 static void
 pdf_document_text_iface_init (EvDocumentTextInterface *iface)
 {
@@ -2569,6 +2661,7 @@ pdf_document_text_iface_init (EvDocumentTextInterface *iface)
         iface->get_text = pdf_document_text_get_text;
         iface->get_text_layout = pdf_document_text_get_text_layout;
 	iface->get_text_attrs = pdf_document_text_get_text_attrs;
+	iface->get_text_data = pdf_document_text_get_text_data;
 }
 
 /* Page Transitions */
@@ -3378,8 +3471,12 @@ pdf_document_annotations_get_annotations (EvDocumentAnnotations *document_annota
 	if (pdf_document->annots) {
 		mapping_list = (EvMappingList *)g_hash_table_lookup (pdf_document->annots,
 								     GINT_TO_POINTER (page->index));
-		if (mapping_list)
+		if (mapping_list) {
+			/* Pages without annotations are cached too, with an empty list */
+			if (ev_mapping_list_length (mapping_list) == 0)
+				return NULL;
 			return ev_mapping_list_ref (mapping_list);
+		}
 	}
 
 	annots = poppler_page_get_annot_mapping (poppler_page);
@@ -3431,9 +3528,6 @@ pdf_document_annotations_get_annotations (EvDocumentAnnotations *document_annota
 
 	poppler_page_free_annot_mapping (annots);
 
-	if (!retval)
-		return NULL;
-
 	if (!pdf_document->annots) {
 		pdf_document->annots = g_hash_table_new_full (g_direct_hash,
 							      g_direct_equal,
@@ -3446,6 +3540,11 @@ pdf_document_annotations_get_annotations (EvDocumentAnnotations *document_annota
 			     GINT_TO_POINTER (page->index),
 			     ev_mapping_list_ref (mapping_list));
 
+	if (!retval) {
+		ev_mapping_list_unref (mapping_list);
+		return NULL;
+	}
+
 	return mapping_list;
 }
 
@@ -3687,7 +3786,7 @@ pdf_document_annotations_add_annotation (EvDocumentAnnotations *document_annotat
 
 	annot_set_unique_name (annot);
 
-	if (mapping_list) {
+	if (mapping_list && ev_mapping_list_length (mapping_list) > 0) {
 		list = ev_mapping_list_get_list (mapping_list);
 		list = g_list_append (list, annot_mapping);
 	} else {
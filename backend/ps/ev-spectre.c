@@ -29,11 +29,41 @@
 #include "ev-file-exporter.h"
 #include "ev-document-misc.h"
 
+/* Default maximum number of pages rendered at the same time,
+ * overridden with the EV_PS_RENDER_SLOTS environment variable.
+ */
+#define DEFAULT_MAX_RENDER_SLOTS 4
+
+/* Idle render slots are freed after this many seconds */
+#define RENDER_SLOT_IDLE_TIMEOUT 30
+
+/* Each render slot has its own copy of the document and render
+ * context, so that several pages can be rendered at once. The
+ * first slot uses the document of the PSDocument and is never
+ * freed. The viewer renders from the single job scheduler thread,
+ * under the document lock, so there it only ever uses one slot.
+ */
+typedef struct {
+	SpectreDocument      *doc;
+	SpectreRenderContext *rc;
+	gboolean              owns_doc;
+	gint64                last_used;
+} PSRenderSlot;
+
 struct _PSDocument {
 	EvDocument object;
 
 	SpectreDocument *doc;
 	SpectreExporter *exporter;
+	gchar           *filename;
+
+	GMutex  slots_lock;
+	GCond   slots_cond;
+	GQueue  idle_slots;
+	guint   n_slots;
+	guint   n_busy_slots;
+	guint   max_slots;
+	guint   reap_id;
 };
 
 struct _PSDocumentClass {
@@ -48,10 +78,166 @@ EV_BACKEND_REGISTER_WITH_CODE (PSDocument, ps_document,
 								 ps_document_file_exporter_iface_init);
 			 });
 
+/* PSRenderSlot */
+static PSRenderSlot *
+ps_render_slot_new (SpectreDocument *doc,
+		    gboolean         owns_doc)
+{
+	PSRenderSlot *slot;
+
+	slot = g_slice_new0 (PSRenderSlot);
+	slot->doc = doc;
+	slot->owns_doc = owns_doc;
+	slot->rc = spectre_render_context_new ();
+
+	return slot;
+}
+
+static void
+ps_render_slot_free (PSRenderSlot *slot)
+{
+	if (slot->owns_doc)
+		spectre_document_free (slot->doc);
+	spectre_render_context_free (slot->rc);
+	g_slice_free (PSRenderSlot, slot);
+}
+
+static void
+ps_document_free_slots (PSDocument *ps)
+{
+	g_queue_foreach (&ps->idle_slots, (GFunc)ps_render_slot_free, NULL);
+	g_queue_clear (&ps->idle_slots);
+	ps->n_slots = 0;
+}
+
+/* Returns a slot no other thread is rendering with. A new one is
+ * created if all of them are busy and the maximum has not been
+ * reached, otherwise this waits for one to be released.
+ */
+static PSRenderSlot *
+ps_document_acquire_slot (PSDocument *ps)
+{
+	PSRenderSlot *slot;
+
+	g_mutex_lock (&ps->slots_lock);
+	while (ps->n_busy_slots >= ps->max_slots)
+		g_cond_wait (&ps->slots_cond, &ps->slots_lock);
+
+	while (!(slot = g_queue_pop_head (&ps->idle_slots))) {
+		SpectreDocument *doc;
+
+		if (ps->n_slots == 0) {
+			slot = ps_render_slot_new (ps->doc, FALSE);
+			ps->n_slots++;
+			break;
+		}
+
+		if (ps->n_slots < ps->max_slots) {
+			doc = spectre_document_new ();
+			spectre_document_load (doc, ps->filename);
+			if (!spectre_document_status (doc)) {
+				slot = ps_render_slot_new (doc, TRUE);
+				ps->n_slots++;
+				break;
+			}
+			spectre_document_free (doc);
+
+			/* Don't try again, use the slots we have */
+			ps->max_slots = ps->n_slots;
+		}
+
+		g_cond_wait (&ps->slots_cond, &ps->slots_lock);
+	}
+	ps->n_busy_slots++;
+	g_mutex_unlock (&ps->slots_lock);
+
+	return slot;
+}
+
+/* Frees the idle slots that have not been used for a while, except
+ * the one borrowing the document of the PSDocument. Returns whether
+ * some idle slots are left to free later. Called with slots_lock held.
+ */
+static gboolean
+ps_document_reap_slots (PSDocument *ps)
+{
+	GList   *l, *next;
+	gint64   now;
+	gboolean pending = FALSE;
+
+	now = g_get_monotonic_time ();
+	for (l = ps->idle_slots.head; l; l = next) {
+		PSRenderSlot *slot = l->data;
+
+		next = l->next;
+		if (!slot->owns_doc)
+			continue;
+
+		if (now - slot->last_used < RENDER_SLOT_IDLE_TIMEOUT * G_USEC_PER_SEC) {
+			pending = TRUE;
+			continue;
+		}
+
+		g_queue_delete_link (&ps->idle_slots, l);
+		ps_render_slot_free (slot);
+		ps->n_slots--;
+	}
+
+	return pending;
+}
+
+static gboolean
+ps_document_reap_slots_cb (PSDocument *ps)
+{
+	gboolean pending;
+
+	g_mutex_lock (&ps->slots_lock);
+	pending = ps_document_reap_slots (ps);
+	if (!pending)
+		ps->reap_id = 0;
+	g_mutex_unlock (&ps->slots_lock);
+
+	return pending;
+}
+
+static void
+ps_document_release_slot (PSDocument   *ps,
+			  PSRenderSlot *slot)
+{
+	slot->last_used = g_get_monotonic_time ();
+
+	g_mutex_lock (&ps->slots_lock);
+	g_queue_push_head (&ps->idle_slots, slot);
+	ps->n_busy_slots--;
+
+	/* Slots are freed once idle for a while, even if no other
+	 * page is rendered in the meantime.
+	 */
+	if (slot->owns_doc && ps->reap_id == 0)
+		ps->reap_id = g_timeout_add_seconds (RENDER_SLOT_IDLE_TIMEOUT,
+						     (GSourceFunc) ps_document_reap_slots_cb,
+						     ps);
+
+	g_cond_broadcast (&ps->slots_cond);
+	g_mutex_unlock (&ps->slots_lock);
+}
+
 /* PSDocument */
 static void
 ps_document_init (PSDocument *ps_document)
 {
+	const gchar *max_slots;
+
+	g_mutex_init (&ps_document->slots_lock);
+	g_cond_init (&ps_document->slots_cond);
+	g_queue_init (&ps_document->idle_slots);
+
+	max_slots = g_getenv ("EV_PS_RENDER_SLOTS");
+	if (max_slots)
+		ps_document->max_slots = CLAMP (atoi (max_slots), 1, 16);
+	else
+		ps_document->max_slots = CLAMP (g_get_num_processors (), 1,
+						DEFAULT_MAX_RENDER_SLOTS);
 }
 
 static void
@@ -59,6 +245,12 @@ ps_document_dispose (GObject *object)
 {
 	PSDocument *ps = PS_DOCUMENT (object);
 
+	if (ps->reap_id > 0) {
+		g_source_remove (ps->reap_id);
+		ps->reap_id = 0;
+	}
+	ps_document_free_slots (ps);
+
 	if (ps->doc) {
 		spectre_document_free (ps->doc);
 		ps->doc = NULL;
@@ -72,6 +264,18 @@ ps_document_dispose (GObject *object)
 	G_OBJECT_CLASS (ps_document_parent_class)->dispose (object);
 }
 
+static void
+ps_document_finalize (GObject *object)
+{
+	PSDocument *ps = PS_DOCUMENT (object);
+
+	g_free (ps->filename);
+	g_mutex_clear (&ps->slots_lock);
+	g_cond_clear (&ps->slots_cond);
+
+	G_OBJECT_CLASS (ps_document_parent_class)->finalize (object);
+}
+
 /* EvDocumentIface */
 static gboolean
 ps_document_load (EvDocument *document,
@@ -84,6 +288,10 @@ ps_document_load (EvDocument *document,
 	filename = g_filename_from_uri (uri, NULL, error);
 	if (!filename)
 		return FALSE;
+
+	g_mutex_lock (&ps->slots_lock);
+	ps_document_free_slots (ps);
+	g_mutex_unlock (&ps->slots_lock);
 	
 	ps->doc = spectre_document_new ();
 
@@ -103,7 +311,8 @@ ps_document_load (EvDocument *document,
 		return FALSE;
 	}
 
-	g_free (filename);
+	g_free (ps->filename);
+	ps->filename = filename;
 
 	return TRUE;
 }
@@ -283,8 +492,10 @@ static cairo_surface_t *
 ps_document_render (EvDocument      *document,
 		    EvRenderContext *rc)
 {
+	PSDocument           *ps = PS_DOCUMENT (document);
+	PSRenderSlot         *slot;
 	SpectrePage          *ps_page;
-	SpectreRenderContext *src;
+	SpectreStatus         status;
 	gint                  width_points;
 	gint                  height_points;
 	gint                  width, height;
@@ -312,20 +523,53 @@ ps_document_render (EvDocument      *document,
 		sheight = height;
 	}
 
-	src = spectre_render_context_new ();
-	spectre_render_context_set_scale (src,
+	slot = ps_document_acquire_slot (ps);
+
+	/* Pages hold a pointer to their document, so the page of
+	 * the slot's document is rendered.
+	 */
+	ps_page = spectre_document_get_page (slot->doc, rc->page->index);
+	if (!ps_page) {
+		ps_document_release_slot (ps, slot);
+		return NULL;
+	}
+	spectre_render_context_set_scale (slot->rc,
 					  (gdouble)swidth / width_points,
 					  (gdouble)sheight / height_points);
-	spectre_render_context_set_rotation (src, rotation);
-	spectre_page_render (ps_page, src, &data, &stride);
-	spectre_render_context_free (src);
+	spectre_render_context_set_rotation (slot->rc, rotation);
+	spectre_page_render (ps_page, slot->rc, &data, &stride);
+	status = spectre_page_status (ps_page);
+
+	if (status == SPECTRE_STATUS_RENDER_ERROR) {
+		gboolean retry;
+
+		/* Ghostscript might not support several instances at
+		 * once; render one page at a time from now on.
+		 */
+		g_mutex_lock (&ps->slots_lock);
+		retry = ps->max_slots > 1;
+		ps->max_slots = 1;
+		while (retry && ps->n_busy_slots > 1)
+			g_cond_wait (&ps->slots_cond, &ps->slots_lock);
+		g_mutex_unlock (&ps->slots_lock);
+
+		if (retry) {
+			g_free (data);
+			data = NULL;
+			spectre_page_render (ps_page, slot->rc, &data, &stride);
+			status = spectre_page_status (ps_page);
+		}
+	}
+
+	spectre_page_free (ps_page);
+	ps_document_release_slot (ps, slot);
 
 	if (!data) {
 		return NULL;
 	}
 
-	if (spectre_page_status (ps_page)) {
-		g_warning ("%s", spectre_status_to_string (spectre_page_status (ps_page)));
+	if (status) {
+		g_warning ("%s", spectre_status_to_string (status));
 		g_free (data);
 		
 		return NULL;
@@ -347,6 +591,7 @@ ps_document_class_init (PSDocumentClass *klass)
 	EvDocumentClass *ev_document_class = EV_DOCUMENT_CLASS (klass);
 
 	object_class->dispose = ps_document_dispose;
+	object_class->finalize = ps_document_finalize;
 
 	ev_document_class->load = ps_document_load;
 	ev_document_class->save = ps_document_save;
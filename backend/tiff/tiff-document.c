@@ -24,6 +24,7 @@
 
 #include <config.h>
 #include <stdio.h>
+#include <string.h>
 #include <glib.h>
 #include <glib/gi18n-lib.h>
 
@@ -31,20 +32,39 @@
 #include "tiff2ps.h"
 #include "tiff-document.h"
 #include "ev-document-misc.h"
+#include "ev-pixel-convert-private.h"
 #include "ev-file-exporter.h"
 #include "ev-file-helpers.h"
 
+/* Upper bound on the buffer of the RGBA fallback, images stored as a
+ * single strip or with tall tiles are read in several bands.
+ */
+#define RGBA_BAND_MAX_BYTES (16 * 1024 * 1024)
+
 struct _TiffDocumentClass
 {
   EvDocumentClass parent_class;
 };
 
+/* Per page metadata, collected when the directories are first counted */
+typedef struct
+{
+  toff_t offset;
+  guint32 width;
+  guint32 height;
+  gfloat x_res;
+  gfloat y_res;
+  guint16 orientation;
+  gchar *label;
+} TiffPage;
+
 struct _TiffDocument
 {
   EvDocument parent_instance;
 
   TIFF *tiff;
   gint n_pages;
+  TiffPage *pages;
   TIFF2PSContext *ps_export_ctx;
   
   gchar *uri;
@@ -145,28 +165,6 @@ tiff_document_save (EvDocument  *document,
 	return ev_xfer_uri_simple (tiff_document->uri, uri, error); 
 }
 
-static int
-tiff_document_get_n_pages (EvDocument  *document)
-{
-	TiffDocument *tiff_document = TIFF_DOCUMENT (document);
-	
-	g_return_val_if_fail (TIFF_IS_DOCUMENT (document), 0);
-	g_return_val_if_fail (tiff_document->tiff != NULL, 0);
-	
-	if (tiff_document->n_pages == -1) {
-		push_handlers ();
-		tiff_document->n_pages = 0;
-		
-		do {
-			tiff_document->n_pages ++;
-		}
-		while (TIFFReadDirectory (tiff_document->tiff));
-		pop_handlers ();
-	}
-
-	return tiff_document->n_pages;
-}
-
 static void
 tiff_document_get_resolution (TiffDocument *tiff_document,
 			      gfloat       *x_res,
@@ -191,34 +189,552 @@ tiff_document_get_resolution (TiffDocument *tiff_document,
 	*y_res = y > 0 ? y : 72.0;
 }
 
+static void
+tiff_document_scan_pages (TiffDocument *tiff_document)
+{
+	TIFF   *tiff = tiff_document->tiff;
+	GArray *pages;
+
+	pages = g_array_new (FALSE, TRUE, sizeof (TiffPage));
+
+	push_handlers ();
+	TIFFSetDirectory (tiff, 0);
+	do {
+		TiffPage page = { 0, };
+		gchar   *label;
+
+		page.offset = TIFFCurrentDirOffset (tiff);
+		TIFFGetField (tiff, TIFFTAG_IMAGEWIDTH, &page.width);
+		TIFFGetField (tiff, TIFFTAG_IMAGELENGTH, &page.height);
+		if (!TIFFGetField (tiff, TIFFTAG_ORIENTATION, &page.orientation))
+			page.orientation = ORIENTATION_TOPLEFT;
+		tiff_document_get_resolution (tiff_document, &page.x_res, &page.y_res);
+		if (TIFFGetField (tiff, TIFFTAG_PAGENAME, &label) &&
+		    g_utf8_validate (label, -1, NULL))
+			page.label = g_strdup (label);
+
+		g_array_append_val (pages, page);
+	} while (TIFFReadDirectory (tiff));
+	pop_handlers ();
+
+	tiff_document->n_pages = pages->len;
+	tiff_document->pages = (TiffPage *) g_array_free (pages, FALSE);
+}
+
+/* Selects the directory of the page @index. Directories are reached
+ * through the offsets recorded by tiff_document_scan_pages(), since
+ * TIFFSetDirectory() walks the whole IFD chain from the start.
+ */
+static gboolean
+tiff_document_set_page (TiffDocument *tiff_document,
+			gint          index)
+{
+	toff_t offset;
+
+	if (index < 0 || index >= tiff_document->n_pages)
+		return FALSE;
+
+	offset = tiff_document->pages[index].offset;
+	if (TIFFCurrentDirOffset (tiff_document->tiff) == offset)
+		return TRUE;
+
+	return TIFFSetSubDirectory (tiff_document->tiff, offset) == 1;
+}
+
+static int
+tiff_document_get_n_pages (EvDocument  *document)
+{
+	TiffDocument *tiff_document = TIFF_DOCUMENT (document);
+	
+	g_return_val_if_fail (TIFF_IS_DOCUMENT (document), 0);
+	g_return_val_if_fail (tiff_document->tiff != NULL, 0);
+	
+	if (tiff_document->n_pages == -1)
+		tiff_document_scan_pages (tiff_document);
+
+	return tiff_document->n_pages;
+}
+
 static void
 tiff_document_get_page_size (EvDocument *document,
 			     EvPage     *page,
 			     double     *width,
 			     double     *height)
 {
-	guint32 w, h;
-	gfloat x_res, y_res;
 	TiffDocument *tiff_document = TIFF_DOCUMENT (document);
+	TiffPage     *tiff_page;
 	
 	g_return_if_fail (TIFF_IS_DOCUMENT (document));
 	g_return_if_fail (tiff_document->tiff != NULL);
 	
-	push_handlers ();
-	if (TIFFSetDirectory (tiff_document->tiff, page->index) != 1) {
-		pop_handlers ();
+	if (page->index >= tiff_document_get_n_pages (document))
 		return;
+
+	tiff_page = &tiff_document->pages[page->index];
+	*width = tiff_page->width;
+	*height = (guint32) (tiff_page->height * (tiff_page->x_res / tiff_page->y_res));
+}
+
+/* Pages are decoded a strip or a band of rows at a time, and box
+ * filtered down to the target size while decoding, so that memory
+ * use depends on the output size rather than on the image size.
+ */
+typedef struct {
+	cairo_surface_t *surface;
+	guchar          *pixels;
+	gint             rowstride;
+	gint             src_width;
+	gint             src_height;
+	gint             factor;
+	gint             row;
+	gint             rows_summed;
+	guint32         *sums;
+} TiffDecimator;
+
+static gboolean
+tiff_decimator_init (TiffDecimator *decimator,
+		     gint           src_width,
+		     gint           src_height,
+		     gint           factor)
+{
+	static const cairo_user_data_key_t key;
+	gint width, height;
+
+	width = (src_width + factor - 1) / factor;
+	height = (src_height + factor - 1) / factor;
+
+	decimator->rowstride = cairo_format_stride_for_width (CAIRO_FORMAT_RGB24, width);
+	if (decimator->rowstride / 4 != width) {
+		g_warning("Overflow while rendering document.");
+		/* overflow, or cairo was changed in an unsupported way */
+		return FALSE;
 	}
-	
-	TIFFGetField (tiff_document->tiff, TIFFTAG_IMAGEWIDTH, &w);
-	TIFFGetField (tiff_document->tiff, TIFFTAG_IMAGELENGTH, &h);
-	tiff_document_get_resolution (tiff_document, &x_res, &y_res);
-	h = h * (x_res / y_res);
-	
-	*width = w;
-	*height = h;
-	
-	pop_handlers ();
+
+	if (height >= INT_MAX / decimator->rowstride) {
+		g_warning("Overflow while rendering document.");
+		/* overflow */
+		return FALSE;
+	}
+
+	decimator->pixels = g_try_malloc0 (height * decimator->rowstride);
+	if (!decimator->pixels) {
+		g_warning("Failed to allocate memory for rendering.");
+		return FALSE;
+	}
+
+	decimator->surface = cairo_image_surface_create_for_data (decimator->pixels,
+								  CAIRO_FORMAT_RGB24,
+								  width, height,
+								  decimator->rowstride);
+	cairo_surface_set_user_data (decimator->surface, &key,
+				     decimator->pixels, (cairo_destroy_func_t)g_free);
+
+	decimator->src_width = src_width;
+	decimator->src_height = src_height;
+	decimator->factor = factor;
+	decimator->row = 0;
+	decimator->rows_summed = 0;
+	decimator->sums = factor > 1 ? g_new0 (guint32, width * 4) : NULL;
+
+	return TRUE;
+}
+
+static void
+tiff_decimator_flush (TiffDecimator *decimator)
+{
+	guint32 *dest;
+	gint     width = decimator->rowstride / 4;
+	gint     x;
+
+	dest = (guint32 *)(decimator->pixels +
+			   ((decimator->row - 1) / decimator->factor) * decimator->rowstride);
+
+	for (x = 0; x < width; x++) {
+		guint32 *sum = decimator->sums + x * 4;
+		guint32  n;
+
+		n = MIN (decimator->factor, decimator->src_width - x * decimator->factor);
+		n *= decimator->rows_summed;
+
+		dest[x] = ((sum[3] / n) << 24) | ((sum[0] / n) << 16) |
+			  ((sum[1] / n) << 8) | (sum[2] / n);
+	}
+
+	memset (decimator->sums, 0, width * 4 * sizeof (guint32));
+	decimator->rows_summed = 0;
+}
+
+/* @src is a row of pixels in cairo's format */
+static void
+tiff_decimator_push_row (TiffDecimator *decimator,
+			 const guint32 *src)
+{
+	gint x;
+
+	if (decimator->row >= decimator->src_height)
+		return;
+
+	if (decimator->factor == 1) {
+		memcpy (decimator->pixels + decimator->row * decimator->rowstride,
+			src, decimator->src_width * sizeof (guint32));
+		decimator->row++;
+		return;
+	}
+
+	for (x = 0; x < decimator->src_width; x++) {
+		guint32 *sum = decimator->sums + (x / decimator->factor) * 4;
+		guint32  pixel = src[x];
+
+		sum[0] += (pixel >> 16) & 0xff;
+		sum[1] += (pixel >> 8) & 0xff;
+		sum[2] += pixel & 0xff;
+		sum[3] += pixel >> 24;
+	}
+	decimator->row++;
+	decimator->rows_summed++;
+
+	if (decimator->rows_summed == decimator->factor ||
+	    decimator->row == decimator->src_height)
+		tiff_decimator_flush (decimator);
+}
+
+static cairo_surface_t *
+tiff_decimator_finish (TiffDecimator *decimator)
+{
+	g_free (decimator->sums);
+	decimator->sums = NULL;
+
+	cairo_surface_mark_dirty (decimator->surface);
+
+	return decimator->surface;
+}
+
+/* Bilevel, grey, 8-bit palette and RGB images in strips, which covers
+ * fax and scanned pages, are read one scanline at a time so that single
+ * strip images don't need to be decoded as a whole.
+ */
+static gboolean
+tiff_document_can_read_scanlines (TIFF *tiff)
+{
+	guint16 bits_per_sample, samples_per_pixel, photometric, planar_config;
+
+	if (TIFFIsTiled (tiff))
+		return FALSE;
+
+	if (!TIFFGetField (tiff, TIFFTAG_PHOTOMETRIC, &photometric))
+		return FALSE;
+
+	TIFFGetFieldDefaulted (tiff, TIFFTAG_BITSPERSAMPLE, &bits_per_sample);
+	TIFFGetFieldDefaulted (tiff, TIFFTAG_SAMPLESPERPIXEL, &samples_per_pixel);
+	TIFFGetFieldDefaulted (tiff, TIFFTAG_PLANARCONFIG, &planar_config);
+
+	if (planar_config != PLANARCONFIG_CONTIG)
+		return FALSE;
+
+	switch (photometric) {
+	case PHOTOMETRIC_MINISWHITE:
+	case PHOTOMETRIC_MINISBLACK:
+		return samples_per_pixel == 1 &&
+			(bits_per_sample == 1 || bits_per_sample == 8);
+	case PHOTOMETRIC_PALETTE: {
+		guint16 *red, *green, *blue;
+
+		return samples_per_pixel == 1 && bits_per_sample == 8 &&
+			TIFFGetField (tiff, TIFFTAG_COLORMAP, &red, &green, &blue);
+	}
+	case PHOTOMETRIC_RGB:
+		if (bits_per_sample != 8)
+			return FALSE;
+		if (samples_per_pixel == 4) {
+			guint16  n_extra_samples;
+			guint16 *extra_samples;
+
+			/* Premultiplied like libtiff's RGBA interface does */
+			return TIFFGetField (tiff, TIFFTAG_EXTRASAMPLES,
+					     &n_extra_samples, &extra_samples) &&
+				n_extra_samples == 1 &&
+				extra_samples[0] == EXTRASAMPLE_UNASSALPHA;
+		}
+		return samples_per_pixel == 3;
+	default:
+		return FALSE;
+	}
+}
+
+/* Fills @palette with the colors of an 8-bit colormap in cairo's
+ * format. Colormaps have 16-bit entries, but some writers store 8-bit
+ * values, which libtiff's RGBA interface also accepts.
+ */
+static void
+tiff_document_get_palette (TIFF    *tiff,
+			   guint32 *palette)
+{
+	guint16 *red, *green, *blue;
+	gint     shift = 0;
+	gint     i;
+
+	TIFFGetField (tiff, TIFFTAG_COLORMAP, &red, &green, &blue);
+
+	for (i = 0; i < 256; i++) {
+		if (red[i] >= 256 || green[i] >= 256 || blue[i] >= 256) {
+			shift = 8;
+			break;
+		}
+	}
+
+	for (i = 0; i < 256; i++) {
+		palette[i] = 0xff000000 |
+			((red[i] >> shift) << 16) |
+			((green[i] >> shift) << 8) |
+			(blue[i] >> shift);
+	}
+}
+
+static gboolean
+tiff_document_read_scanlines (TIFF            *tiff,
+			      EvRenderContext *rc,
+			      TiffDecimator   *decimator)
+{
+	guint16  bits_per_sample, samples_per_pixel, photometric;
+	guint32  palette[256];
+	guchar  *scanline;
+	guint32 *row;
+	gint     width = decimator->src_width;
+	gint     y, x;
+	gboolean retval = TRUE;
+
+	TIFFGetField (tiff, TIFFTAG_PHOTOMETRIC, &photometric);
+	TIFFGetFieldDefaulted (tiff, TIFFTAG_BITSPERSAMPLE, &bits_per_sample);
+	TIFFGetFieldDefaulted (tiff, TIFFTAG_SAMPLESPERPIXEL, &samples_per_pixel);
+
+	if (photometric == PHOTOMETRIC_PALETTE)
+		tiff_document_get_palette (tiff, palette);
+
+	scanline = g_try_malloc (TIFFScanlineSize (tiff));
+	row = g_try_new (guint32, width);
+	if (!scanline || !row) {
+		g_free (scanline);
+		g_free (row);
+		return FALSE;
+	}
+
+	for (y = 0; y < decimator->src_height; y++) {
+		if (ev_render_context_is_cancelled (rc)) {
+			retval = FALSE;
+			break;
+		}
+
+		if (TIFFReadScanline (tiff, scanline, y, 0) < 0) {
+			retval = FALSE;
+			break;
+		}
+
+		if (photometric == PHOTOMETRIC_RGB) {
+			if (samples_per_pixel == 4)
+				ev_pixel_convert_rgba_to_argb32 (scanline, row, width);
+			else
+				ev_pixel_convert_rgb_to_rgb24 (scanline, row, width);
+		} else if (photometric == PHOTOMETRIC_PALETTE) {
+			for (x = 0; x < width; x++)
+				row[x] = palette[scanline[x]];
+		} else if (bits_per_sample == 8) {
+			if (photometric == PHOTOMETRIC_MINISWHITE) {
+				for (x = 0; x < width; x++)
+					scanline[x] = 0xff - scanline[x];
+			}
+			ev_pixel_convert_gray_to_rgb24 (scanline, row, width);
+		} else {
+			guint32 black = photometric == PHOTOMETRIC_MINISWHITE ? 1 : 0;
+
+			for (x = 0; x < width; x++) {
+				guint32 bit = (scanline[x >> 3] >> (7 - (x & 7))) & 1;
+
+				row[x] = bit == black ? 0xff000000 : 0xffffffff;
+			}
+		}
+
+		tiff_decimator_push_row (decimator, row);
+	}
+
+	g_free (scanline);
+	g_free (row);
+
+	return retval;
+}
+
+/* Any other image goes through libtiff's RGBA interface, a strip
+ * or a row of tiles at a time, in bands of at most RGBA_BAND_MAX_BYTES.
+ * A band starting inside a strip makes libtiff decode that strip from
+ * its start again, so bands are kept as tall as the bound allows.
+ */
+static gboolean
+tiff_document_read_rgba_bands (TIFF            *tiff,
+			       gint             orientation,
+			       EvRenderContext *rc,
+			       TiffDecimator   *decimator)
+{
+	TIFFRGBAImage img;
+	char          emsg[1024];
+	guint32      *band;
+	guint32       band_height;
+	gint          width = decimator->src_width;
+	gint          y, i;
+	gboolean      retval = TRUE;
+
+	if (!TIFFRGBAImageOK (tiff, emsg) ||
+	    !TIFFRGBAImageBegin (&img, tiff, 0, emsg)) {
+		g_warning ("Failed to read image: %s", emsg);
+		return FALSE;
+	}
+	img.req_orientation = orientation;
+
+	if (TIFFIsTiled (tiff))
+		TIFFGetField (tiff, TIFFTAG_TILELENGTH, &band_height);
+	else
+		TIFFGetFieldDefaulted (tiff, TIFFTAG_ROWSPERSTRIP, &band_height);
+	band_height = MIN (band_height, RGBA_BAND_MAX_BYTES / ((gsize) width * 4));
+	band_height = CLAMP (band_height, 1, (guint32) decimator->src_height);
+
+	band = g_try_new (guint32, (gsize) width * band_height);
+	if (!band) {
+		g_warning("Failed to allocate memory for rendering.");
+		TIFFRGBAImageEnd (&img);
+		return FALSE;
+	}
+
+	for (y = 0; y < decimator->src_height; y += band_height) {
+		gint n_rows = MIN (band_height, (guint32) (decimator->src_height - y));
+
+		if (ev_render_context_is_cancelled (rc)) {
+			retval = FALSE;
+			break;
+		}
+
+		img.row_offset = y;
+		img.col_offset = 0;
+		if (!TIFFRGBAImageGet (&img, (uint32 *) band, width, n_rows)) {
+			retval = FALSE;
+			break;
+		}
+
+		/* Convert the format returned by libtiff to
+		 * what cairo expects
+		 */
+		ev_pixel_convert_abgr_to_argb (band, band, (gsize) width * n_rows);
+
+		for (i = 0; i < n_rows; i++)
+			tiff_decimator_push_row (decimator, band + (gsize) i * width);
+	}
+
+	g_free (band);
+	TIFFRGBAImageEnd (&img);
+
+	return retval;
+}
+
+/* Switches to the smallest reduced resolution version of the current
+ * page that is still at least @target_width wide, if there's any.
+ */
+static gboolean
+tiff_document_select_reduced_image (TiffDocument *tiff_document,
+				    gint          page,
+				    gint          target_width,
+				    gint         *width,
+				    gint         *height)
+{
+	TIFF    *tiff = tiff_document->tiff;
+	guint16  n_subifds;
+	toff_t  *subifds;
+	toff_t  *offsets;
+	toff_t   best_offset = 0;
+	guint32  best_width = G_MAXUINT32;
+	guint32  best_height = 0;
+	gint     i;
+
+	if (!TIFFGetField (tiff, TIFFTAG_SUBIFD, &n_subifds, &subifds) || n_subifds == 0)
+		return FALSE;
+
+	/* The array belongs to the current directory */
+	offsets = g_memdup (subifds, n_subifds * sizeof (toff_t));
+
+	for (i = 0; i < n_subifds; i++) {
+		guint32 subfile_type = 0;
+		guint32 w, h;
+
+		if (!TIFFSetSubDirectory (tiff, offsets[i]))
+			continue;
+
+		TIFFGetField (tiff, TIFFTAG_SUBFILETYPE, &subfile_type);
+		if (!(subfile_type & FILETYPE_REDUCEDIMAGE))
+			continue;
+
+		if (!TIFFGetField (tiff, TIFFTAG_IMAGEWIDTH, &w) ||
+		    !TIFFGetField (tiff, TIFFTAG_IMAGELENGTH, &h))
+			continue;
+
+		if (w >= (guint32) target_width && w < best_width) {
+			best_offset = offsets[i];
+			best_width = w;
+			best_height = h;
+		}
+	}
+	g_free (offsets);
+
+	if (best_offset != 0 && TIFFSetSubDirectory (tiff, best_offset)) {
+		*width = best_width;
+		*height = best_height;
+		return TRUE;
+	}
+
+	tiff_document_set_page (tiff_document, page);
+	return FALSE;
+}
+
+/* Decodes the current page to a surface at most twice the target size,
+ * with the ratio between the image and the surface kept uniform.
+ * Returns %NULL if @rc is cancelled while decoding.
+ */
+static cairo_surface_t *
+tiff_document_decode (TiffDocument    *tiff_document,
+		      EvRenderContext *rc,
+		      gint             page,
+		      gint             width,
+		      gint             height,
+		      gint             orientation,
+		      gint             target_width,
+		      gint             target_height)
+{
+	TiffDecimator decimator;
+	gint          factor;
+	gboolean      success;
+
+	factor = MIN (width / MAX (target_width, 1), height / MAX (target_height, 1));
+	if (factor >= 2 &&
+	    tiff_document_select_reduced_image (tiff_document, page, target_width,
+						&width, &height)) {
+		factor = MIN (width / MAX (target_width, 1), height / MAX (target_height, 1));
+	}
+	factor = MAX (factor, 1);
+
+	if (!tiff_decimator_init (&decimator, width, height, factor))
+		return NULL;
+
+	if (tiff_document_can_read_scanlines (tiff_document->tiff))
+		success = tiff_document_read_scanlines (tiff_document->tiff, rc, &decimator);
+	else
+		success = tiff_document_read_rgba_bands (tiff_document->tiff, orientation,
+							 rc, &decimator);
+
+	if (ev_render_context_is_cancelled (rc)) {
+		cairo_surface_destroy (tiff_decimator_finish (&decimator));
+		return NULL;
+	}
+
+	/* Keep what was decoded of a broken image, like TIFFReadRGBAImage does */
+	if (!success)
+		g_warning ("Failed to decode page %d", page);
+
+	return tiff_decimator_finish (&decimator);
 }
 
 static cairo_surface_t *
@@ -226,104 +742,49 @@ tiff_document_render (EvDocument      *document,
 		      EvRenderContext *rc)
 {
 	TiffDocument *tiff_document = TIFF_DOCUMENT (document);
+	TiffPage *tiff_page;
 	int width, height;
 	int scaled_width, scaled_height;
 	float x_res, y_res;
-	gint rowstride, bytes;
-	guchar *pixels = NULL;
-	guchar *p;
-	int orientation;
 	cairo_surface_t *surface;
 	cairo_surface_t *rotated_surface;
-	static const cairo_user_data_key_t key;
 	
 	g_return_val_if_fail (TIFF_IS_DOCUMENT (document), NULL);
 	g_return_val_if_fail (tiff_document->tiff != NULL, NULL);
-  
-	push_handlers ();
-	if (TIFFSetDirectory (tiff_document->tiff, rc->page->index) != 1) {
-		pop_handlers ();
-		g_warning("Failed to select page %d", rc->page->index);
-		return NULL;
-	}
-
-	if (!TIFFGetField (tiff_document->tiff, TIFFTAG_IMAGEWIDTH, &width)) {
-		pop_handlers ();
-		g_warning("Failed to read image width");
-		return NULL;
-	}
 
-	if (! TIFFGetField (tiff_document->tiff, TIFFTAG_IMAGELENGTH, &height)) {
-		pop_handlers ();
-		g_warning("Failed to read image height");
+	if (rc->page->index >= tiff_document_get_n_pages (document))
 		return NULL;
-	}
 
-	if (! TIFFGetField (tiff_document->tiff, TIFFTAG_ORIENTATION, &orientation)) {
-		orientation = ORIENTATION_TOPLEFT;
-	}
+	tiff_page = &tiff_document->pages[rc->page->index];
+	width = tiff_page->width;
+	height = tiff_page->height;
+	x_res = tiff_page->x_res;
+	y_res = tiff_page->y_res;
 
-	tiff_document_get_resolution (tiff_document, &x_res, &y_res);
-	
-	pop_handlers ();
-  
 	/* Sanity check the doc */
 	if (width <= 0 || height <= 0) {
 		g_warning("Invalid width or height.");
 		return NULL;
 	}
-
-	rowstride = cairo_format_stride_for_width (CAIRO_FORMAT_RGB24, width);
-	if (rowstride / 4 != width) {
-		g_warning("Overflow while rendering document.");
-		/* overflow, or cairo was changed in an unsupported way */
-		return NULL;                
-	}
-	
-	if (height >= INT_MAX / rowstride) {
-		g_warning("Overflow while rendering document.");
-		/* overflow */
-		return NULL;
-	}
-	bytes = height * rowstride;
-	
-	pixels = g_try_malloc (bytes);
-	if (!pixels) {
-		g_warning("Failed to allocate memory for rendering.");
+  
+	push_handlers ();
+	if (!tiff_document_set_page (tiff_document, rc->page->index)) {
+		pop_handlers ();
+		g_warning("Failed to select page %d", rc->page->index);
 		return NULL;
 	}
-	
-	surface = cairo_image_surface_create_for_data (pixels,
-						       CAIRO_FORMAT_RGB24,
-						       width, height,
-						       rowstride);
-	cairo_surface_set_user_data (surface, &key,
-				     pixels, (cairo_destroy_func_t)g_free);
-
-	TIFFReadRGBAImageOriented (tiff_document->tiff,
-				   width, height,
-				   (uint32 *)pixels,
-				   orientation, 0);
-	pop_handlers ();
 
-	/* Convert the format returned by libtiff to
-	* what cairo expects
-	*/
-	p = pixels;
-	while (p < pixels + bytes) {
-		guint32 *pixel = (guint32*)p;
-		guint8 r = TIFFGetR(*pixel);
-		guint8 g = TIFFGetG(*pixel);
-		guint8 b = TIFFGetB(*pixel);
-		guint8 a = TIFFGetA(*pixel);
+	ev_render_context_compute_scaled_size (rc, width, height * (x_res / y_res),
+					       &scaled_width, &scaled_height);
 
-		*pixel = (a << 24) | (r << 16) | (g << 8) | b;
+	surface = tiff_document_decode (tiff_document, rc, rc->page->index,
+					width, height, tiff_page->orientation,
+					scaled_width, scaled_height * (y_res / x_res));
+	pop_handlers ();
 
-		p += 4;
-	}
+	if (!surface)
+		return NULL;
 
-	ev_render_context_compute_scaled_size (rc, width, height * (x_res / y_res),
-					       &scaled_width, &scaled_height);
 	rotated_surface = ev_document_misc_surface_rotate_and_scale (surface,
 								     scaled_width, scaled_height,
 								     rc->rotation);
@@ -336,74 +797,18 @@ static GdkPixbuf *
 tiff_document_get_thumbnail (EvDocument      *document,
 			     EvRenderContext *rc)
 {
-	TiffDocument *tiff_document = TIFF_DOCUMENT (document);
-	int width, height;
-	int scaled_width, scaled_height;
-	float x_res, y_res;
-	gint rowstride, bytes;
-	guchar *pixels = NULL;
-	GdkPixbuf *pixbuf;
-	GdkPixbuf *scaled_pixbuf;
-	GdkPixbuf *rotated_pixbuf;
-	
-	push_handlers ();
-	if (TIFFSetDirectory (tiff_document->tiff, rc->page->index) != 1) {
-		pop_handlers ();
-		return NULL;
-	}
+	cairo_surface_t *surface;
+	GdkPixbuf       *pixbuf;
 
-	if (!TIFFGetField (tiff_document->tiff, TIFFTAG_IMAGEWIDTH, &width)) {
-		pop_handlers ();
+	/* Thumbnails only need decoding at their own size too */
+	surface = tiff_document_render (document, rc);
+	if (!surface)
 		return NULL;
-	}
-
-	if (! TIFFGetField (tiff_document->tiff, TIFFTAG_IMAGELENGTH, &height)) {
-		pop_handlers ();
-		return NULL;
-	}
-
-	tiff_document_get_resolution (tiff_document, &x_res, &y_res);
-	
-	pop_handlers ();
-  
-	/* Sanity check the doc */
-	if (width <= 0 || height <= 0)
-		return NULL;                
 
-	if (width >= INT_MAX / 4)
-		/* overflow */
-		return NULL;                
-	rowstride = width * 4;
-        
-	if (height >= INT_MAX / rowstride)
-		/* overflow */
-		return NULL;                
-	bytes = height * rowstride;
-	
-	pixels = g_try_malloc (bytes);
-	if (!pixels)
-		return NULL;
-	
-	pixbuf = gdk_pixbuf_new_from_data (pixels, GDK_COLORSPACE_RGB, TRUE, 8, 
-					   width, height, rowstride,
-					   (GdkPixbufDestroyNotify) g_free, NULL);
-	TIFFReadRGBAImageOriented (tiff_document->tiff,
-				   width, height,
-				   (uint32 *)pixels,
-				   ORIENTATION_TOPLEFT, 0);
-	pop_handlers ();
+	pixbuf = ev_document_misc_pixbuf_from_surface (surface);
+	cairo_surface_destroy (surface);
 
-	ev_render_context_compute_scaled_size (rc, width, height * (x_res / y_res),
-					       &scaled_width, &scaled_height);
-	scaled_pixbuf = gdk_pixbuf_scale_simple (pixbuf,
-						 scaled_width, scaled_height,
-						 GDK_INTERP_BILINEAR);
-	g_object_unref (pixbuf);
-	
-	rotated_pixbuf = gdk_pixbuf_rotate_simple (scaled_pixbuf, 360 - rc->rotation);
-	g_object_unref (scaled_pixbuf);
-	
-	return rotated_pixbuf;
+	return pixbuf;
 }
 
 static gchar *
@@ -411,14 +816,11 @@ tiff_document_get_page_label (EvDocument *document,
 			      EvPage     *page)
 {
 	TiffDocument *tiff_document = TIFF_DOCUMENT (document);
-	static gchar *label;
 
-	if (TIFFGetField (tiff_document->tiff, TIFFTAG_PAGENAME, &label) &&
-	    g_utf8_validate (label, -1, NULL)) {
-		return g_strdup (label);
-	}
+	if (page->index >= tiff_document_get_n_pages (document))
+		return NULL;
 
-	return NULL;
+	return g_strdup (tiff_document->pages[page->index].label);
 }
 
 static void
@@ -428,6 +830,13 @@ tiff_document_finalize (GObject *object)
 
 	if (tiff_document->tiff)
 		TIFFClose (tiff_document->tiff);
+	if (tiff_document->pages) {
+		gint i;
+
+		for (i = 0; i < tiff_document->n_pages; i++)
+			g_free (tiff_document->pages[i].label);
+		g_free (tiff_document->pages);
+	}
 	if (tiff_document->uri)
 		g_free (tiff_document->uri);
 
@@ -468,7 +877,7 @@ tiff_document_file_exporter_do_page (EvFileExporter *exporter, EvRenderContext *
 
 	if (document->ps_export_ctx == NULL)
 		return;
-	if (TIFFSetDirectory (document->tiff, rc->page->index) != 1)
+	if (!tiff_document_set_page (document, rc->page->index))
 		return;
 	tiff2ps_process_page (document->ps_export_ctx, document->tiff,
 			      0, 0, 0, 0, 0);
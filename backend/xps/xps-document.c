@@ -27,12 +27,47 @@
 #include "ev-document-print.h"
 #include "ev-document-misc.h"
 
+/* Maximum number of pages rendered at the same time */
+#define MAX_HANDLES 4
+
+/* Number of parsed pages kept by each handle */
+#define PAGE_CACHE_SIZE 8
+
+/* An XPS file opened once more, so that a page can be rendered
+ * while another one is rendered with a different handle. A GXPSPage
+ * must not be rendered by two threads at once, so each handle has
+ * its own pages.
+ */
+typedef struct {
+	GXPSFile     *xps;
+	GXPSDocument *doc;
+	GQueue        pages;
+} XPSHandle;
+
+typedef struct {
+	gint      index;
+	GXPSPage *page;
+} XPSCachedPage;
+
 struct _XPSDocument {
 	EvDocument    object;
 
 	GFile        *file;
 	GXPSFile     *xps;
 	GXPSDocument *doc;
+
+	/* The main handle uses xps and doc, its pages are the
+	 * ones of the EvPages. They are only used with the main
+	 * handle acquired, except for the number of pages and the
+	 * page sizes, which don't change once parsed.
+	 */
+	XPSHandle    *main_handle;
+	GList        *handles;
+	GQueue        idle_handles;
+	guint         n_opening;
+	GMutex        handles_lock;
+	GCond         handles_cond;
+	GMutex        pages_lock;
 };
 
 struct _XPSDocumentClass {
@@ -50,10 +85,187 @@ EV_BACKEND_REGISTER_WITH_CODE (XPSDocument, xps_document,
 						       xps_document_document_print_iface_init);
 	       })
 
+/* XPSHandle */
+static XPSHandle *
+xps_handle_new (GXPSFile     *xps,
+		GXPSDocument *doc)
+{
+	XPSHandle *handle;
+
+	handle = g_slice_new0 (XPSHandle);
+	handle->xps = g_object_ref (xps);
+	handle->doc = g_object_ref (doc);
+	g_queue_init (&handle->pages);
+
+	return handle;
+}
+
+static void
+xps_cached_page_free (XPSCachedPage *cached_page)
+{
+	g_object_unref (cached_page->page);
+	g_slice_free (XPSCachedPage, cached_page);
+}
+
+static void
+xps_handle_free (XPSHandle *handle)
+{
+	g_queue_foreach (&handle->pages, (GFunc)xps_cached_page_free, NULL);
+	g_queue_clear (&handle->pages);
+	g_object_unref (handle->doc);
+	g_object_unref (handle->xps);
+	g_slice_free (XPSHandle, handle);
+}
+
+static XPSCachedPage *
+xps_handle_find_page (XPSHandle *handle,
+		      gint       index)
+{
+	GList *l;
+
+	for (l = handle->pages.head; l; l = g_list_next (l)) {
+		XPSCachedPage *cached_page = (XPSCachedPage *)l->data;
+
+		if (cached_page->index == index) {
+			/* Keep the most recently used pages first */
+			g_queue_unlink (&handle->pages, l);
+			g_queue_push_head_link (&handle->pages, l);
+
+			return cached_page;
+		}
+	}
+
+	return NULL;
+}
+
+/* Returns a new reference to the page of the handle's document,
+ * parsing it only when it's not in the cache.
+ */
+static GXPSPage *
+xps_document_get_handle_page (XPSDocument *xps,
+			      XPSHandle   *handle,
+			      gint         index,
+			      GError     **error)
+{
+	XPSCachedPage *cached_page;
+	GXPSPage      *xps_page;
+
+	g_mutex_lock (&xps->pages_lock);
+	cached_page = xps_handle_find_page (handle, index);
+	if (cached_page) {
+		xps_page = g_object_ref (cached_page->page);
+		g_mutex_unlock (&xps->pages_lock);
+
+		return xps_page;
+	}
+	g_mutex_unlock (&xps->pages_lock);
+
+	xps_page = gxps_document_get_page (handle->doc, index, error);
+	if (!xps_page)
+		return NULL;
+
+	g_mutex_lock (&xps->pages_lock);
+	/* Another thread might have parsed it meanwhile */
+	cached_page = xps_handle_find_page (handle, index);
+	if (cached_page) {
+		g_object_unref (xps_page);
+		xps_page = g_object_ref (cached_page->page);
+	} else {
+		cached_page = g_slice_new (XPSCachedPage);
+		cached_page->index = index;
+		cached_page->page = g_object_ref (xps_page);
+		g_queue_push_head (&handle->pages, cached_page);
+		if (g_queue_get_length (&handle->pages) > PAGE_CACHE_SIZE)
+			xps_cached_page_free (g_queue_pop_tail (&handle->pages));
+	}
+	g_mutex_unlock (&xps->pages_lock);
+
+	return xps_page;
+}
+
+/* Opens the file again, for another handle */
+static XPSHandle *
+xps_document_open_handle (XPSDocument *xps)
+{
+	XPSHandle    *handle = NULL;
+	GXPSFile     *file;
+	GXPSDocument *doc = NULL;
+
+	file = gxps_file_new (xps->file, NULL);
+	if (file)
+		doc = gxps_file_get_document (file, 0, NULL);
+	if (doc)
+		handle = xps_handle_new (file, doc);
+	g_clear_object (&file);
+	g_clear_object (&doc);
+
+	return handle;
+}
+
+/* Returns a handle no other thread is rendering with, opening the
+ * file again if all of them are busy and there are not too many.
+ */
+static XPSHandle *
+xps_document_acquire_handle (XPSDocument *xps)
+{
+	XPSHandle *handle;
+
+	g_mutex_lock (&xps->handles_lock);
+	while (!(handle = g_queue_pop_head (&xps->idle_handles))) {
+		if (g_list_length (xps->handles) + xps->n_opening < MAX_HANDLES) {
+			/* The file is opened without the lock, so that
+			 * other handles can be released meanwhile.
+			 */
+			xps->n_opening++;
+			g_mutex_unlock (&xps->handles_lock);
+			handle = xps_document_open_handle (xps);
+			g_mutex_lock (&xps->handles_lock);
+			xps->n_opening--;
+			if (handle) {
+				xps->handles = g_list_prepend (xps->handles, handle);
+				break;
+			}
+		}
+
+		g_cond_wait (&xps->handles_cond, &xps->handles_lock);
+	}
+	g_mutex_unlock (&xps->handles_lock);
+
+	return handle;
+}
+
+/* Waits for the main handle to be idle and takes it, for the
+ * functions using the main document and its pages outside of
+ * rendering, like getting pages, links or the document info.
+ */
+static void
+xps_document_acquire_main_handle (XPSDocument *xps)
+{
+	g_mutex_lock (&xps->handles_lock);
+	while (!g_queue_remove (&xps->idle_handles, xps->main_handle))
+		g_cond_wait (&xps->handles_cond, &xps->handles_lock);
+	g_mutex_unlock (&xps->handles_lock);
+}
+
+static void
+xps_document_release_handle (XPSDocument *xps,
+			     XPSHandle   *handle)
+{
+	g_mutex_lock (&xps->handles_lock);
+	g_queue_push_head (&xps->idle_handles, handle);
+	/* Someone may be waiting for this handle in particular */
+	g_cond_broadcast (&xps->handles_cond);
+	g_mutex_unlock (&xps->handles_lock);
+}
+
 /* XPSDocument */
 static void
-xps_document_init (XPSDocument *ps_document)
+xps_document_init (XPSDocument *xps)
 {
+	g_mutex_init (&xps->handles_lock);
+	g_cond_init (&xps->handles_cond);
+	g_mutex_init (&xps->pages_lock);
+	g_queue_init (&xps->idle_handles);
 }
 
 static void
@@ -61,6 +273,11 @@ xps_document_dispose (GObject *object)
 {
 	XPSDocument *xps = XPS_DOCUMENT (object);
 
+	g_list_free_full (xps->handles, (GDestroyNotify)xps_handle_free);
+	xps->handles = NULL;
+	xps->main_handle = NULL;
+	g_queue_clear (&xps->idle_handles);
+
 	if (xps->file) {
 		g_object_unref (xps->file);
 		xps->file = NULL;
@@ -79,6 +296,18 @@ xps_document_dispose (GObject *object)
 	G_OBJECT_CLASS (xps_document_parent_class)->dispose (object);
 }
 
+static void
+xps_document_finalize (GObject *object)
+{
+	XPSDocument *xps = XPS_DOCUMENT (object);
+
+	g_mutex_clear (&xps->handles_lock);
+	g_cond_clear (&xps->handles_cond);
+	g_mutex_clear (&xps->pages_lock);
+
+	G_OBJECT_CLASS (xps_document_parent_class)->finalize (object);
+}
+
 /* EvDocumentIface */
 static gboolean
 xps_document_load (EvDocument *document,
@@ -102,6 +331,10 @@ xps_document_load (EvDocument *document,
 		return FALSE;
 	}
 
+	xps->main_handle = xps_handle_new (xps->xps, xps->doc);
+	xps->handles = g_list_prepend (NULL, xps->main_handle);
+	g_queue_push_head (&xps->idle_handles, xps->main_handle);
+
 	return TRUE;
 }
 
@@ -140,7 +373,10 @@ xps_document_get_page (EvDocument *document,
 	GXPSPage    *xps_page;
 	EvPage      *page;
 
-	xps_page = gxps_document_get_page (xps->doc, index, NULL);
+	xps_document_acquire_main_handle (xps);
+	xps_page = xps_document_get_handle_page (xps, xps->main_handle, index, NULL);
+	xps_document_release_handle (xps, xps->main_handle);
+
 	page = ev_page_new (index);
 	if (xps_page) {
 		page->backend_page = (EvBackendPage)xps_page;
@@ -175,9 +411,13 @@ xps_document_get_info (EvDocument *document)
 	if (info->n_pages > 0) {
                 GXPSPage *gxps_page;
 
-                gxps_page = gxps_document_get_page (xps->doc, 0, NULL);
-		gxps_page_get_size (gxps_page, &(info->paper_width), &(info->paper_height));
-                g_object_unref (gxps_page);
+                xps_document_acquire_main_handle (xps);
+                gxps_page = xps_document_get_handle_page (xps, xps->main_handle, 0, NULL);
+                xps_document_release_handle (xps, xps->main_handle);
+                if (gxps_page) {
+                        gxps_page_get_size (gxps_page, &(info->paper_width), &(info->paper_height));
+                        g_object_unref (gxps_page);
+                }
 
 		info->paper_width  = info->paper_width / 96.0f * 25.4f;
 		info->paper_height = info->paper_height / 96.0f * 25.4f;
@@ -200,6 +440,8 @@ static cairo_surface_t *
 xps_document_render (EvDocument      *document,
 		     EvRenderContext *rc)
 {
+	XPSDocument     *xps = XPS_DOCUMENT (document);
+	XPSHandle       *handle;
 	GXPSPage        *xps_page;
 	gdouble          page_width, page_height;
 	gint             width, height;
@@ -208,7 +450,16 @@ xps_document_render (EvDocument      *document,
 	cairo_t         *cr;
 	GError          *error = NULL;
 
-	xps_page = GXPS_PAGE (rc->page->backend_page);
+	handle = xps_document_acquire_handle (xps);
+	xps_page = xps_document_get_handle_page (xps, handle, rc->page->index, &error);
+	if (!xps_page) {
+		xps_document_release_handle (xps, handle);
+		g_warning ("Error loading page %d: %s\n",
+			   rc->page->index, error->message);
+		g_error_free (error);
+
+		return NULL;
+	}
 
 	gxps_page_get_size (xps_page, &page_width, &page_height);
 	ev_render_context_compute_transformed_size (rc, page_width, page_height,
@@ -243,6 +494,9 @@ xps_document_render (EvDocument      *document,
 	gxps_page_render (xps_page, cr, &error);
 	cairo_destroy (cr);
 
+	g_object_unref (xps_page);
+	xps_document_release_handle (xps, handle);
+
 	if (error) {
 		g_warning ("Error rendering page %d: %s\n",
 			   rc->page->index, error->message);
@@ -259,6 +513,7 @@ xps_document_class_init (XPSDocumentClass *klass)
 	EvDocumentClass *ev_document_class = EV_DOCUMENT_CLASS (klass);
 
 	object_class->dispose = xps_document_dispose;
+	object_class->finalize = xps_document_finalize;
 
 	ev_document_class->load = xps_document_load;
 	ev_document_class->save = xps_document_save;
@@ -276,14 +531,15 @@ xps_document_links_has_document_links (EvDocumentLinks *document_links)
 {
 	XPSDocument           *xps_document = XPS_DOCUMENT (document_links);
 	GXPSDocumentStructure *structure;
-	gboolean               retval;
+	gboolean               retval = FALSE;
 
+	xps_document_acquire_main_handle (xps_document);
 	structure = gxps_document_get_structure (xps_document->doc);
-	if (!structure)
-		return FALSE;
-
-	retval = gxps_document_structure_has_outline (structure);
-	g_object_unref (structure);
+	if (structure) {
+		retval = gxps_document_structure_has_outline (structure);
+		g_object_unref (structure);
+	}
+	xps_document_release_handle (xps_document, xps_document->main_handle);
 
 	return retval;
 }
@@ -383,9 +639,12 @@ xps_document_links_get_links_model (EvDocumentLinks *document_links)
 	GXPSOutlineIter        iter;
 	GtkTreeModel          *model = NULL;
 
+	xps_document_acquire_main_handle (xps_document);
 	structure = gxps_document_get_structure (xps_document->doc);
-	if (!structure)
+	if (!structure) {
+		xps_document_release_handle (xps_document, xps_document->main_handle);
 		return NULL;
+	}
 
 	if (gxps_document_structure_outline_iter_init (&iter, structure)) {
 		model = (GtkTreeModel *) gtk_tree_store_new (EV_DOCUMENT_LINKS_COLUMN_NUM_COLUMNS,
@@ -397,6 +656,7 @@ xps_document_links_get_links_model (EvDocumentLinks *document_links)
 	}
 
 	g_object_unref (structure);
+	xps_document_release_handle (xps_document, xps_document->main_handle);
 
 	return model;
 }
@@ -411,6 +671,8 @@ xps_document_links_get_links (EvDocumentLinks *document_links,
 	GList       *mapping_list;
 	GList       *list;
 
+	/* The links are parsed from the file of the main handle */
+	xps_document_acquire_main_handle (xps_document);
 	xps_page = GXPS_PAGE (page->backend_page);
 	mapping_list = gxps_page_get_links (xps_page, NULL);
 
@@ -439,6 +701,7 @@ xps_document_links_get_links (EvDocumentLinks *document_links,
 	}
 
 	g_list_free (mapping_list);
+	xps_document_release_handle (xps_document, xps_document->main_handle);
 
 	return ev_mapping_list_new (page->index, g_list_reverse (retval), (GDestroyNotify)g_object_unref);
 }
@@ -453,18 +716,17 @@ xps_document_links_find_link_dest (EvDocumentLinks *document_links,
 	cairo_rectangle_t  area;
 	EvLinkDest        *dest = NULL;
 
+	xps_document_acquire_main_handle (xps_document);
 	page = gxps_document_get_page_for_anchor (xps_document->doc, link_name);
-	if (page == -1)
-		return NULL;
-
-	xps_page = gxps_document_get_page (xps_document->doc, page, NULL);
-	if (!xps_page)
-		return NULL;
-
-	if (gxps_page_get_anchor_destination (xps_page, link_name, &area, NULL))
-		dest = ev_link_dest_new_xyz (page, area.x, area.y, 1., TRUE, TRUE, FALSE);
-
-	g_object_unref (xps_page);
+	xps_page = page != -1 ?
+		xps_document_get_handle_page (xps_document, xps_document->main_handle,
+					      page, NULL) : NULL;
+	if (xps_page) {
+		if (gxps_page_get_anchor_destination (xps_page, link_name, &area, NULL))
+			dest = ev_link_dest_new_xyz (page, area.x, area.y, 1., TRUE, TRUE, FALSE);
+		g_object_unref (xps_page);
+	}
+	xps_document_release_handle (xps_document, xps_document->main_handle);
 
 	return dest;
 }
@@ -474,8 +736,13 @@ xps_document_links_find_link_page (EvDocumentLinks *document_links,
 				   const gchar     *link_name)
 {
 	XPSDocument *xps_document = XPS_DOCUMENT (document_links);
+	gint         page;
 
-	return gxps_document_get_page_for_anchor (xps_document->doc, link_name);
+	xps_document_acquire_main_handle (xps_document);
+	page = gxps_document_get_page_for_anchor (xps_document->doc, link_name);
+	xps_document_release_handle (xps_document, xps_document->main_handle);
+
+	return page;
 }
 
 static void
@@ -494,9 +761,18 @@ xps_document_print_print_page (EvDocumentPrint *document,
 			       EvPage          *page,
 			       cairo_t         *cr)
 {
-	GError *error = NULL;
+	XPSDocument *xps = XPS_DOCUMENT (document);
+	XPSHandle   *handle;
+	GXPSPage    *xps_page;
+	GError      *error = NULL;
 
-	gxps_page_render (GXPS_PAGE (page->backend_page), cr, &error);
+	handle = xps_document_acquire_handle (xps);
+	xps_page = xps_document_get_handle_page (xps, handle, page->index, &error);
+	if (xps_page) {
+		gxps_page_render (xps_page, cr, &error);
+		g_object_unref (xps_page);
+	}
+	xps_document_release_handle (xps, handle);
 	if (error) {
 		g_warning ("Error rendering page %d for printing: %s\n",
 			   page->index, error->message);
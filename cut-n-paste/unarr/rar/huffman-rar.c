@@ -118,6 +118,79 @@ static bool rar_make_table_rec(struct huffman_code *code, int node, int offset,
     return true;
 }
 
+static int rar_tree_depth(struct huffman_code *code, int node)
+{
+    int depth0, depth1;
+
+    if (node < 0 || code->numentries <= node || rar_is_leaf_node(code, node))
+        return 0;
+    depth0 = rar_tree_depth(code, code->tree[node].branches[0]);
+    depth1 = rar_tree_depth(code, code->tree[node].branches[1]);
+    return 1 + (depth0 > depth1 ? depth0 : depth1);
+}
+
+static void rar_make_subtable_rec(struct huffman_code *code, int node, int offset, int depth, int maxdepth)
+{
+    int currtablesize = 1 << (maxdepth - depth);
+    int i;
+
+    if (node < 0 || code->numentries <= node || (depth == maxdepth && !rar_is_leaf_node(code, node))) {
+        /* incomplete code: let the lookup fail on these prefixes */
+        for (i = 0; i < currtablesize; i++) {
+            code->table[offset + i].length = -1;
+            code->table[offset + i].value = -1;
+        }
+    }
+    else if (rar_is_leaf_node(code, node)) {
+        for (i = 0; i < currtablesize; i++) {
+            code->table[offset + i].length = depth;
+            code->table[offset + i].value = code->tree[node].branches[0];
+        }
+    }
+    else {
+        rar_make_subtable_rec(code, code->tree[node].branches[0], offset, depth + 1, maxdepth);
+        rar_make_subtable_rec(code, code->tree[node].branches[1], offset + currtablesize / 2, depth + 1, maxdepth);
+    }
+}
+
+/* codes longer than the first level table get a second level table
+   per prefix, sized for the deepest code sharing that prefix */
+static bool rar_make_subtables(struct huffman_code *code)
+{
+    int rootsize = 1 << code->tablesize;
+    int totalsize = rootsize;
+    int i;
+    void *new_table;
+
+    for (i = 0; i < rootsize; i++) {
+        if (code->table[i].length > code->tablesize)
+            totalsize += 1 << rar_tree_depth(code, code->table[i].value);
+    }
+    if (totalsize == rootsize)
+        return true;
+
+    new_table = realloc(code->table, totalsize * sizeof(*code->table));
+    if (!new_table) {
+        warn("OOM during decompression");
+        return false;
+    }
+    code->table = new_table;
+
+    totalsize = rootsize;
+    for (i = 0; i < rootsize; i++) {
+        int node, subbits;
+        if (code->table[i].length <= code->tablesize)
+            continue;
+        node = code->table[i].value;
+        subbits = rar_tree_depth(code, node);
+        rar_make_subtable_rec(code, node, totalsize, 0, subbits);
+        code->table[i].length = code->tablesize + subbits;
+        code->table[i].value = totalsize;
+        totalsize += 1 << subbits;
+    }
+    return true;
+}
+
 bool rar_make_table(struct huffman_code *code)
 {
     if (code->minlength <= code->maxlength && code->maxlength <= 10)
@@ -131,7 +204,9 @@ bool rar_make_table(struct huffman_code *code)
         return false;
     }
 
-    return rar_make_table_rec(code, 0, 0, 0, code->tablesize);
+    if (!rar_make_table_rec(code, 0, 0, 0, code->tablesize))
+        return false;
+    return rar_make_subtables(code);
 }
 
 void rar_free_code(struct huffman_code *code)
@@ -77,6 +77,8 @@ static bool rar_parse_entry(ar_archive *ar, off64_t offset)
             }
             else {
                 br_clear_leftover_bits(&rar->uncomp);
+                /* bytes read ahead from the previous entry's data are never used */
+                br_clear_buffered_bytes(&rar->uncomp);
             }
 
             rar->solid.restart = rar->entry.solid && (out_of_order || !rar->solid.part_done);
@@ -218,6 +218,9 @@ struct ar_archive_rar_uncomp {
         uint64_t bits;
         int available;
         bool at_eof;
+        uint8_t buffer[4096];
+        size_t buffer_pos;
+        size_t buffer_len;
     } br;
 };
 
@@ -225,6 +228,7 @@ bool rar_uncompress_part(ar_archive_rar *rar, void *buffer, size_t buffer_size);
 int64_t rar_expand(ar_archive_rar *rar, int64_t end);
 void rar_clear_uncompress(struct ar_archive_rar_uncomp *uncomp);
 static inline void br_clear_leftover_bits(struct ar_archive_rar_uncomp *uncomp) { uncomp->br.available &= ~0x07; }
+static inline void br_clear_buffered_bytes(struct ar_archive_rar_uncomp *uncomp) { uncomp->br.buffer_pos = uncomp->br.buffer_len = 0; }
 
 /***** rar *****/
 
@@ -10,27 +10,49 @@ static void *gSzAlloc_Alloc(ISzAllocPtr p, size_t size) { return malloc(size); }
 static void gSzAlloc_Free(ISzAllocPtr p, void *ptr) { free(ptr); }
 static ISzAlloc gSzAlloc = { gSzAlloc_Alloc, gSzAlloc_Free };
 
+/* reads the entry's compressed data in large chunks instead of a few bytes per refill */
+static void br_fill_buffer(ar_archive_rar *rar)
+{
+    struct StreamBitReader *br = &rar->uncomp.br;
+    size_t left = br->buffer_len - br->buffer_pos;
+    size_t count = sizeof(br->buffer) - left;
+
+    memmove(br->buffer, br->buffer + br->buffer_pos, left);
+    br->buffer_pos = 0;
+    br->buffer_len = left;
+
+    if (rar->progress.data_left < count)
+        count = rar->progress.data_left;
+    if (count == 0)
+        return;
+    /* a short read only matters if the missing bytes are ever needed */
+    count = ar_read(rar->super.stream, br->buffer + left, count);
+    rar->progress.data_left -= count;
+    br->buffer_len += count;
+}
+
 static bool br_fill(ar_archive_rar *rar, int bits)
 {
-    uint8_t bytes[8];
+    struct StreamBitReader *br = &rar->uncomp.br;
     int count, i;
     /* read as many bits as possible */
-    count = (64 - rar->uncomp.br.available) / 8;
-    if (rar->progress.data_left < (size_t)count)
-        count = (int)rar->progress.data_left;
-
-    if (bits > rar->uncomp.br.available + 8 * count || ar_read(rar->super.stream, bytes, count) != (size_t)count) {
-        if (!rar->uncomp.br.at_eof) {
+    count = (64 - br->available) / 8;
+    if (br->buffer_len - br->buffer_pos < (size_t)count)
+        br_fill_buffer(rar);
+    if (br->buffer_len - br->buffer_pos < (size_t)count)
+        count = (int)(br->buffer_len - br->buffer_pos);
+
+    if (bits > br->available + 8 * count) {
+        if (!br->at_eof) {
             warn("Unexpected EOF during decompression (truncated file?)");
-            rar->uncomp.br.at_eof = true;
+            br->at_eof = true;
         }
         return false;
     }
-    rar->progress.data_left -= count;
     for (i = 0; i < count; i++) {
-        rar->uncomp.br.bits = (rar->uncomp.br.bits << 8) | bytes[i];
+        br->bits = (br->bits << 8) | br->buffer[br->buffer_pos++];
     }
-    rar->uncomp.br.available += 8 * count;
+    br->available += 8 * count;
     return true;
 }
 
@@ -165,6 +187,10 @@ static int rar_read_next_symbol(ar_archive_rar *rar, struct huffman_code *code)
     if (!code->table && !rar_make_table(code))
         return -1;
 
+    /* try to have a whole code in the bit buffer (this can't fail, short codes may still fit) */
+    if (rar->uncomp.br.available < code->maxlength)
+        br_fill(rar, 0);
+
     /* performance optimization */
     if (code->tablesize <= rar->uncomp.br.available) {
         uint16_t bits = (uint16_t)br_bits(rar, code->tablesize);
@@ -181,7 +207,24 @@ static int rar_read_next_symbol(ar_archive_rar *rar, struct huffman_code *code)
             return value;
         }
 
-        node = value;
+        /* second level table */
+        length -= code->tablesize;
+        if (length <= rar->uncomp.br.available) {
+            int subbits = length;
+            bits = (uint16_t)br_bits(rar, subbits);
+            length = code->table[value + bits].length;
+            value = code->table[value + bits].value;
+
+            if (length < 0) {
+                warn("Invalid data in bitstream"); /* invalid prefix code in bitstream */
+                return -1;
+            }
+            rar->uncomp.br.available += subbits - length;
+            return value;
+        }
+
+        /* not enough data left for the lookup, walk the tree instead */
+        rar->uncomp.br.available += code->tablesize;
     }
 
     while (!rar_is_leaf_node(code, node)) {
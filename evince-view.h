@@ -24,6 +24,7 @@
 #include <libview/ev-job-scheduler.h>
 #include <libview/ev-jobs.h>
 #include <libview/ev-document-model.h>
+#include <libview/ev-document-async.h>
 #include <libview/ev-print-operation.h>
 #include <libview/ev-view.h>
 #include <libview/ev-view-type-builtins.h>
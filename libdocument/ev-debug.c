@@ -38,16 +38,44 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <gio/gio.h>
 
 #include "ev-debug.h"
 
+/* Number of events kept for every thread, the oldest ones are
+ * overwritten when the buffer is full.
+ */
+#define PROFILER_BUFFER_SIZE 4096
+#define PROFILER_NAME_SIZE   64
+
+typedef struct {
+	gint64        time;
+	gconstpointer document;
+	gint          page;
+	gchar         phase;
+	gchar         name[PROFILER_NAME_SIZE];
+} EvProfilerEvent;
+
+typedef struct {
+	GMutex          lock;
+	gint            thread_id;
+	gboolean        is_main_thread;
+	guint64         n_events;
+	EvProfilerEvent events[PROFILER_BUFFER_SIZE];
+} EvProfilerBuffer;
+
+static EvProfileSection ev_profile = EV_NO_PROFILE;
+
+static GThread *profiler_main_thread = NULL;
+static GPrivate profiler_buffer_key = G_PRIVATE_INIT (NULL);
+static GSList  *profiler_buffers = NULL;
+static GMutex   profiler_lock;
+
 #ifdef EV_ENABLE_DEBUG
 static EvDebugSection ev_debug = EV_NO_DEBUG;
-static EvProfileSection ev_profile = EV_NO_PROFILE;
 static EvDebugBorders ev_debug_borders = EV_DEBUG_BORDER_NONE;
 
-static GHashTable *timers = NULL;
-
 static void
 debug_init (void)
 {
@@ -70,6 +98,7 @@ debug_init (void)
                 ev_debug_borders = g_parse_debug_string (g_getenv ("EV_DEBUG_SHOW_BORDERS"),
                                                          border_keys, G_N_ELEMENTS (border_keys));
 }
+#endif /* EV_ENABLE_DEBUG */
 
 static void
 profile_init (void)
@@ -82,30 +111,66 @@ profile_init (void)
 			ev_profile |= EV_PROFILE_JOBS;
 	}
 
+	profiler_main_thread = g_thread_self ();
+}
+
+static gchar *
+profiler_get_default_filename (void)
+{
+	const gchar *filename;
+	gchar       *basename;
+	gchar       *retval;
+
+	filename = g_getenv ("EV_PROFILE_TRACE");
+	if (filename && filename[0] != '\0')
+		return g_strdup (filename);
+
+	basename = g_strdup_printf ("evince-trace-%d.json", (gint) getpid ());
+	retval = g_build_filename (g_get_tmp_dir (), basename, NULL);
+	g_free (basename);
+
+	return retval;
+}
+
+static void
+profile_shutdown (void)
+{
 	if (ev_profile) {
-		timers = g_hash_table_new_full (g_str_hash,
-						g_str_equal,
-						(GDestroyNotify) g_free,
-						(GDestroyNotify) g_timer_destroy);
+		GError *error = NULL;
+		gchar  *filename;
+
+		filename = profiler_get_default_filename ();
+		if (ev_profiler_write_trace (filename, &error)) {
+			g_printerr ("Profiler trace written to %s\n", filename);
+		} else {
+			g_warning ("Failed to write profiler trace: %s", error->message);
+			g_error_free (error);
+		}
+		g_free (filename);
 	}
+
+	/* The buffers are not freed, threads still running keep
+	 * pointers to them, recording just stops.
+	 */
+	ev_profile = EV_NO_PROFILE;
 }
 
 void
 _ev_debug_init (void)
 {
+#ifdef EV_ENABLE_DEBUG
 	debug_init ();
+#endif
 	profile_init ();
 }
 
 void
 _ev_debug_shutdown (void)
 {
-	if (timers) {
-		g_hash_table_destroy (timers);
-		timers = NULL;
-	}
+	profile_shutdown ();
 }
 
+#ifdef EV_ENABLE_DEBUG
 void
 ev_debug_message (EvDebugSection  section,
 		  const gchar    *file,
@@ -132,29 +197,102 @@ ev_debug_message (EvDebugSection  section,
 	}
 }
 
+EvDebugBorders
+ev_debug_get_debug_borders (void)
+{
+        return ev_debug_borders;
+}
+#endif /* EV_ENABLE_DEBUG */
+
+/* Every thread records its events in its own buffer, so threads only
+ * wait for each other while a trace is being written.
+ */
+static EvProfilerBuffer *
+profiler_get_buffer (void)
+{
+	static gint       n_threads = 0;
+	EvProfilerBuffer *buffer;
+
+	buffer = g_private_get (&profiler_buffer_key);
+	if (G_LIKELY (buffer))
+		return buffer;
+
+	buffer = g_new0 (EvProfilerBuffer, 1);
+	g_mutex_init (&buffer->lock);
+	buffer->thread_id = g_atomic_int_add (&n_threads, 1) + 1;
+	buffer->is_main_thread = g_thread_self () == profiler_main_thread;
+	g_private_set (&profiler_buffer_key, buffer);
+
+	g_mutex_lock (&profiler_lock);
+	profiler_buffers = g_slist_prepend (profiler_buffers, buffer);
+	g_mutex_unlock (&profiler_lock);
+
+	return buffer;
+}
+
+static void
+profiler_record (gchar          phase,
+		 gconstpointer  document,
+		 gint           page,
+		 const gchar   *format,
+		 va_list        args)
+{
+	EvProfilerBuffer *buffer;
+	EvProfilerEvent  *event;
+
+	buffer = profiler_get_buffer ();
+
+	g_mutex_lock (&buffer->lock);
+	event = &buffer->events[buffer->n_events++ % PROFILER_BUFFER_SIZE];
+	event->time = g_get_monotonic_time ();
+	event->document = document;
+	event->page = page;
+	event->phase = phase;
+	g_vsnprintf (event->name, PROFILER_NAME_SIZE, format, args);
+	g_mutex_unlock (&buffer->lock);
+}
+
 void
 ev_profiler_start (EvProfileSection section,
 		   const gchar     *format, ...)
 {
 	if (G_UNLIKELY (ev_profile & section)) {
-		GTimer *timer;
-		gchar  *name;
 		va_list args;
 
 		if (!format)
 			return;
 
 		va_start (args, format);
-		name = g_strdup_vprintf (format, args);
+		profiler_record ('b', NULL, -1, format, args);
 		va_end (args);
+	}
+}
 
-		timer = g_hash_table_lookup (timers, name);
-		if (!timer) {
-			timer = g_timer_new ();
-			g_hash_table_insert (timers, g_strdup (name), timer);
-		} else {
-			g_timer_start (timer);
-		}
+/**
+ * ev_profiler_start_full:
+ * @section: a #EvProfileSection
+ * @document: (allow-none): the document being processed, or %NULL
+ * @page: the page being processed, or -1
+ * @format: printf-like format of the event name
+ *
+ * Like ev_profiler_start(), recording also the document and the page,
+ * that are shown as arguments of the event in the trace.
+ */
+void
+ev_profiler_start_full (EvProfileSection section,
+			gconstpointer    document,
+			gint             page,
+			const gchar     *format, ...)
+{
+	if (G_UNLIKELY (ev_profile & section)) {
+		va_list args;
+
+		if (!format)
+			return;
+
+		va_start (args, format);
+		profiler_record ('b', document, page, format, args);
+		va_end (args);
 	}
 }
 
@@ -163,33 +301,136 @@ ev_profiler_stop (EvProfileSection section,
 		  const gchar     *format, ...)
 {
 	if (G_UNLIKELY (ev_profile & section)) {
-		GTimer *timer;
-		gchar  *name;
 		va_list args;
-		gdouble seconds;
 
 		if (!format)
 			return;
 
 		va_start (args, format);
-		name = g_strdup_vprintf (format, args);
+		profiler_record ('e', NULL, -1, format, args);
 		va_end (args);
-		
-		timer = g_hash_table_lookup (timers, name);
-		if (!timer)
-			return;
-		
-		g_timer_stop (timer);
-		seconds = g_timer_elapsed (timer, NULL);
-		g_print ("[ %s ] %f s elapsed\n", name, seconds);
-		fflush (stdout);
 	}
 }
 
-EvDebugBorders
-ev_debug_get_debug_borders (void)
+gboolean
+ev_profiler_is_enabled (void)
 {
-        return ev_debug_borders;
+	return ev_profile != EV_NO_PROFILE;
 }
 
-#endif /* EV_ENABLE_DEBUG */
+static void
+profiler_append_json_string (GString     *str,
+			     const gchar *value)
+{
+	const gchar *p;
+
+	g_string_append_c (str, '"');
+	for (p = value; *p; p++) {
+		if (*p == '"' || *p == '\\')
+			g_string_append_printf (str, "\\%c", *p);
+		else if ((guchar) *p < 0x20)
+			g_string_append_printf (str, "\\u%04x", (guint) *p);
+		else
+			g_string_append_c (str, *p);
+	}
+	g_string_append_c (str, '"');
+}
+
+static void
+profiler_append_buffer (GString          *str,
+			EvProfilerBuffer *buffer,
+			gint              pid)
+{
+	guint64 i, first;
+
+	g_string_append_printf (str,
+				"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+				"\"args\":{\"name\":\"%s %d\"}},\n",
+				pid, buffer->thread_id,
+				buffer->is_main_thread ? "Main thread" : "Thread",
+				buffer->thread_id);
+
+	g_mutex_lock (&buffer->lock);
+
+	first = buffer->n_events > PROFILER_BUFFER_SIZE ?
+		buffer->n_events - PROFILER_BUFFER_SIZE : 0;
+	for (i = first; i < buffer->n_events; i++) {
+		EvProfilerEvent *event = &buffer->events[i % PROFILER_BUFFER_SIZE];
+
+		/* Jobs start in a thread and finish in the main thread, so
+		 * they are async events, matched by their name.
+		 */
+		g_string_append (str, "{\"name\":");
+		profiler_append_json_string (str, event->name);
+		g_string_append_printf (str,
+					",\"cat\":\"jobs\",\"ph\":\"%c\",\"id\":\"0x%x\","
+					"\"ts\":%" G_GINT64_FORMAT ",\"pid\":%d,\"tid\":%d",
+					event->phase, g_str_hash (event->name),
+					event->time, pid, buffer->thread_id);
+		if (event->document || event->page >= 0) {
+			g_string_append (str, ",\"args\":{");
+			if (event->document)
+				g_string_append_printf (str, "\"document\":\"%p\"%s",
+							event->document,
+							event->page >= 0 ? "," : "");
+			if (event->page >= 0)
+				g_string_append_printf (str, "\"page\":%d", event->page);
+			g_string_append_c (str, '}');
+		}
+		g_string_append (str, "},\n");
+	}
+
+	g_mutex_unlock (&buffer->lock);
+}
+
+/**
+ * ev_profiler_write_trace:
+ * @filename: the file to write the trace to, or %NULL to use
+ *   EV_PROFILE_TRACE or a temporary file
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Writes the events recorded so far in the Chrome trace event format.
+ *
+ * Returns: %TRUE on success, %FALSE if the profiler is not enabled
+ *   or the file could not be written
+ */
+gboolean
+ev_profiler_write_trace (const gchar *filename,
+			 GError     **error)
+{
+	GString  *str;
+	GSList   *l;
+	gchar    *default_filename = NULL;
+	gint      pid = (gint) getpid ();
+	gboolean  retval;
+
+	if (!ev_profile) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+				     "Profiling is not enabled, set EV_PROFILE to enable it");
+		return FALSE;
+	}
+
+	if (!filename)
+		filename = default_filename = profiler_get_default_filename ();
+
+	str = g_string_new ("{\"traceEvents\":[\n");
+
+	g_mutex_lock (&profiler_lock);
+	for (l = profiler_buffers; l; l = g_slist_next (l))
+		profiler_append_buffer (str, (EvProfilerBuffer *) l->data, pid);
+	g_mutex_unlock (&profiler_lock);
+
+	/* The trailing comma is not valid JSON, close with a last event */
+	g_string_append_printf (str,
+				"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+				"\"args\":{\"name\":", pid);
+	profiler_append_json_string (str, g_get_prgname () ? g_get_prgname () : "evince");
+	g_string_append (str, "}}\n],\"displayTimeUnit\":\"ms\"}\n");
+
+	retval = g_file_set_contents (filename, str->str, str->len, error);
+
+	g_string_free (str, TRUE);
+	g_free (default_filename);
+
+	return retval;
+}
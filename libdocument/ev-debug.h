@@ -43,22 +43,46 @@
 
 #define EV_GET_TYPE_NAME(instance) g_type_name_from_instance ((gpointer)instance)
 
+G_BEGIN_DECLS
+
+/*
+ * The profiler is available in all builds. Set an environmental var
+ * of the same name to turn on profiling. Setting EV_PROFILE will turn
+ * on all sections. The events are recorded per thread, and written as
+ * a Chrome trace, that can be loaded in chrome://tracing or Perfetto,
+ * on exit to the file in EV_PROFILE_TRACE, or to a temporary file if
+ * it's not set.
+ */
+typedef enum {
+	EV_NO_PROFILE   = 0,
+	EV_PROFILE_JOBS = 1 << 0
+} EvProfileSection;
+
+void     _ev_debug_init          (void);
+void     _ev_debug_shutdown      (void);
+
+void     ev_profiler_start       (EvProfileSection section,
+				  const gchar     *format, ...) G_GNUC_PRINTF(2, 3);
+void     ev_profiler_start_full  (EvProfileSection section,
+				  gconstpointer    document,
+				  gint             page,
+				  const gchar     *format, ...) G_GNUC_PRINTF(4, 5);
+void     ev_profiler_stop        (EvProfileSection section,
+				  const gchar     *format, ...) G_GNUC_PRINTF(2, 3);
+gboolean ev_profiler_is_enabled  (void);
+gboolean ev_profiler_write_trace (const gchar     *filename,
+				  GError         **error);
+
+G_END_DECLS
+
 #ifndef EV_ENABLE_DEBUG
 
-#define _ev_debug_init()
-#define _ev_debug_shutdown()
 #if defined(G_HAVE_GNUC_VARARGS)
 #define ev_debug_message(section, format, args...) G_STMT_START { } G_STMT_END
-#define ev_profiler_start(format, args...) G_STMT_START { } G_STMT_END
-#define ev_profiler_stop(format, args...) G_STMT_START { } G_STMT_END
 #elif defined(G_HAVE_ISO_VARARGS)
 #define ev_debug_message(...) G_STMT_START { } G_STMT_END
-#define ev_profiler_start(...) G_STMT_START { } G_STMT_END
-#define ev_profiler_stop(...) G_STMT_START { } G_STMT_END
 #else /* no varargs macros */
 static void ev_debug_message(EvDebugSection section, const gchar *file, gint line, const gchar *function, const gchar *format, ...) {}
-static void ev_profiler_start(EvProfileSection section,	const gchar *format, ...) {}
-static void ev_profiler_stop(EvProfileSection section, const gchar *format, ...) {}
 #endif
 
 #else /* ENABLE_DEBUG */
@@ -90,28 +114,11 @@ typedef enum {
 
 #define DEBUG_JOBS      EV_DEBUG_JOBS,    __FILE__, __LINE__, G_STRFUNC
 
-/*
- * Set an environmental var of the same name to turn on
- * profiling. Setting EV_PROFILE will turn on all
- * sections.
- */
-typedef enum {
-	EV_NO_PROFILE   = 0,
-	EV_PROFILE_JOBS = 1 << 0
-} EvProfileSection;
-
-void _ev_debug_init     (void);
-void _ev_debug_shutdown (void);
-
 void ev_debug_message  (EvDebugSection   section,
 			const gchar     *file,
 			gint             line,
 			const gchar     *function,
 			const gchar     *format, ...) G_GNUC_PRINTF(5, 6);
-void ev_profiler_start (EvProfileSection section,
-			const gchar     *format, ...) G_GNUC_PRINTF(2, 3);
-void ev_profiler_stop  (EvProfileSection section,
-			const gchar     *format, ...) G_GNUC_PRINTF(2, 3);
 
 EvDebugBorders ev_debug_get_debug_borders (void);
 
@@ -26,6 +26,7 @@
 #include <gtk/gtk.h>
 
 #include "ev-document-misc.h"
+#include "ev-pixel-convert-private.h"
 
 /* Returns a new GdkPixbuf that is suitable for placing in the thumbnail view.
  * It is four pixels wider and taller than the source.  If source_pixbuf is not
@@ -370,19 +371,53 @@ cairo_surface_t *
 ev_document_misc_surface_from_pixbuf (GdkPixbuf *pixbuf)
 {
 	cairo_surface_t *surface;
-	cairo_t         *cr;
+	const guchar    *src;
+	guchar          *dest;
+	gint             width, height;
+	gint             src_stride, dest_stride;
+	gint             n_channels;
+	gint             y;
 
 	g_return_val_if_fail (GDK_IS_PIXBUF (pixbuf), NULL);
 
+	width = gdk_pixbuf_get_width (pixbuf);
+	height = gdk_pixbuf_get_height (pixbuf);
+	n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+
 	surface = cairo_image_surface_create (gdk_pixbuf_get_has_alpha (pixbuf) ?
 					      CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24,
-					      gdk_pixbuf_get_width (pixbuf),
-					      gdk_pixbuf_get_height (pixbuf));
-	cr = cairo_create (surface);
-	gdk_cairo_set_source_pixbuf (cr, pixbuf, 0, 0);
-	cairo_paint (cr);
-	cairo_destroy (cr);
-	
+					      width, height);
+
+	if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS ||
+	    gdk_pixbuf_get_bits_per_sample (pixbuf) != 8 ||
+	    (n_channels != 3 && n_channels != 4)) {
+		cairo_t *cr;
+
+		cr = cairo_create (surface);
+		gdk_cairo_set_source_pixbuf (cr, pixbuf, 0, 0);
+		cairo_paint (cr);
+		cairo_destroy (cr);
+
+		return surface;
+	}
+
+	src = gdk_pixbuf_read_pixels (pixbuf);
+	src_stride = gdk_pixbuf_get_rowstride (pixbuf);
+	dest = cairo_image_surface_get_data (surface);
+	dest_stride = cairo_image_surface_get_stride (surface);
+
+	cairo_surface_flush (surface);
+	for (y = 0; y < height; y++) {
+		if (n_channels == 4)
+			ev_pixel_convert_rgba_to_argb32 (src, (guint32 *)dest, width);
+		else
+			ev_pixel_convert_rgb_to_rgb24 (src, (guint32 *)dest, width);
+
+		src += src_stride;
+		dest += dest_stride;
+	}
+	cairo_surface_mark_dirty (surface);
+
 	return surface;
 }
 
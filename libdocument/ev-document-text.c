@@ -91,3 +91,65 @@ ev_document_text_get_text_attrs (EvDocumentText *document_text,
 
 	return iface->get_text_attrs (document_text, page);
 }
+
+/**
+ * ev_document_text_get_text_data:
+ * @document_text: a #EvDocumentText
+ * @page: a #EvPage
+ * @text: (out) (allow-none) (transfer full): return location for the text, or %NULL
+ * @areas: (out) (allow-none) (transfer full) (array length=n_areas): return location
+ *   for the text layout, or %NULL
+ * @n_areas: (out) (allow-none): return location for the number of @areas
+ * @text_mapping: (out) (allow-none) (transfer full): return location for the text
+ *   mapping, or %NULL
+ * @text_attrs: (out) (allow-none) (transfer full): return location for the text
+ *   attributes, or %NULL
+ *
+ * Gets all the requested text data of @page at once. Only the data whose return
+ * location is not %NULL is retrieved, so that backends able to extract all of it
+ * from a single pass over the page text don't need to extract the text again for
+ * every call to ev_document_text_get_text(), ev_document_text_get_text_layout(),
+ * ev_document_text_get_text_mapping() and ev_document_text_get_text_attrs().
+ *
+ * Returns: %TRUE if any of the requested data was retrieved
+ *
+ * Since: 3.32
+ */
+gboolean
+ev_document_text_get_text_data (EvDocumentText  *document_text,
+				EvPage          *page,
+				gchar          **text,
+				EvRectangle    **areas,
+				guint           *n_areas,
+				cairo_region_t **text_mapping,
+				PangoAttrList  **text_attrs)
+{
+	EvDocumentTextInterface *iface = EV_DOCUMENT_TEXT_GET_IFACE (document_text);
+	gboolean                 retval = FALSE;
+
+	g_return_val_if_fail ((areas == NULL) == (n_areas == NULL), FALSE);
+
+	if (iface->get_text_data)
+		return iface->get_text_data (document_text, page, text, areas, n_areas,
+					     text_mapping, text_attrs);
+
+	if (text_mapping) {
+		*text_mapping = ev_document_text_get_text_mapping (document_text, page);
+		retval |= *text_mapping != NULL;
+	}
+	if (text) {
+		*text = ev_document_text_get_text (document_text, page);
+		retval |= *text != NULL;
+	}
+	if (areas) {
+		*areas = NULL;
+		*n_areas = 0;
+		retval |= ev_document_text_get_text_layout (document_text, page, areas, n_areas);
+	}
+	if (text_attrs) {
+		*text_attrs = ev_document_text_get_text_attrs (document_text, page);
+		retval |= *text_attrs != NULL;
+	}
+
+	return retval;
+}
@@ -82,6 +82,12 @@ static gboolean        _ev_document_support_synctex (EvDocument *document);
 static GMutex ev_doc_mutex;
 static GMutex ev_fc_mutex;
 
+/* Doc mutex contention, see ev_document_doc_mutex_get_stats() */
+static volatile gint ev_doc_mutex_n_locks = 0;
+static volatile gint ev_doc_mutex_n_contended = 0;
+static gint64 ev_doc_mutex_wait_time = 0;
+G_LOCK_DEFINE_STATIC (ev_doc_mutex_stats);
+
 G_DEFINE_ABSTRACT_TYPE (EvDocument, ev_document, G_TYPE_OBJECT)
 
 GQuark
@@ -249,7 +255,19 @@ ev_document_set_modified (EvDocument *document,
 void
 ev_document_doc_mutex_lock (void)
 {
+	gint64 start;
+
+	g_atomic_int_inc (&ev_doc_mutex_n_locks);
+	if (g_mutex_trylock (&ev_doc_mutex))
+		return;
+
+	start = g_get_monotonic_time ();
 	g_mutex_lock (&ev_doc_mutex);
+
+	G_LOCK (ev_doc_mutex_stats);
+	ev_doc_mutex_wait_time += g_get_monotonic_time () - start;
+	G_UNLOCK (ev_doc_mutex_stats);
+	g_atomic_int_inc (&ev_doc_mutex_n_contended);
 }
 
 void
@@ -264,6 +282,35 @@ ev_document_doc_mutex_trylock (void)
 	return g_mutex_trylock (&ev_doc_mutex);
 }
 
+/**
+ * ev_document_doc_mutex_get_stats:
+ * @n_locks: (out) (allow-none): return location for the number of locks
+ * @n_contended: (out) (allow-none): return location for the number of
+ *   locks that had to wait for another thread
+ * @wait_time: (out) (allow-none): return location for the total time
+ *   spent waiting, in microseconds
+ *
+ * Gets how contended the document mutex has been since the program
+ * started. Only locks taken with ev_document_doc_mutex_lock() are counted.
+ *
+ * Since: 3.32
+ */
+void
+ev_document_doc_mutex_get_stats (guint  *n_locks,
+				 guint  *n_contended,
+				 gint64 *wait_time)
+{
+	if (n_locks)
+		*n_locks = g_atomic_int_get (&ev_doc_mutex_n_locks);
+	if (n_contended)
+		*n_contended = g_atomic_int_get (&ev_doc_mutex_n_contended);
+	if (wait_time) {
+		G_LOCK (ev_doc_mutex_stats);
+		*wait_time = ev_doc_mutex_wait_time;
+		G_UNLOCK (ev_doc_mutex_stats);
+	}
+}
+
 void
 ev_document_fc_mutex_lock (void)
 {
@@ -142,6 +142,9 @@ GMutex          *ev_document_get_doc_mutex        (void);
 void             ev_document_doc_mutex_lock       (void);
 void             ev_document_doc_mutex_unlock     (void);
 gboolean         ev_document_doc_mutex_trylock    (void);
+void             ev_document_doc_mutex_get_stats  (guint            *n_locks,
+						   guint            *n_contended,
+						   gint64           *wait_time);
 
 /* FontConfig mutex */
 GMutex          *ev_document_get_fc_mutex         (void);
@@ -0,0 +1,64 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; c-indent-level: 8 -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#if !defined (EVINCE_COMPILATION)
+#error "This is a private header."
+#endif
+
+#ifndef EV_PIXEL_CONVERT_PRIVATE_H
+#define EV_PIXEL_CONVERT_PRIVATE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void ev_pixel_convert_abgr_to_argb   (const guint32 *src,
+				      guint32       *dest,
+				      gsize          n_pixels);
+void ev_pixel_convert_rgba_to_argb32 (const guchar  *src,
+				      guint32       *dest,
+				      gsize          n_pixels);
+void ev_pixel_convert_rgb_to_rgb24   (const guchar  *src,
+				      guint32       *dest,
+				      gsize          n_pixels);
+void ev_pixel_convert_gray_to_rgb24  (const guchar  *src,
+				      guint32       *dest,
+				      gsize          n_pixels);
+
+typedef struct {
+	const gchar *name;
+
+	void (* abgr_to_argb)   (const guint32 *src,
+				 guint32       *dest,
+				 gsize          n_pixels);
+	void (* rgba_to_argb32) (const guchar  *src,
+				 guint32       *dest,
+				 gsize          n_pixels);
+	void (* rgb_to_rgb24)   (const guchar  *src,
+				 guint32       *dest,
+				 gsize          n_pixels);
+	void (* gray_to_rgb24)  (const guchar  *src,
+				 guint32       *dest,
+				 gsize          n_pixels);
+} EvPixelConvertFuncs;
+
+/* NULL terminated, the scalar implementation first */
+const EvPixelConvertFuncs **_ev_pixel_convert_get_supported (void);
+
+G_END_DECLS
+
+#endif /* EV_PIXEL_CONVERT_PRIVATE_H */
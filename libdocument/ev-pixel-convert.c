@@ -0,0 +1,529 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; c-indent-level: 8 -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "ev-pixel-convert-private.h"
+
+/* Pixel format conversions used by the raster backends. Destinations
+ * are always in cairo's native endian ARGB32/RGB24 layout. Every
+ * conversion has a plain C version, and SIMD versions for x86 and
+ * ARM that are chosen at runtime depending on what the CPU supports.
+ * Setting EV_PIXEL_CONVERT to the name of an implementation forces
+ * its use, which is useful for debugging.
+ */
+
+#if defined (__GNUC__) && defined (__SSE2__) && (defined (__x86_64__) || defined (__i386__))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#if defined (__ARM_NEON) && G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* Same rounding as cairo and gdk-pixbuf use */
+#define PREMULTIPLY(d,c,a,t) G_STMT_START { t = (c) * (a) + 0x80; d = ((t >> 8) + t) >> 8; } G_STMT_END
+
+static void
+abgr_to_argb_c (const guint32 *src,
+		guint32       *dest,
+		gsize          n_pixels)
+{
+	gsize i;
+
+	for (i = 0; i < n_pixels; i++) {
+		guint32 p = src[i];
+
+		dest[i] = (p & 0xff00ff00) | ((p & 0xff) << 16) | ((p >> 16) & 0xff);
+	}
+}
+
+static void
+rgba_to_argb32_c (const guchar *src,
+		  guint32      *dest,
+		  gsize         n_pixels)
+{
+	gsize i;
+
+	for (i = 0; i < n_pixels; i++, src += 4) {
+		guint a = src[3];
+		guint r, g, b, t;
+
+		PREMULTIPLY (r, src[0], a, t);
+		PREMULTIPLY (g, src[1], a, t);
+		PREMULTIPLY (b, src[2], a, t);
+
+		dest[i] = (a << 24) | (r << 16) | (g << 8) | b;
+	}
+}
+
+static void
+rgb_to_rgb24_c (const guchar *src,
+		guint32      *dest,
+		gsize         n_pixels)
+{
+	gsize i;
+
+	for (i = 0; i < n_pixels; i++, src += 3)
+		dest[i] = 0xff000000 | (src[0] << 16) | (src[1] << 8) | src[2];
+}
+
+static void
+gray_to_rgb24_c (const guchar *src,
+		 guint32      *dest,
+		 gsize         n_pixels)
+{
+	gsize i;
+
+	for (i = 0; i < n_pixels; i++)
+		dest[i] = 0xff000000 | (src[i] * 0x010101);
+}
+
+static const EvPixelConvertFuncs scalar_funcs = {
+	"scalar",
+	abgr_to_argb_c,
+	rgba_to_argb32_c,
+	rgb_to_rgb24_c,
+	gray_to_rgb24_c
+};
+
+#ifdef HAVE_X86_SIMD
+/* Swaps the first and third byte of every 32 bit pixel */
+static inline __m128i
+swap_rb_sse2 (__m128i v)
+{
+	__m128i ag = _mm_and_si128 (v, _mm_set1_epi32 ((gint) 0xff00ff00));
+	__m128i rb = _mm_and_si128 (v, _mm_set1_epi32 (0x00ff00ff));
+
+	return _mm_or_si128 (ag, _mm_or_si128 (_mm_slli_epi32 (rb, 16),
+					       _mm_srli_epi32 (rb, 16)));
+}
+
+/* Premultiplies 16 bit channels by the alpha of their pixel */
+static inline __m128i
+premultiply_sse2 (__m128i c)
+{
+	__m128i a, t;
+
+	a = _mm_shufflelo_epi16 (c, _MM_SHUFFLE (3, 3, 3, 3));
+	a = _mm_shufflehi_epi16 (a, _MM_SHUFFLE (3, 3, 3, 3));
+	t = _mm_add_epi16 (_mm_mullo_epi16 (c, a), _mm_set1_epi16 (0x80));
+
+	return _mm_srli_epi16 (_mm_add_epi16 (t, _mm_srli_epi16 (t, 8)), 8);
+}
+
+static void
+abgr_to_argb_sse2 (const guint32 *src,
+		   guint32       *dest,
+		   gsize          n_pixels)
+{
+	gsize i;
+
+	for (i = 0; i + 4 <= n_pixels; i += 4) {
+		__m128i v = _mm_loadu_si128 ((const __m128i *)(src + i));
+
+		_mm_storeu_si128 ((__m128i *)(dest + i), swap_rb_sse2 (v));
+	}
+
+	abgr_to_argb_c (src + i, dest + i, n_pixels - i);
+}
+
+static void
+rgba_to_argb32_sse2 (const guchar *src,
+		     guint32      *dest,
+		     gsize         n_pixels)
+{
+	const __m128i zero = _mm_setzero_si128 ();
+	const __m128i alpha = _mm_set1_epi32 ((gint) 0xff000000);
+	gsize         i;
+
+	for (i = 0; i + 4 <= n_pixels; i += 4) {
+		__m128i v = _mm_loadu_si128 ((const __m128i *)(src + i * 4));
+		__m128i lo, hi, p;
+
+		lo = premultiply_sse2 (_mm_unpacklo_epi8 (v, zero));
+		hi = premultiply_sse2 (_mm_unpackhi_epi8 (v, zero));
+		p = _mm_packus_epi16 (lo, hi);
+		p = _mm_or_si128 (_mm_andnot_si128 (alpha, p), _mm_and_si128 (alpha, v));
+
+		_mm_storeu_si128 ((__m128i *)(dest + i), swap_rb_sse2 (p));
+	}
+
+	rgba_to_argb32_c (src + i * 4, dest + i, n_pixels - i);
+}
+
+static void
+gray_to_rgb24_sse2 (const guchar *src,
+		    guint32      *dest,
+		    gsize         n_pixels)
+{
+	const __m128i alpha = _mm_set1_epi32 ((gint) 0xff000000);
+	gsize         i;
+
+	for (i = 0; i + 16 <= n_pixels; i += 16) {
+		__m128i g = _mm_loadu_si128 ((const __m128i *)(src + i));
+		__m128i lo = _mm_unpacklo_epi8 (g, g);
+		__m128i hi = _mm_unpackhi_epi8 (g, g);
+
+		_mm_storeu_si128 ((__m128i *)(dest + i),
+				  _mm_or_si128 (_mm_unpacklo_epi16 (lo, lo), alpha));
+		_mm_storeu_si128 ((__m128i *)(dest + i + 4),
+				  _mm_or_si128 (_mm_unpackhi_epi16 (lo, lo), alpha));
+		_mm_storeu_si128 ((__m128i *)(dest + i + 8),
+				  _mm_or_si128 (_mm_unpacklo_epi16 (hi, hi), alpha));
+		_mm_storeu_si128 ((__m128i *)(dest + i + 12),
+				  _mm_or_si128 (_mm_unpackhi_epi16 (hi, hi), alpha));
+	}
+
+	gray_to_rgb24_c (src + i, dest + i, n_pixels - i);
+}
+
+__attribute__((target ("ssse3")))
+static void
+rgb_to_rgb24_ssse3 (const guchar *src,
+		    guint32      *dest,
+		    gsize         n_pixels)
+{
+	const __m128i alpha = _mm_set1_epi32 ((gint) 0xff000000);
+	const __m128i mask = _mm_setr_epi8 (2, 1, 0, -1, 5, 4, 3, -1,
+					    8, 7, 6, -1, 11, 10, 9, -1);
+	gsize         i;
+
+	/* Every load reads 16 bytes but only consumes 12 */
+	for (i = 0; i + 6 <= n_pixels; i += 4) {
+		__m128i v = _mm_loadu_si128 ((const __m128i *)(src + i * 3));
+
+		_mm_storeu_si128 ((__m128i *)(dest + i),
+				  _mm_or_si128 (_mm_shuffle_epi8 (v, mask), alpha));
+	}
+
+	rgb_to_rgb24_c (src + i * 3, dest + i, n_pixels - i);
+}
+
+__attribute__((target ("avx2")))
+static void
+abgr_to_argb_avx2 (const guint32 *src,
+		   guint32       *dest,
+		   gsize          n_pixels)
+{
+	const __m256i ag_mask = _mm256_set1_epi32 ((gint) 0xff00ff00);
+	const __m256i rb_mask = _mm256_set1_epi32 (0x00ff00ff);
+	gsize         i;
+
+	for (i = 0; i + 8 <= n_pixels; i += 8) {
+		__m256i v = _mm256_loadu_si256 ((const __m256i *)(src + i));
+		__m256i rb = _mm256_and_si256 (v, rb_mask);
+
+		v = _mm256_or_si256 (_mm256_and_si256 (v, ag_mask),
+				     _mm256_or_si256 (_mm256_slli_epi32 (rb, 16),
+						      _mm256_srli_epi32 (rb, 16)));
+		_mm256_storeu_si256 ((__m256i *)(dest + i), v);
+	}
+
+	abgr_to_argb_c (src + i, dest + i, n_pixels - i);
+}
+
+__attribute__((target ("avx2")))
+static void
+rgba_to_argb32_avx2 (const guchar *src,
+		     guint32      *dest,
+		     gsize         n_pixels)
+{
+	const __m256i zero = _mm256_setzero_si256 ();
+	const __m256i half = _mm256_set1_epi16 (0x80);
+	const __m256i alpha = _mm256_set1_epi32 ((gint) 0xff000000);
+	const __m256i ag_mask = _mm256_set1_epi32 ((gint) 0xff00ff00);
+	const __m256i rb_mask = _mm256_set1_epi32 (0x00ff00ff);
+	gsize         i;
+
+	for (i = 0; i + 8 <= n_pixels; i += 8) {
+		__m256i v = _mm256_loadu_si256 ((const __m256i *)(src + i * 4));
+		__m256i c[2];
+		__m256i p, rb;
+		gint    j;
+
+		/* Unpacking and packing work within 128 bit lanes,
+		 * so the pixel order is preserved.
+		 */
+		c[0] = _mm256_unpacklo_epi8 (v, zero);
+		c[1] = _mm256_unpackhi_epi8 (v, zero);
+		for (j = 0; j < 2; j++) {
+			__m256i a, t;
+
+			a = _mm256_shufflelo_epi16 (c[j], _MM_SHUFFLE (3, 3, 3, 3));
+			a = _mm256_shufflehi_epi16 (a, _MM_SHUFFLE (3, 3, 3, 3));
+			t = _mm256_add_epi16 (_mm256_mullo_epi16 (c[j], a), half);
+			c[j] = _mm256_srli_epi16 (_mm256_add_epi16 (t, _mm256_srli_epi16 (t, 8)), 8);
+		}
+		p = _mm256_packus_epi16 (c[0], c[1]);
+		p = _mm256_or_si256 (_mm256_andnot_si256 (alpha, p), _mm256_and_si256 (alpha, v));
+
+		rb = _mm256_and_si256 (p, rb_mask);
+		p = _mm256_or_si256 (_mm256_and_si256 (p, ag_mask),
+				     _mm256_or_si256 (_mm256_slli_epi32 (rb, 16),
+						      _mm256_srli_epi32 (rb, 16)));
+		_mm256_storeu_si256 ((__m256i *)(dest + i), p);
+	}
+
+	rgba_to_argb32_c (src + i * 4, dest + i, n_pixels - i);
+}
+
+static const EvPixelConvertFuncs sse2_funcs = {
+	"sse2",
+	abgr_to_argb_sse2,
+	rgba_to_argb32_sse2,
+	rgb_to_rgb24_c,
+	gray_to_rgb24_sse2
+};
+
+static const EvPixelConvertFuncs ssse3_funcs = {
+	"ssse3",
+	abgr_to_argb_sse2,
+	rgba_to_argb32_sse2,
+	rgb_to_rgb24_ssse3,
+	gray_to_rgb24_sse2
+};
+
+static const EvPixelConvertFuncs avx2_funcs = {
+	"avx2",
+	abgr_to_argb_avx2,
+	rgba_to_argb32_avx2,
+	rgb_to_rgb24_ssse3,
+	gray_to_rgb24_sse2
+};
+#endif /* HAVE_X86_SIMD */
+
+#ifdef HAVE_NEON
+static inline uint8x16_t
+premultiply_neon (uint8x16_t c,
+		  uint8x16_t a)
+{
+	uint16x8_t lo = vmull_u8 (vget_low_u8 (c), vget_low_u8 (a));
+	uint16x8_t hi = vmull_u8 (vget_high_u8 (c), vget_high_u8 (a));
+
+	lo = vaddq_u16 (lo, vdupq_n_u16 (0x80));
+	hi = vaddq_u16 (hi, vdupq_n_u16 (0x80));
+
+	return vcombine_u8 (vshrn_n_u16 (vaddq_u16 (lo, vshrq_n_u16 (lo, 8)), 8),
+			    vshrn_n_u16 (vaddq_u16 (hi, vshrq_n_u16 (hi, 8)), 8));
+}
+
+static void
+abgr_to_argb_neon (const guint32 *src,
+		   guint32       *dest,
+		   gsize          n_pixels)
+{
+	gsize i;
+
+	for (i = 0; i + 16 <= n_pixels; i += 16) {
+		uint8x16x4_t p = vld4q_u8 ((const guint8 *)(src + i));
+		uint8x16_t   r = p.val[0];
+
+		p.val[0] = p.val[2];
+		p.val[2] = r;
+		vst4q_u8 ((guint8 *)(dest + i), p);
+	}
+
+	abgr_to_argb_c (src + i, dest + i, n_pixels - i);
+}
+
+static void
+rgba_to_argb32_neon (const guchar *src,
+		     guint32      *dest,
+		     gsize         n_pixels)
+{
+	gsize i;
+
+	for (i = 0; i + 16 <= n_pixels; i += 16) {
+		uint8x16x4_t p = vld4q_u8 (src + i * 4);
+		uint8x16x4_t q;
+
+		q.val[0] = premultiply_neon (p.val[2], p.val[3]);
+		q.val[1] = premultiply_neon (p.val[1], p.val[3]);
+		q.val[2] = premultiply_neon (p.val[0], p.val[3]);
+		q.val[3] = p.val[3];
+		vst4q_u8 ((guint8 *)(dest + i), q);
+	}
+
+	rgba_to_argb32_c (src + i * 4, dest + i, n_pixels - i);
+}
+
+static void
+rgb_to_rgb24_neon (const guchar *src,
+		   guint32      *dest,
+		   gsize         n_pixels)
+{
+	gsize i;
+
+	for (i = 0; i + 16 <= n_pixels; i += 16) {
+		uint8x16x3_t p = vld3q_u8 (src + i * 3);
+		uint8x16x4_t q;
+
+		q.val[0] = p.val[2];
+		q.val[1] = p.val[1];
+		q.val[2] = p.val[0];
+		q.val[3] = vdupq_n_u8 (0xff);
+		vst4q_u8 ((guint8 *)(dest + i), q);
+	}
+
+	rgb_to_rgb24_c (src + i * 3, dest + i, n_pixels - i);
+}
+
+static void
+gray_to_rgb24_neon (const guchar *src,
+		    guint32      *dest,
+		    gsize         n_pixels)
+{
+	gsize i;
+
+	for (i = 0; i + 16 <= n_pixels; i += 16) {
+		uint8x16x4_t q;
+
+		q.val[0] = q.val[1] = q.val[2] = vld1q_u8 (src + i);
+		q.val[3] = vdupq_n_u8 (0xff);
+		vst4q_u8 ((guint8 *)(dest + i), q);
+	}
+
+	gray_to_rgb24_c (src + i, dest + i, n_pixels - i);
+}
+
+static const EvPixelConvertFuncs neon_funcs = {
+	"neon",
+	abgr_to_argb_neon,
+	rgba_to_argb32_neon,
+	rgb_to_rgb24_neon,
+	gray_to_rgb24_neon
+};
+#endif /* HAVE_NEON */
+
+const EvPixelConvertFuncs **
+_ev_pixel_convert_get_supported (void)
+{
+	static const EvPixelConvertFuncs *supported[5];
+	static gsize                      initialized = 0;
+
+	if (g_once_init_enter (&initialized)) {
+		guint n = 0;
+
+		supported[n++] = &scalar_funcs;
+#ifdef HAVE_X86_SIMD
+		__builtin_cpu_init ();
+		supported[n++] = &sse2_funcs;
+		if (__builtin_cpu_supports ("ssse3"))
+			supported[n++] = &ssse3_funcs;
+		if (__builtin_cpu_supports ("avx2"))
+			supported[n++] = &avx2_funcs;
+#endif
+#ifdef HAVE_NEON
+		supported[n++] = &neon_funcs;
+#endif
+		supported[n] = NULL;
+
+		g_once_init_leave (&initialized, 1);
+	}
+
+	return supported;
+}
+
+static const EvPixelConvertFuncs *
+get_funcs (void)
+{
+	static const EvPixelConvertFuncs *funcs = NULL;
+
+	if (g_once_init_enter (&funcs)) {
+		const EvPixelConvertFuncs **supported;
+		const EvPixelConvertFuncs  *best = NULL;
+		const gchar                *name;
+		guint                       i;
+
+		/* Implementations are sorted from slowest to fastest */
+		supported = _ev_pixel_convert_get_supported ();
+		name = g_getenv ("EV_PIXEL_CONVERT");
+		for (i = 0; supported[i]; i++) {
+			best = supported[i];
+			if (name && strcmp (name, best->name) == 0)
+				break;
+		}
+
+		g_once_init_leave (&funcs, best);
+	}
+
+	return funcs;
+}
+
+/**
+ * ev_pixel_convert_abgr_to_argb:
+ * @src: pixels in 0xAABBGGRR format, as returned by libtiff
+ * @dest: return location for pixels in cairo's format
+ * @n_pixels: number of pixels to convert
+ *
+ * Swaps the red and blue channels of @n_pixels pixels. @src and @dest
+ * may be the same buffer.
+ */
+void
+ev_pixel_convert_abgr_to_argb (const guint32 *src,
+			       guint32       *dest,
+			       gsize          n_pixels)
+{
+	get_funcs ()->abgr_to_argb (src, dest, n_pixels);
+}
+
+/**
+ * ev_pixel_convert_rgba_to_argb32:
+ * @src: non-premultiplied RGBA pixels, as in a #GdkPixbuf with alpha
+ * @dest: return location for %CAIRO_FORMAT_ARGB32 pixels
+ * @n_pixels: number of pixels to convert
+ */
+void
+ev_pixel_convert_rgba_to_argb32 (const guchar *src,
+				 guint32      *dest,
+				 gsize         n_pixels)
+{
+	get_funcs ()->rgba_to_argb32 (src, dest, n_pixels);
+}
+
+/**
+ * ev_pixel_convert_rgb_to_rgb24:
+ * @src: packed RGB pixels, as in a #GdkPixbuf without alpha
+ * @dest: return location for %CAIRO_FORMAT_RGB24 pixels
+ * @n_pixels: number of pixels to convert
+ */
+void
+ev_pixel_convert_rgb_to_rgb24 (const guchar *src,
+			       guint32      *dest,
+			       gsize         n_pixels)
+{
+	get_funcs ()->rgb_to_rgb24 (src, dest, n_pixels);
+}
+
+/**
+ * ev_pixel_convert_gray_to_rgb24:
+ * @src: 8 bit grey pixels
+ * @dest: return location for %CAIRO_FORMAT_RGB24 pixels
+ * @n_pixels: number of pixels to convert
+ */
+void
+ev_pixel_convert_gray_to_rgb24 (const guchar *src,
+				guint32      *dest,
+				gsize         n_pixels)
+{
+	get_funcs ()->gray_to_rgb24 (src, dest, n_pixels);
+}
@@ -41,6 +41,11 @@ ev_render_context_dispose (GObject *object)
 		rc->page = NULL;
 	}
 
+	if (rc->cancellable) {
+		g_object_unref (rc->cancellable);
+		rc->cancellable = NULL;
+	}
+
 	(* G_OBJECT_CLASS (ev_render_context_parent_class)->dispose) (object);
 }
 
@@ -113,6 +118,50 @@ ev_render_context_set_target_size (EvRenderContext *rc,
 	rc->target_height = target_height;
 }
 
+/**
+ * ev_render_context_set_cancellable:
+ * @rc: an #EvRenderContext
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ *
+ * Sets a #GCancellable that backends check while rendering with @rc,
+ * see ev_render_context_is_cancelled().
+ *
+ * Since: 3.32
+ */
+void
+ev_render_context_set_cancellable (EvRenderContext *rc,
+				   GCancellable    *cancellable)
+{
+	g_return_if_fail (rc != NULL);
+
+	if (cancellable)
+		g_object_ref (cancellable);
+	if (rc->cancellable)
+		g_object_unref (rc->cancellable);
+	rc->cancellable = cancellable;
+}
+
+/**
+ * ev_render_context_is_cancelled:
+ * @rc: an #EvRenderContext
+ *
+ * Backends rendering in steps, like rows or bands, call this between
+ * them, and return %NULL as soon as it returns %TRUE, so that a
+ * cancelled render stops early. It's cheap enough to be called for
+ * every row.
+ *
+ * Returns: %TRUE if the render using @rc has been cancelled
+ *
+ * Since: 3.32
+ */
+gboolean
+ev_render_context_is_cancelled (EvRenderContext *rc)
+{
+	g_return_val_if_fail (rc != NULL, FALSE);
+
+	return rc->cancellable && g_cancellable_is_cancelled (rc->cancellable);
+}
+
 void
 ev_render_context_compute_scaled_size (EvRenderContext *rc,
 				       double		width_points,
@@ -25,6 +25,7 @@
 #define EV_RENDER_CONTEXT_H
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 #include "ev-page.h"
 
@@ -52,6 +53,8 @@ struct _EvRenderContext
 	gdouble scale;
 	gint	target_width;
 	gint	target_height;
+
+	GCancellable *cancellable;
 };
 
 
@@ -68,6 +71,9 @@ void             ev_render_context_set_scale       (EvRenderContext *rc,
 void             ev_render_context_set_target_size (EvRenderContext *rc,
                                                     int              target_width,
                                                     int              target_height);
+void             ev_render_context_set_cancellable (EvRenderContext *rc,
+						    GCancellable    *cancellable);
+gboolean         ev_render_context_is_cancelled    (EvRenderContext *rc);
 void             ev_render_context_compute_scaled_size      (EvRenderContext *rc,
                                                              double           width_points,
                                                              double           height_points,
@@ -0,0 +1,145 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; c-indent-level: 8 -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Checks every pixel conversion implementation supported by the CPU
+ * against the scalar one, and measures their throughput.
+ *
+ * Usage: test-ev-pixel-convert [N_MEGAPIXELS]
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ev-pixel-convert-private.h"
+
+#define N_ITERATIONS 10
+
+typedef enum {
+	ABGR_TO_ARGB,
+	RGBA_TO_ARGB32,
+	RGB_TO_RGB24,
+	GRAY_TO_RGB24,
+	N_CONVERSIONS
+} Conversion;
+
+static const gchar *conversion_names[N_CONVERSIONS] = {
+	"abgr_to_argb",
+	"rgba_to_argb32",
+	"rgb_to_rgb24",
+	"gray_to_rgb24"
+};
+
+static void
+run (const EvPixelConvertFuncs *funcs,
+     Conversion                 conversion,
+     const guchar              *src,
+     guint32                   *dest,
+     gsize                      n_pixels)
+{
+	switch (conversion) {
+	case ABGR_TO_ARGB:
+		funcs->abgr_to_argb ((const guint32 *)src, dest, n_pixels);
+		break;
+	case RGBA_TO_ARGB32:
+		funcs->rgba_to_argb32 (src, dest, n_pixels);
+		break;
+	case RGB_TO_RGB24:
+		funcs->rgb_to_rgb24 (src, dest, n_pixels);
+		break;
+	case GRAY_TO_RGB24:
+		funcs->gray_to_rgb24 (src, dest, n_pixels);
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+}
+
+/* Odd sizes and offsets exercise the scalar tails */
+static gboolean
+check (const EvPixelConvertFuncs *funcs,
+       const EvPixelConvertFuncs *reference,
+       Conversion                 conversion,
+       const guchar              *src)
+{
+	guint32 expected[1031];
+	guint32 result[1031];
+	gsize   n_pixels;
+
+	for (n_pixels = 0; n_pixels < G_N_ELEMENTS (expected); n_pixels += 103) {
+		run (reference, conversion, src + 4, expected, n_pixels);
+		run (funcs, conversion, src + 4, result, n_pixels);
+		if (memcmp (expected, result, n_pixels * sizeof (guint32)) != 0)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+gint
+main (gint argc, gchar **argv)
+{
+	const EvPixelConvertFuncs **supported;
+	guchar                     *src;
+	guint32                    *dest;
+	gsize                       n_pixels;
+	gint                        i, j, k;
+	gint                        retval = EXIT_SUCCESS;
+
+	n_pixels = (argc > 1 ? atoi (argv[1]) : 16) * 1024 * 1024;
+	n_pixels = MAX (n_pixels, 2048);
+
+	src = g_malloc (n_pixels * 4 + 4);
+	dest = g_malloc (n_pixels * 4);
+	for (i = 0; i < (gint) (n_pixels * 4 + 4); i++)
+		src[i] = g_random_int_range (0, 256);
+
+	supported = _ev_pixel_convert_get_supported ();
+	for (i = 0; supported[i]; i++) {
+		for (j = 0; j < N_CONVERSIONS; j++) {
+			GTimer  *timer;
+			gdouble  elapsed;
+
+			if (!check (supported[i], supported[0], j, src)) {
+				g_printerr ("%s: %s differs from %s\n",
+					    supported[i]->name, conversion_names[j],
+					    supported[0]->name);
+				retval = EXIT_FAILURE;
+				continue;
+			}
+
+			/* Fault the destination in first */
+			run (supported[i], j, src, dest, n_pixels);
+
+			timer = g_timer_new ();
+			for (k = 0; k < N_ITERATIONS; k++)
+				run (supported[i], j, src, dest, n_pixels);
+			elapsed = g_timer_elapsed (timer, NULL);
+			g_timer_destroy (timer);
+
+			g_print ("%-8s %-16s %8.1f Mpixels/s\n",
+				 supported[i]->name, conversion_names[j],
+				 n_pixels * N_ITERATIONS / elapsed / 1e6);
+		}
+	}
+
+	g_free (src);
+	g_free (dest);
+
+	return retval;
+}
@@ -0,0 +1,607 @@
+/* ev-document-async.c
+ *  this file is part of evince, a gnome document viewer
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:ev-document-async
+ * @short_description: Asynchronous document operations
+ *
+ * These functions run the usual document operations as jobs of the
+ * #EvJob scheduler, with its priorities, and report their result in
+ * the GIO asynchronous style, so that callers don't need to handle
+ * the jobs and their signals themselves. They must be called from
+ * the main thread.
+ *
+ * Operations on the same document don't need to wait for each other:
+ * requesting the page data and the rendering of a page at once queues
+ * both jobs right away, and they run back to back in the scheduler
+ * thread, without going through the main loop in between.
+ *
+ * Cancelling the #GCancellable of an operation cancels its job, and
+ * backends rendering in steps stop early.
+ */
+
+#include <config.h>
+
+#include <glib/gi18n-lib.h>
+
+#include "ev-debug.h"
+#include "ev-document-async.h"
+
+typedef struct {
+	EvJob  *job;
+	gulong  cancelled_id;
+} EvAsyncJob;
+
+/* EvPageData */
+G_DEFINE_BOXED_TYPE (EvPageData, ev_page_data, ev_page_data_copy, ev_page_data_free)
+
+/**
+ * ev_page_data_copy:
+ * @page_data: an #EvPageData
+ *
+ * Returns: (transfer full): a copy of @page_data
+ *
+ * Since: 3.32
+ */
+EvPageData *
+ev_page_data_copy (EvPageData *page_data)
+{
+	EvPageData *copy;
+
+	g_return_val_if_fail (page_data != NULL, NULL);
+
+	copy = g_slice_dup (EvPageData, page_data);
+	if (copy->link_mapping)
+		ev_mapping_list_ref (copy->link_mapping);
+	if (copy->image_mapping)
+		ev_mapping_list_ref (copy->image_mapping);
+	if (copy->form_field_mapping)
+		ev_mapping_list_ref (copy->form_field_mapping);
+	if (copy->annot_mapping)
+		ev_mapping_list_ref (copy->annot_mapping);
+	if (copy->media_mapping)
+		ev_mapping_list_ref (copy->media_mapping);
+	if (copy->text_mapping)
+		cairo_region_reference (copy->text_mapping);
+	copy->text = g_strdup (page_data->text);
+	copy->text_layout = g_memdup (page_data->text_layout,
+				      page_data->text_layout_length * sizeof (EvRectangle));
+	if (copy->text_attrs)
+		pango_attr_list_ref (copy->text_attrs);
+	copy->text_log_attrs = g_memdup (page_data->text_log_attrs,
+					 page_data->text_log_attrs_length * sizeof (PangoLogAttr));
+
+	return copy;
+}
+
+/**
+ * ev_page_data_free:
+ * @page_data: an #EvPageData
+ *
+ * Frees @page_data and the data it holds.
+ *
+ * Since: 3.32
+ */
+void
+ev_page_data_free (EvPageData *page_data)
+{
+	if (!page_data)
+		return;
+
+	g_clear_pointer (&page_data->link_mapping, ev_mapping_list_unref);
+	g_clear_pointer (&page_data->image_mapping, ev_mapping_list_unref);
+	g_clear_pointer (&page_data->form_field_mapping, ev_mapping_list_unref);
+	g_clear_pointer (&page_data->annot_mapping, ev_mapping_list_unref);
+	g_clear_pointer (&page_data->media_mapping, ev_mapping_list_unref);
+	g_clear_pointer (&page_data->text_mapping, cairo_region_destroy);
+	g_free (page_data->text);
+	g_free (page_data->text_layout);
+	g_clear_pointer (&page_data->text_attrs, pango_attr_list_unref);
+	g_free (page_data->text_log_attrs);
+	g_slice_free (EvPageData, page_data);
+}
+
+static void
+ev_async_job_free (EvAsyncJob *async_job)
+{
+	g_object_unref (async_job->job);
+	g_slice_free (EvAsyncJob, async_job);
+}
+
+static gboolean
+ev_async_job_cancel_idle (EvJob *job)
+{
+	ev_job_cancel (job);
+
+	return FALSE;
+}
+
+/* ev_job_cancel() can only be called from the main thread, where the
+ * jobs emit their signals, and a cancellable can't be disconnected
+ * from its own handler, so the job is cancelled from an idle. Its
+ * cancellable is cancelled right away so that a running job stops as
+ * soon as possible.
+ */
+static void
+ev_async_job_cancellable_cancelled_cb (GCancellable *cancellable,
+				       EvJob        *job)
+{
+	GSource *source;
+
+	g_cancellable_cancel (job->cancellable);
+
+	source = g_idle_source_new ();
+	g_source_set_callback (source, (GSourceFunc) ev_async_job_cancel_idle,
+			       g_object_ref (job), g_object_unref);
+	g_source_attach (source, NULL);
+	g_source_unref (source);
+}
+
+/* Drops the ref on @task held while the job was running */
+static void
+ev_async_job_complete (GTask *task)
+{
+	EvAsyncJob *async_job = g_task_get_task_data (task);
+
+	g_signal_handlers_disconnect_by_data (async_job->job, task);
+	if (async_job->cancelled_id) {
+		g_cancellable_disconnect (g_task_get_cancellable (task),
+					  async_job->cancelled_id);
+		async_job->cancelled_id = 0;
+	}
+
+	g_object_unref (task);
+}
+
+/* The task returns the job itself, its result is taken from it by
+ * the finish function.
+ */
+static void
+ev_async_job_finished_cb (EvJob *job,
+			  GTask *task)
+{
+	if (ev_job_is_failed (job))
+		g_task_return_error (task, g_error_copy (job->error));
+	else
+		g_task_return_pointer (task, g_object_ref (job), g_object_unref);
+
+	ev_async_job_complete (task);
+}
+
+static void
+ev_async_job_cancelled_cb (EvJob *job,
+			   GTask *task)
+{
+	g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+				 "%s", _("Operation was cancelled"));
+
+	ev_async_job_complete (task);
+}
+
+/* Takes ownership of @job and of the ref on @task */
+static void
+ev_async_job_push (GTask        *task,
+		   EvJob        *job,
+		   EvJobPriority priority)
+{
+	EvAsyncJob   *async_job;
+	GCancellable *cancellable;
+
+	ev_debug_message (DEBUG_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+
+	async_job = g_slice_new0 (EvAsyncJob);
+	async_job->job = job;
+	g_task_set_task_data (task, async_job, (GDestroyNotify) ev_async_job_free);
+
+	g_signal_connect (job, "finished",
+			  G_CALLBACK (ev_async_job_finished_cb),
+			  task);
+	g_signal_connect (job, "cancelled",
+			  G_CALLBACK (ev_async_job_cancelled_cb),
+			  task);
+
+	cancellable = g_task_get_cancellable (task);
+	if (cancellable) {
+		async_job->cancelled_id =
+			g_cancellable_connect (cancellable,
+					       G_CALLBACK (ev_async_job_cancellable_cancelled_cb),
+					       g_object_ref (job),
+					       (GDestroyNotify) g_object_unref);
+	}
+
+	ev_job_scheduler_push_job (job, priority);
+}
+
+static EvJob *
+ev_async_job_propagate (GAsyncResult *result,
+			GError      **error)
+{
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/**
+ * ev_document_new_for_gfile_async:
+ * @file: a #GFile
+ * @flags: flags from #EvDocumentLoadFlags
+ * @priority: the priority of the job loading @file
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the document is loaded
+ * @user_data: the data to pass to @callback
+ *
+ * Asynchronously creates a document for @file and loads it, like
+ * ev_document_factory_get_document_for_gfile().
+ *
+ * Since: 3.32
+ */
+void
+ev_document_new_for_gfile_async (GFile               *file,
+				 EvDocumentLoadFlags  flags,
+				 EvJobPriority        priority,
+				 GCancellable        *cancellable,
+				 GAsyncReadyCallback  callback,
+				 gpointer             user_data)
+{
+	GTask *task;
+
+	g_return_if_fail (G_IS_FILE (file));
+
+	task = g_task_new (NULL, cancellable, callback, user_data);
+	g_task_set_source_tag (task, ev_document_new_for_gfile_async);
+
+	ev_async_job_push (task, ev_job_load_gfile_new (file, flags), priority);
+}
+
+/**
+ * ev_document_new_for_gfile_finish:
+ * @result: a #GAsyncResult
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Finishes an operation started with ev_document_new_for_gfile_async().
+ *
+ * Returns: (transfer full): the loaded #EvDocument, or %NULL with
+ *   @error set
+ *
+ * Since: 3.32
+ */
+EvDocument *
+ev_document_new_for_gfile_finish (GAsyncResult *result,
+				  GError      **error)
+{
+	EvJob      *job;
+	EvDocument *document;
+
+	g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+	g_return_val_if_fail (g_async_result_is_tagged (result, ev_document_new_for_gfile_async), NULL);
+
+	job = ev_async_job_propagate (result, error);
+	if (!job)
+		return NULL;
+
+	document = g_object_ref (job->document);
+	g_object_unref (job);
+
+	return document;
+}
+
+/**
+ * ev_document_render_async:
+ * @document: an #EvDocument
+ * @page: the index of the page to render
+ * @rotation: the rotation
+ * @scale: the scale
+ * @priority: the priority of the job rendering @page
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the page is rendered
+ * @user_data: the data to pass to @callback
+ *
+ * Asynchronously renders @page, like an #EvJobRender does.
+ *
+ * Since: 3.32
+ */
+void
+ev_document_render_async (EvDocument          *document,
+			  gint                 page,
+			  gint                 rotation,
+			  gdouble              scale,
+			  EvJobPriority        priority,
+			  GCancellable        *cancellable,
+			  GAsyncReadyCallback  callback,
+			  gpointer             user_data)
+{
+	GTask *task;
+
+	g_return_if_fail (EV_IS_DOCUMENT (document));
+
+	task = g_task_new (document, cancellable, callback, user_data);
+	g_task_set_source_tag (task, ev_document_render_async);
+
+	ev_async_job_push (task,
+			   ev_job_render_new (document, page, rotation, scale, -1, -1),
+			   priority);
+}
+
+/**
+ * ev_document_render_finish:
+ * @document: an #EvDocument
+ * @result: a #GAsyncResult
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Finishes an operation started with ev_document_render_async().
+ *
+ * Returns: (transfer full): the rendered page, or %NULL with @error set
+ *
+ * Since: 3.32
+ */
+cairo_surface_t *
+ev_document_render_finish (EvDocument   *document,
+			   GAsyncResult *result,
+			   GError      **error)
+{
+	EvJob           *job;
+	cairo_surface_t *surface;
+
+	g_return_val_if_fail (g_task_is_valid (result, document), NULL);
+	g_return_val_if_fail (g_async_result_is_tagged (result, ev_document_render_async), NULL);
+
+	job = ev_async_job_propagate (result, error);
+	if (!job)
+		return NULL;
+
+	surface = EV_JOB_RENDER (job)->surface;
+	EV_JOB_RENDER (job)->surface = NULL;
+	g_object_unref (job);
+
+	return surface;
+}
+
+/**
+ * ev_document_get_page_data_async:
+ * @document: an #EvDocument
+ * @page: the index of a page
+ * @flags: the data to get, from #EvJobPageDataFlags
+ * @priority: the priority of the job getting the data
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the data is ready
+ * @user_data: the data to pass to @callback
+ *
+ * Asynchronously gets the links, text, images, forms, annotations
+ * or media of @page, like an #EvJobPageData does.
+ *
+ * Since: 3.32
+ */
+void
+ev_document_get_page_data_async (EvDocument          *document,
+				 gint                 page,
+				 EvJobPageDataFlags   flags,
+				 EvJobPriority        priority,
+				 GCancellable        *cancellable,
+				 GAsyncReadyCallback  callback,
+				 gpointer             user_data)
+{
+	GTask *task;
+
+	g_return_if_fail (EV_IS_DOCUMENT (document));
+
+	task = g_task_new (document, cancellable, callback, user_data);
+	g_task_set_source_tag (task, ev_document_get_page_data_async);
+
+	ev_async_job_push (task, ev_job_page_data_new (document, page, flags), priority);
+}
+
+/**
+ * ev_document_get_page_data_finish:
+ * @document: an #EvDocument
+ * @result: a #GAsyncResult
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Finishes an operation started with ev_document_get_page_data_async().
+ *
+ * Returns: (transfer full): the data of the page, to free with
+ *   ev_page_data_free(), or %NULL with @error set
+ *
+ * Since: 3.32
+ */
+EvPageData *
+ev_document_get_page_data_finish (EvDocument   *document,
+				  GAsyncResult *result,
+				  GError      **error)
+{
+	EvJob         *job;
+	EvJobPageData *job_data;
+	EvPageData    *page_data;
+
+	g_return_val_if_fail (g_task_is_valid (result, document), NULL);
+	g_return_val_if_fail (g_async_result_is_tagged (result, ev_document_get_page_data_async), NULL);
+
+	job = ev_async_job_propagate (result, error);
+	if (!job)
+		return NULL;
+
+	/* The job gives up the data it holds */
+	job_data = EV_JOB_PAGE_DATA (job);
+	page_data = g_slice_new0 (EvPageData);
+	page_data->page = job_data->page;
+	page_data->link_mapping = job_data->link_mapping;
+	page_data->image_mapping = job_data->image_mapping;
+	page_data->form_field_mapping = job_data->form_field_mapping;
+	page_data->annot_mapping = job_data->annot_mapping;
+	page_data->media_mapping = job_data->media_mapping;
+	page_data->text_mapping = job_data->text_mapping;
+	page_data->text = job_data->text;
+	page_data->text_layout = job_data->text_layout;
+	page_data->text_layout_length = job_data->text_layout_length;
+	page_data->text_attrs = job_data->text_attrs;
+	page_data->text_log_attrs = job_data->text_log_attrs;
+	page_data->text_log_attrs_length = job_data->text_log_attrs_length;
+
+	job_data->link_mapping = NULL;
+	job_data->image_mapping = NULL;
+	job_data->form_field_mapping = NULL;
+	job_data->annot_mapping = NULL;
+	job_data->media_mapping = NULL;
+	job_data->text_mapping = NULL;
+	job_data->text = NULL;
+	job_data->text_layout = NULL;
+	job_data->text_attrs = NULL;
+	job_data->text_log_attrs = NULL;
+	g_object_unref (job);
+
+	return page_data;
+}
+
+/**
+ * ev_document_get_text_async:
+ * @document: an #EvDocument
+ * @page: the index of a page
+ * @priority: the priority of the job getting the text
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the text is ready
+ * @user_data: the data to pass to @callback
+ *
+ * Asynchronously gets the text of @page.
+ *
+ * Since: 3.32
+ */
+void
+ev_document_get_text_async (EvDocument          *document,
+			    gint                 page,
+			    EvJobPriority        priority,
+			    GCancellable        *cancellable,
+			    GAsyncReadyCallback  callback,
+			    gpointer             user_data)
+{
+	GTask *task;
+
+	g_return_if_fail (EV_IS_DOCUMENT (document));
+
+	task = g_task_new (document, cancellable, callback, user_data);
+	g_task_set_source_tag (task, ev_document_get_text_async);
+
+	ev_async_job_push (task,
+			   ev_job_page_data_new (document, page, EV_PAGE_DATA_INCLUDE_TEXT),
+			   priority);
+}
+
+/**
+ * ev_document_get_text_finish:
+ * @document: an #EvDocument
+ * @result: a #GAsyncResult
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Finishes an operation started with ev_document_get_text_async().
+ *
+ * Returns: (transfer full): the text of the page, %NULL if @document
+ *   has no text, or %NULL with @error set
+ *
+ * Since: 3.32
+ */
+gchar *
+ev_document_get_text_finish (EvDocument   *document,
+			     GAsyncResult *result,
+			     GError      **error)
+{
+	EvJob *job;
+	gchar *text;
+
+	g_return_val_if_fail (g_task_is_valid (result, document), NULL);
+	g_return_val_if_fail (g_async_result_is_tagged (result, ev_document_get_text_async), NULL);
+
+	job = ev_async_job_propagate (result, error);
+	if (!job)
+		return NULL;
+
+	text = EV_JOB_PAGE_DATA (job)->text;
+	EV_JOB_PAGE_DATA (job)->text = NULL;
+	g_object_unref (job);
+
+	return text;
+}
+
+/**
+ * ev_document_find_async:
+ * @document: an #EvDocument implementing #EvDocumentFind
+ * @text: the text to find
+ * @options: the #EvFindOptions
+ * @priority: the priority of the job finding @text
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when all pages have been searched
+ * @user_data: the data to pass to @callback
+ *
+ * Asynchronously finds @text in all the pages of @document.
+ *
+ * Since: 3.32
+ */
+void
+ev_document_find_async (EvDocument          *document,
+			const gchar         *text,
+			EvFindOptions        options,
+			EvJobPriority        priority,
+			GCancellable        *cancellable,
+			GAsyncReadyCallback  callback,
+			gpointer             user_data)
+{
+	GTask *task;
+	EvJob *job;
+
+	g_return_if_fail (EV_IS_DOCUMENT_FIND (document));
+	g_return_if_fail (text != NULL);
+
+	task = g_task_new (document, cancellable, callback, user_data);
+	g_task_set_source_tag (task, ev_document_find_async);
+
+	job = ev_job_find_new (document, 0, ev_document_get_n_pages (document), text,
+			       (options & EV_FIND_CASE_SENSITIVE) != 0);
+	ev_job_find_set_options (EV_JOB_FIND (job), options);
+	ev_async_job_push (task, job, priority);
+}
+
+/**
+ * ev_document_find_finish:
+ * @document: an #EvDocument
+ * @result: a #GAsyncResult
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Finishes an operation started with ev_document_find_async().
+ *
+ * Returns: (transfer full): an array with, for every page of
+ *   @document, a #GList of the #EvRectangle of the matches in it,
+ *   or %NULL with @error set
+ *
+ * Since: 3.32
+ */
+GList **
+ev_document_find_finish (EvDocument   *document,
+			 GAsyncResult *result,
+			 GError      **error)
+{
+	EvJob  *job;
+	GList **pages;
+
+	g_return_val_if_fail (g_task_is_valid (result, document), NULL);
+	g_return_val_if_fail (g_async_result_is_tagged (result, ev_document_find_async), NULL);
+
+	job = ev_async_job_propagate (result, error);
+	if (!job)
+		return NULL;
+
+	pages = EV_JOB_FIND (job)->pages;
+	EV_JOB_FIND (job)->pages = NULL;
+	g_object_unref (job);
+
+	return pages;
+}
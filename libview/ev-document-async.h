@@ -0,0 +1,136 @@
+/* ev-document-async.h
+ *  this file is part of evince, a gnome document viewer
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#if !defined (__EV_EVINCE_VIEW_H_INSIDE__) && !defined (EVINCE_COMPILATION)
+#error "Only <evince-view.h> can be included directly."
+#endif
+
+#ifndef EV_DOCUMENT_ASYNC_H
+#define EV_DOCUMENT_ASYNC_H
+
+#include <gio/gio.h>
+#include <cairo.h>
+
+#include <evince-document.h>
+
+#include "ev-jobs.h"
+#include "ev-job-scheduler.h"
+
+G_BEGIN_DECLS
+
+#define EV_TYPE_PAGE_DATA (ev_page_data_get_type ())
+
+typedef struct _EvPageData EvPageData;
+
+/**
+ * EvPageData:
+ * @page: the index of the page
+ * @link_mapping: the links, if requested
+ * @image_mapping: the images, if requested
+ * @form_field_mapping: the form fields, if requested
+ * @annot_mapping: the annotations, if requested
+ * @media_mapping: the media, if requested
+ * @text_mapping: the region covered by text, if requested
+ * @text: the text, if requested
+ * @text_layout: the area of each character of @text, if requested
+ * @text_layout_length: the number of items in @text_layout
+ * @text_attrs: the attributes of @text, if requested
+ * @text_log_attrs: the logical attributes of @text, if requested
+ * @text_log_attrs_length: the number of items in @text_log_attrs
+ *
+ * The data of a page returned by ev_document_get_page_data_finish().
+ * The fields that were not requested, or that the document doesn't
+ * have, are %NULL.
+ */
+struct _EvPageData {
+	gint            page;
+
+	EvMappingList  *link_mapping;
+	EvMappingList  *image_mapping;
+	EvMappingList  *form_field_mapping;
+	EvMappingList  *annot_mapping;
+	EvMappingList  *media_mapping;
+	cairo_region_t *text_mapping;
+	gchar          *text;
+	EvRectangle    *text_layout;
+	guint           text_layout_length;
+	PangoAttrList  *text_attrs;
+	PangoLogAttr   *text_log_attrs;
+	gulong          text_log_attrs_length;
+};
+
+GType            ev_page_data_get_type            (void) G_GNUC_CONST;
+EvPageData      *ev_page_data_copy                (EvPageData          *page_data);
+void             ev_page_data_free                (EvPageData          *page_data);
+
+void             ev_document_new_for_gfile_async  (GFile               *file,
+                                                   EvDocumentLoadFlags  flags,
+                                                   EvJobPriority        priority,
+                                                   GCancellable        *cancellable,
+                                                   GAsyncReadyCallback  callback,
+                                                   gpointer             user_data);
+EvDocument      *ev_document_new_for_gfile_finish (GAsyncResult        *result,
+                                                   GError             **error);
+
+void             ev_document_render_async         (EvDocument          *document,
+                                                   gint                 page,
+                                                   gint                 rotation,
+                                                   gdouble              scale,
+                                                   EvJobPriority        priority,
+                                                   GCancellable        *cancellable,
+                                                   GAsyncReadyCallback  callback,
+                                                   gpointer             user_data);
+cairo_surface_t *ev_document_render_finish        (EvDocument          *document,
+                                                   GAsyncResult        *result,
+                                                   GError             **error);
+
+void             ev_document_get_page_data_async  (EvDocument          *document,
+                                                   gint                 page,
+                                                   EvJobPageDataFlags   flags,
+                                                   EvJobPriority        priority,
+                                                   GCancellable        *cancellable,
+                                                   GAsyncReadyCallback  callback,
+                                                   gpointer             user_data);
+EvPageData      *ev_document_get_page_data_finish (EvDocument          *document,
+                                                   GAsyncResult        *result,
+                                                   GError             **error);
+
+void             ev_document_get_text_async       (EvDocument          *document,
+                                                   gint                 page,
+                                                   EvJobPriority        priority,
+                                                   GCancellable        *cancellable,
+                                                   GAsyncReadyCallback  callback,
+                                                   gpointer             user_data);
+gchar           *ev_document_get_text_finish      (EvDocument          *document,
+                                                   GAsyncResult        *result,
+                                                   GError             **error);
+
+void             ev_document_find_async           (EvDocument          *document,
+                                                   const gchar         *text,
+                                                   EvFindOptions        options,
+                                                   EvJobPriority        priority,
+                                                   GCancellable        *cancellable,
+                                                   GAsyncReadyCallback  callback,
+                                                   gpointer             user_data);
+GList          **ev_document_find_finish          (EvDocument          *document,
+                                                   GAsyncResult        *result,
+                                                   GError             **error);
+
+G_END_DECLS
+
+#endif /* EV_DOCUMENT_ASYNC_H */
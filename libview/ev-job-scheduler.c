@@ -18,101 +18,507 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include <string.h>
+
 #include "ev-debug.h"
 #include "ev-job-scheduler.h"
+#include "ev-job-scheduler-private.h"
 
 typedef struct _EvSchedulerJob {
 	EvJob         *job;
 	EvJobPriority  priority;
-	GSList        *job_link;
+	guint          distance;
+	gint64         queued_time;
+	gboolean       started;
+
+	/* Position in job_queue, -1 when not queued. Jobs are run in
+	 * deadline order, see ev_scheduler_job_update_deadline().
+	 */
+	gint           queue_index;
+	gint64         deadline;
+	guint64        sequence;
+	EvJobPriority  queue_priority;
+
+	/* Equivalent jobs are run once, see ev_job_queue_find_leader_unlocked() */
+	struct _EvSchedulerJob *leader;
+	GList                  *followers;
+	guint                   leader_key;
+	gboolean                can_lead;
 } EvSchedulerJob;
 
-G_LOCK_DEFINE_STATIC(job_list);
-static GSList *job_list = NULL;
+/* Scales of equivalent jobs may differ by this much, relatively */
+#define SCALE_TOLERANCE 0.001
+
+/* Urgent jobs, the visible pages, always run before any other. The
+ * other jobs run in the order of a deadline: how much later than a
+ * high priority job queued at the same time jobs of every priority
+ * have to run, and how much later for every page of distance to the
+ * visible pages. Among them, a job that has waited for longer than
+ * that runs before more urgent jobs queued after it, so low priority
+ * jobs are not delayed forever while scrolling.
+ */
+#define DISTANCE_DELAY (20 * G_TIME_SPAN_MILLISECOND)
+#define URGENT_TIER    ((gint64) 1 << 56)
+
+static const gint64 priority_delays[EV_JOB_N_PRIORITIES] = {
+	0,                              /* EV_JOB_PRIORITY_URGENT */
+	0,                              /* EV_JOB_PRIORITY_HIGH */
+	500 * G_TIME_SPAN_MILLISECOND,  /* EV_JOB_PRIORITY_LOW */
+	2 * G_TIME_SPAN_SECOND          /* EV_JOB_PRIORITY_NONE */
+};
+
+/* Statistics, see ev_job_scheduler_get_stats() */
+typedef struct {
+	guint  n_jobs;
+	gint64 total_time;
+	gint64 max_time;
+} EvSchedulerTimeStats;
+
+typedef struct {
+	guint                max_depth;
+	EvSchedulerTimeStats wait;
+} EvSchedulerQueueStats;
+
+G_LOCK_DEFINE_STATIC(stats);
+static EvSchedulerQueueStats queue_stats[EV_JOB_N_PRIORITIES];
+static GHashTable *run_stats = NULL;
+static guint   n_jobs_pushed = 0;
+static guint   n_jobs_coalesced = 0;
+static guint   n_cancelled_before_start = 0;
+static guint   n_cancelled_after_start = 0;
+static guint   doc_mutex_n_locks = 0;
+static guint   doc_mutex_n_contended = 0;
+static gint64  doc_mutex_wait_time = 0;
+
+static const gchar *priority_names[EV_JOB_N_PRIORITIES] = {
+	"urgent",
+	"high",
+	"low",
+	"none"
+};
 
 static volatile EvJob *running_job = NULL;
 
+/* EV_SCHEDULER=fifo runs jobs of the same priority in the order they
+ * were queued, ignoring their distance, and never runs a less urgent
+ * job while there are more urgent ones.
+ */
+static gboolean fifo_mode = FALSE;
+
+/* The EvSchedulerJob of an EvJob is attached to it, protected by job_queue_mutex */
+static GQuark scheduler_job_quark = 0;
+
+/* Jobs that can be followed by equivalent ones, indexed by
+ * ev_scheduler_job_get_leader_key(). Protected by job_queue_mutex.
+ */
+static GHashTable *leaders = NULL;
+
 static gpointer ev_job_thread_proxy               (gpointer        data);
 static void     ev_scheduler_thread_job_cancelled (EvSchedulerJob *job,
 						   GCancellable   *cancellable);
 
-/* EvJobQueue */
-static GQueue queue_urgent = G_QUEUE_INIT;
-static GQueue queue_high = G_QUEUE_INIT;
-static GQueue queue_low = G_QUEUE_INIT;
-static GQueue queue_none = G_QUEUE_INIT;
+/* EvJobQueue: a binary heap of jobs ordered by deadline */
+static GPtrArray *job_queue = NULL;
+static guint      job_queue_length[EV_JOB_N_PRIORITIES];
+static guint64    job_queue_sequence = 0;
 static GCond job_queue_cond;
 static GMutex job_queue_mutex;
 
-static GQueue *job_queue[EV_JOB_N_PRIORITIES] = {
-	&queue_urgent,
-	&queue_high,
-	&queue_low,
-	&queue_none
-};
+#define QUEUE_JOB(i) ((EvSchedulerJob *) g_ptr_array_index (job_queue, (i)))
+
+static gboolean
+ev_job_queue_job_before (EvSchedulerJob *a,
+			 EvSchedulerJob *b)
+{
+	if (a->deadline != b->deadline)
+		return a->deadline < b->deadline;
+
+	return a->sequence < b->sequence;
+}
 
 static void
-ev_job_queue_push (EvSchedulerJob *job,
-		   EvJobPriority   priority)
+ev_job_queue_set_unlocked (EvSchedulerJob *job,
+			   gint            index)
 {
-	ev_debug_message (DEBUG_JOBS, "%s priority %d", EV_GET_TYPE_NAME (job->job), priority);
-	
-	g_mutex_lock (&job_queue_mutex);
+	g_ptr_array_index (job_queue, index) = job;
+	job->queue_index = index;
+}
 
-	g_queue_push_tail (job_queue[priority], job);
-	g_cond_broadcast (&job_queue_cond);
-	
-	g_mutex_unlock (&job_queue_mutex);
+static void
+ev_job_queue_sift_up_unlocked (EvSchedulerJob *job)
+{
+	gint index = job->queue_index;
+
+	while (index > 0) {
+		gint parent = (index - 1) / 2;
+
+		if (!ev_job_queue_job_before (job, QUEUE_JOB (parent)))
+			break;
+
+		ev_job_queue_set_unlocked (QUEUE_JOB (parent), index);
+		index = parent;
+	}
+	ev_job_queue_set_unlocked (job, index);
 }
 
-static EvSchedulerJob *
-ev_job_queue_get_next_unlocked (void)
+static void
+ev_job_queue_sift_down_unlocked (EvSchedulerJob *job)
 {
-	gint i;
-	EvSchedulerJob *job = NULL;
-	
-	for (i = EV_JOB_PRIORITY_URGENT; i < EV_JOB_N_PRIORITIES; i++) {
-		job = (EvSchedulerJob *) g_queue_pop_head (job_queue[i]);
-		if (job)
+	gint index = job->queue_index;
+	gint length = job_queue->len;
+
+	while (TRUE) {
+		gint child = 2 * index + 1;
+
+		if (child >= length)
+			break;
+		if (child + 1 < length &&
+		    ev_job_queue_job_before (QUEUE_JOB (child + 1), QUEUE_JOB (child)))
+			child++;
+		if (!ev_job_queue_job_before (QUEUE_JOB (child), job))
 			break;
+
+		ev_job_queue_set_unlocked (QUEUE_JOB (child), index);
+		index = child;
 	}
+	ev_job_queue_set_unlocked (job, index);
+}
 
-	ev_debug_message (DEBUG_JOBS, "%s", job ? EV_GET_TYPE_NAME (job->job) : "No jobs in queue");
+/* Jobs are run in the order of their deadline, computed from the most
+ * urgent priority and the smallest distance of the job and its
+ * followers. Ties are broken by the order they were queued in.
+ */
+static void
+ev_scheduler_job_update_deadline (EvSchedulerJob *job)
+{
+	EvJobPriority priority = job->priority;
+	guint         distance = job->distance;
+	GList        *l;
 
-	return job;
+	for (l = job->followers; l; l = g_list_next (l)) {
+		EvSchedulerJob *follower = (EvSchedulerJob *) l->data;
+
+		priority = MIN (priority, follower->priority);
+		distance = MIN (distance, follower->distance);
+	}
+
+	if (fifo_mode) {
+		job->deadline = ((gint64) priority << 56) + job->queued_time;
+	} else {
+		job->deadline = job->queued_time + priority_delays[priority] +
+			MIN (distance, 1000) * DISTANCE_DELAY;
+		if (priority != EV_JOB_PRIORITY_URGENT)
+			job->deadline += URGENT_TIER;
+	}
+
+	if (job->queue_priority != priority && job->queue_index >= 0) {
+		job_queue_length[job->queue_priority]--;
+		job_queue_length[priority]++;
+	}
+	job->queue_priority = priority;
 }
 
-static gpointer
-ev_job_scheduler_init (gpointer data)
+static void
+ev_job_queue_add_unlocked (EvSchedulerJob *job)
 {
-	g_thread_new ("EvJobScheduler", ev_job_thread_proxy, NULL);
+	EvJobPriority priority;
+
+	ev_scheduler_job_update_deadline (job);
+	job->sequence = job_queue_sequence++;
+
+	g_ptr_array_add (job_queue, job);
+	job->queue_index = job_queue->len - 1;
+	ev_job_queue_sift_up_unlocked (job);
+	g_cond_broadcast (&job_queue_cond);
+
+	priority = job->queue_priority;
+	job_queue_length[priority]++;
+
+	G_LOCK (stats);
+	queue_stats[priority].max_depth = MAX (queue_stats[priority].max_depth,
+					       job_queue_length[priority]);
+	G_UNLOCK (stats);
+}
+
+static void
+ev_job_queue_remove_unlocked (EvSchedulerJob *job)
+{
+	EvSchedulerJob *last;
+	gint            index = job->queue_index;
+
+	job_queue_length[job->queue_priority]--;
+	job->queue_index = -1;
+
+	last = g_ptr_array_remove_index (job_queue, job_queue->len - 1);
+	if (last == job)
+		return;
+
+	ev_job_queue_set_unlocked (last, index);
+	ev_job_queue_sift_up_unlocked (last);
+	ev_job_queue_sift_down_unlocked (last);
+}
+
+/* Called when the priority or distance of @job or its followers change */
+static void
+ev_job_queue_update_unlocked (EvSchedulerJob *job)
+{
+	EvJobPriority old_priority = job->queue_priority;
+
+	if (job->queue_index < 0) {
+		ev_scheduler_job_update_deadline (job);
+		return;
+	}
+
+	ev_scheduler_job_update_deadline (job);
+	if (job->queue_priority != old_priority) {
+		ev_debug_message (DEBUG_JOBS, "Moving job %s from pirority %d to %d",
+				  EV_GET_TYPE_NAME (job->job), old_priority, job->queue_priority);
+
+		G_LOCK (stats);
+		queue_stats[job->queue_priority].max_depth =
+			MAX (queue_stats[job->queue_priority].max_depth,
+			     job_queue_length[job->queue_priority]);
+		G_UNLOCK (stats);
+	}
+
+	ev_job_queue_sift_up_unlocked (job);
+	ev_job_queue_sift_down_unlocked (job);
+	g_cond_broadcast (&job_queue_cond);
+}
+
+static gboolean
+ev_scheduler_scales_equal (gdouble a,
+			   gdouble b)
+{
+	return ABS (a - b) <= SCALE_TOLERANCE * MAX (a, b);
+}
+
+/* Jobs are equivalent when they produce the same result. Render jobs
+ * including the selection are never, since the selection can change
+ * between the two requests.
+ */
+static gboolean
+ev_scheduler_jobs_equivalent (EvJob *a,
+			      EvJob *b)
+{
+	if (a->document != b->document || G_OBJECT_TYPE (a) != G_OBJECT_TYPE (b))
+		return FALSE;
+
+	if (G_OBJECT_TYPE (a) == EV_TYPE_JOB_RENDER) {
+		EvJobRender *ra = EV_JOB_RENDER (a);
+		EvJobRender *rb = EV_JOB_RENDER (b);
+
+		return !ra->include_selection && !rb->include_selection &&
+			ra->page == rb->page &&
+			ra->rotation == rb->rotation &&
+			ra->target_width == rb->target_width &&
+			ra->target_height == rb->target_height &&
+			ev_scheduler_scales_equal (ra->scale, rb->scale);
+	}
+
+	if (G_OBJECT_TYPE (a) == EV_TYPE_JOB_THUMBNAIL) {
+		EvJobThumbnail *ta = EV_JOB_THUMBNAIL (a);
+		EvJobThumbnail *tb = EV_JOB_THUMBNAIL (b);
+
+		return ta->page == tb->page &&
+			ta->rotation == tb->rotation &&
+			ta->target_width == tb->target_width &&
+			ta->target_height == tb->target_height &&
+			ta->format == tb->format &&
+			ta->has_frame == tb->has_frame &&
+			ev_scheduler_scales_equal (ta->scale, tb->scale);
+	}
+
+	return FALSE;
+}
+
+/* Equivalent jobs have the same key, jobs with the same key
+ * are not necessarily equivalent.
+ */
+static gboolean
+ev_scheduler_job_get_leader_key (EvSchedulerJob *job,
+				 guint          *key)
+{
+	gint page;
+
+	if (G_OBJECT_TYPE (job->job) == EV_TYPE_JOB_RENDER)
+		page = EV_JOB_RENDER (job->job)->page;
+	else if (G_OBJECT_TYPE (job->job) == EV_TYPE_JOB_THUMBNAIL)
+		page = EV_JOB_THUMBNAIL (job->job)->page;
+	else
+		return FALSE;
+
+	*key = g_direct_hash (job->job->document) ^
+		g_direct_hash (GSIZE_TO_POINTER (G_OBJECT_TYPE (job->job))) ^
+		(page * 2654435761u);
+
+	return TRUE;
+}
+
+static void
+ev_job_queue_add_leader_unlocked (EvSchedulerJob *job)
+{
+	GList *candidates;
+
+	if (!ev_scheduler_job_get_leader_key (job, &job->leader_key))
+		return;
+
+	if (!leaders)
+		leaders = g_hash_table_new (NULL, NULL);
+
+	candidates = g_hash_table_lookup (leaders, GUINT_TO_POINTER (job->leader_key));
+	g_hash_table_insert (leaders, GUINT_TO_POINTER (job->leader_key),
+			     g_list_prepend (candidates, job));
+	job->can_lead = TRUE;
+}
+
+static void
+ev_job_queue_remove_leader_unlocked (EvSchedulerJob *job)
+{
+	GList *candidates;
+
+	if (!job->can_lead)
+		return;
+
+	candidates = g_hash_table_lookup (leaders, GUINT_TO_POINTER (job->leader_key));
+	candidates = g_list_remove (candidates, job);
+	if (candidates)
+		g_hash_table_insert (leaders, GUINT_TO_POINTER (job->leader_key), candidates);
+	else
+		g_hash_table_remove (leaders, GUINT_TO_POINTER (job->leader_key));
+	job->can_lead = FALSE;
+}
+
+/* Looks for a queued or running job equivalent to @job. If there's one,
+ * @job doesn't get queued, it's added to the followers of that job,
+ * its leader, and gets a copy of the leader's result when it finishes.
+ */
+static EvSchedulerJob *
+ev_job_queue_find_leader_unlocked (EvSchedulerJob *job)
+{
+	GList *l;
+	guint  key;
+
+	if (!leaders || !ev_scheduler_job_get_leader_key (job, &key))
+		return NULL;
+
+	for (l = g_hash_table_lookup (leaders, GUINT_TO_POINTER (key)); l; l = g_list_next (l)) {
+		EvSchedulerJob *leader = (EvSchedulerJob *) l->data;
+
+		if (ev_scheduler_jobs_equivalent (leader->job, job->job))
+			return leader;
+	}
 
 	return NULL;
 }
 
+/* Makes the first of @followers their leader, and queues it */
 static void
-ev_scheduler_job_list_add (EvSchedulerJob *job)
+ev_job_queue_promote_follower_unlocked (GList *followers)
 {
-	ev_debug_message (DEBUG_JOBS, "%s", EV_GET_TYPE_NAME (job->job));
-	
-	G_LOCK (job_list);
+	EvSchedulerJob *leader = (EvSchedulerJob *) followers->data;
+	GList          *l;
 
-	job_list = g_slist_prepend (job_list, job);
-	job->job_link = job_list;
-	
-	G_UNLOCK (job_list);
+	leader->leader = NULL;
+	leader->followers = g_list_delete_link (followers, followers);
+	for (l = leader->followers; l; l = g_list_next (l))
+		((EvSchedulerJob *) l->data)->leader = leader;
+
+	ev_job_queue_add_unlocked (leader);
+	ev_job_queue_add_leader_unlocked (leader);
 }
 
 static void
-ev_scheduler_job_list_remove (EvSchedulerJob *job)
+ev_job_queue_push (EvSchedulerJob *job)
 {
-	ev_debug_message (DEBUG_JOBS, "%s", EV_GET_TYPE_NAME (job->job));
+	ev_debug_message (DEBUG_JOBS, "%s priority %d distance %u",
+			  EV_GET_TYPE_NAME (job->job), job->priority, job->distance);
 	
-	G_LOCK (job_list);
+	g_mutex_lock (&job_queue_mutex);
 
-	job_list = g_slist_delete_link (job_list, job->job_link);
-	
-	G_UNLOCK (job_list);
+	job->queued_time = g_get_monotonic_time ();
+
+	job->leader = ev_job_queue_find_leader_unlocked (job);
+	if (job->leader) {
+		ev_debug_message (DEBUG_JOBS, "%s coalesced", EV_GET_TYPE_NAME (job->job));
+		job->leader->followers = g_list_append (job->leader->followers, job);
+		ev_job_queue_update_unlocked (job->leader);
+
+		G_LOCK (stats);
+		n_jobs_coalesced++;
+		G_UNLOCK (stats);
+
+		g_mutex_unlock (&job_queue_mutex);
+
+		return;
+	}
+
+	ev_job_queue_add_unlocked (job);
+	ev_job_queue_add_leader_unlocked (job);
+
+	g_mutex_unlock (&job_queue_mutex);
+}
+
+static void
+ev_scheduler_time_stats_add (EvSchedulerTimeStats *time_stats,
+			     gint64                time)
+{
+	time_stats->n_jobs++;
+	time_stats->total_time += time;
+	time_stats->max_time = MAX (time_stats->max_time, time);
+}
+
+static void
+ev_scheduler_stats_add_run_time (EvJob *job,
+				 gint64 time)
+{
+	EvSchedulerTimeStats *time_stats;
+
+	G_LOCK (stats);
+
+	if (!run_stats)
+		run_stats = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+
+	/* Type names are interned, they can be used as keys directly */
+	time_stats = g_hash_table_lookup (run_stats, EV_GET_TYPE_NAME (job));
+	if (!time_stats) {
+		time_stats = g_new0 (EvSchedulerTimeStats, 1);
+		g_hash_table_insert (run_stats, (gpointer) EV_GET_TYPE_NAME (job), time_stats);
+	}
+	ev_scheduler_time_stats_add (time_stats, time);
+
+	G_UNLOCK (stats);
+}
+
+static EvSchedulerJob *
+ev_job_queue_get_next_unlocked (void)
+{
+	EvSchedulerJob *job = NULL;
+
+	if (job_queue->len > 0) {
+		job = QUEUE_JOB (0);
+		ev_job_queue_remove_unlocked (job);
+
+		G_LOCK (stats);
+		ev_scheduler_time_stats_add (&queue_stats[job->queue_priority].wait,
+					     g_get_monotonic_time () - job->queued_time);
+		G_UNLOCK (stats);
+	}
+
+	ev_debug_message (DEBUG_JOBS, "%s", job ? EV_GET_TYPE_NAME (job->job) : "No jobs in queue");
+
+	return job;
+}
+
+static gpointer
+ev_job_scheduler_init (gpointer data)
+{
+	fifo_mode = g_strcmp0 (g_getenv ("EV_SCHEDULER"), "fifo") == 0;
+	job_queue = g_ptr_array_new ();
+	scheduler_job_quark = g_quark_from_static_string ("ev-scheduler-job");
+	g_thread_new ("EvJobScheduler", ev_job_thread_proxy, NULL);
+
+	return NULL;
 }
 
 static void
@@ -139,8 +545,12 @@ ev_scheduler_job_destroy (EvSchedulerJob *job)
 						      G_CALLBACK (ev_scheduler_thread_job_cancelled),
 						      job);
 	}
-	
-	ev_scheduler_job_list_remove (job);
+
+	g_mutex_lock (&job_queue_mutex);
+	if (g_object_get_qdata (G_OBJECT (job->job), scheduler_job_quark) == job)
+		g_object_set_qdata (G_OBJECT (job->job), scheduler_job_quark, NULL);
+	g_mutex_unlock (&job_queue_mutex);
+
 	ev_scheduler_job_free (job);
 }
 
@@ -148,20 +558,51 @@ static void
 ev_scheduler_thread_job_cancelled (EvSchedulerJob *job,
 				   GCancellable   *cancellable)
 {
-	GList   *list;
-	
+	gboolean queued;
+
 	ev_debug_message (DEBUG_JOBS, "%s", EV_GET_TYPE_NAME (job->job));
 
 	g_mutex_lock (&job_queue_mutex);
 
+	/* A follower is just removed from its leader */
+	if (job->leader) {
+		job->leader->followers = g_list_remove (job->leader->followers, job);
+		ev_job_queue_update_unlocked (job->leader);
+		job->leader = NULL;
+
+		G_LOCK (stats);
+		n_cancelled_before_start++;
+		G_UNLOCK (stats);
+
+		g_mutex_unlock (&job_queue_mutex);
+		ev_scheduler_job_destroy (job);
+
+		return;
+	}
+
 	/* If the job is not still running,
-	 * remove it from the job queue and job list.
+	 * remove it from the job queue.
 	 * If the job is currently running, it will be
 	 * destroyed as soon as it finishes. 
 	 */
-	list = g_queue_find (job_queue[job->priority], job);
-	if (list) {
-		g_queue_delete_link (job_queue[job->priority], list);
+	queued = job->queue_index >= 0;
+
+	G_LOCK (stats);
+	if (queued && !job->started)
+		n_cancelled_before_start++;
+	else
+		n_cancelled_after_start++;
+	G_UNLOCK (stats);
+
+	if (queued) {
+		ev_job_queue_remove_unlocked (job);
+		ev_job_queue_remove_leader_unlocked (job);
+
+		/* The first follower is queued instead */
+		if (job->followers) {
+			ev_job_queue_promote_follower_unlocked (job->followers);
+			job->followers = NULL;
+		}
 		g_mutex_unlock (&job_queue_mutex);
 		ev_scheduler_job_destroy (job);
 	} else {
@@ -169,9 +610,37 @@ ev_scheduler_thread_job_cancelled (EvSchedulerJob *job,
 	}
 }
 
-static void
-ev_job_thread (EvJob *job)
+/* Puts a job that has more work to do back in the queue when there
+ * are other jobs waiting that would run before it, so that jobs
+ * working in steps, like EvJobAnnots, don't keep the thread busy
+ * until they are done.
+ */
+static gboolean
+ev_job_queue_requeue_if_pending (EvSchedulerJob *job)
 {
+	gboolean requeue;
+
+	g_mutex_lock (&job_queue_mutex);
+
+	job->queued_time = g_get_monotonic_time ();
+	ev_scheduler_job_update_deadline (job);
+	requeue = job_queue->len > 0 && QUEUE_JOB (0)->deadline <= job->deadline;
+
+	if (requeue) {
+		ev_debug_message (DEBUG_JOBS, "%s priority %d", EV_GET_TYPE_NAME (job->job), job->priority);
+		ev_job_queue_add_unlocked (job);
+	}
+
+	g_mutex_unlock (&job_queue_mutex);
+
+	return requeue;
+}
+
+/* Returns whether the job was put back in the queue */
+static gboolean
+ev_job_thread (EvSchedulerJob *s_job)
+{
+	EvJob   *job = s_job->job;
 	gboolean result;
 
 	ev_debug_message (DEBUG_JOBS, "%s", EV_GET_TYPE_NAME (job));
@@ -180,23 +649,180 @@ ev_job_thread (EvJob *job)
 		if (g_cancellable_is_cancelled (job->cancellable))
 			result = FALSE;
 		else {
+			gint64 start;
+
                         g_atomic_pointer_set (&running_job, job);
+			s_job->started = TRUE;
+			start = g_get_monotonic_time ();
 			result = ev_job_run (job);
+			ev_scheduler_stats_add_run_time (job, g_get_monotonic_time () - start);
                 }
+
+		if (result && ev_job_queue_requeue_if_pending (s_job)) {
+			g_atomic_pointer_set (&running_job, NULL);
+			return TRUE;
+		}
 	} while (result);
 
         g_atomic_pointer_set (&running_job, NULL);
+
+	return FALSE;
+}
+
+static cairo_surface_t *
+ev_scheduler_copy_surface (cairo_surface_t *surface)
+{
+	cairo_surface_t *copy;
+	gdouble          device_scale_x = 1, device_scale_y = 1;
+	gint             height, stride;
+
+	if (!surface)
+		return NULL;
+
+	height = cairo_image_surface_get_height (surface);
+	stride = cairo_image_surface_get_stride (surface);
+	copy = cairo_image_surface_create (cairo_image_surface_get_format (surface),
+					   cairo_image_surface_get_width (surface),
+					   height);
+	g_assert (stride == cairo_image_surface_get_stride (copy));
+
+	cairo_surface_flush (surface);
+	memcpy (cairo_image_surface_get_data (copy),
+		cairo_image_surface_get_data (surface),
+		height * stride);
+	cairo_surface_mark_dirty (copy);
+
+	cairo_surface_get_device_scale (surface, &device_scale_x, &device_scale_y);
+	cairo_surface_set_device_scale (copy, device_scale_x, device_scale_y);
+
+	return copy;
+}
+
+/* Gives @follower a copy of the result of @leader. Every job gets its
+ * own copy, since the results are modified, e.g. to invert colors, once
+ * they are in the main thread, so this must run before @leader emits
+ * finished. Returns %FALSE if @leader has no result because it was
+ * cancelled.
+ */
+static gboolean
+ev_scheduler_job_copy_result (EvSchedulerJob *follower,
+			      EvSchedulerJob *leader)
+{
+	EvJob *job = leader->job;
+
+	if (job->failed) {
+		ev_job_failed_from_error (follower->job, job->error);
+
+		return TRUE;
+	}
+
+	if (EV_IS_JOB_RENDER (job)) {
+		EvJobRender *render = EV_JOB_RENDER (job);
+
+		/* A render cancelled after rendering the page still has it */
+		if (!render->surface)
+			return FALSE;
+
+		EV_JOB_RENDER (follower->job)->surface = ev_scheduler_copy_surface (render->surface);
+	} else if (EV_IS_JOB_THUMBNAIL (job)) {
+		EvJobThumbnail *thumbnail = EV_JOB_THUMBNAIL (job);
+		EvJobThumbnail *follower_thumbnail = EV_JOB_THUMBNAIL (follower->job);
+
+		if (!thumbnail->thumbnail && !thumbnail->thumbnail_surface)
+			return FALSE;
+
+		if (thumbnail->thumbnail)
+			follower_thumbnail->thumbnail = gdk_pixbuf_copy (thumbnail->thumbnail);
+		follower_thumbnail->thumbnail_surface =
+			ev_scheduler_copy_surface (thumbnail->thumbnail_surface);
+	} else {
+		g_assert_not_reached ();
+	}
+
+	ev_job_succeeded (follower->job);
+
+	return TRUE;
+}
+
+/* Called in the scheduler thread when @job has its result, and again
+ * when it has finished running, in case it was cancelled before.
+ */
+static void
+ev_scheduler_job_finish_followers (EvSchedulerJob *job)
+{
+	EvSchedulerJob *first;
+	GList          *followers;
+	GList          *l;
+
+	g_mutex_lock (&job_queue_mutex);
+	ev_job_queue_remove_leader_unlocked (job);
+	followers = job->followers;
+	job->followers = NULL;
+	for (l = followers; l; l = g_list_next (l))
+		((EvSchedulerJob *) l->data)->leader = NULL;
+	g_mutex_unlock (&job_queue_mutex);
+
+	if (!followers)
+		return;
+
+	first = (EvSchedulerJob *) followers->data;
+	if (!ev_scheduler_job_copy_result (first, job)) {
+		/* The job was cancelled before having a result,
+		 * the first follower is run instead.
+		 */
+		g_mutex_lock (&job_queue_mutex);
+		ev_job_queue_promote_follower_unlocked (followers);
+		g_mutex_unlock (&job_queue_mutex);
+
+		return;
+	}
+
+	for (l = followers; l; l = g_list_next (l)) {
+		EvSchedulerJob *follower = (EvSchedulerJob *) l->data;
+
+		follower->started = TRUE;
+		if (follower != first)
+			ev_scheduler_job_copy_result (follower, job);
+		ev_scheduler_job_destroy (follower);
+	}
+	g_list_free (followers);
+}
+
+/* Called by ev_job_emit_finished() in the scheduler thread, before the
+ * finished signal of @job is queued to the main thread.
+ */
+void
+_ev_job_scheduler_job_finishing (EvJob *job)
+{
+	EvSchedulerJob *s_job;
+
+	if (!scheduler_job_quark)
+		return;
+
+	g_mutex_lock (&job_queue_mutex);
+	s_job = g_object_get_qdata (G_OBJECT (job), scheduler_job_quark);
+	g_mutex_unlock (&job_queue_mutex);
+
+	if (s_job)
+		ev_scheduler_job_finish_followers (s_job);
 }
 
 static gboolean
 ev_job_idle (EvJob *job)
 {
+	gboolean result;
+	gint64   start;
+
 	ev_debug_message (DEBUG_JOBS, "%s", EV_GET_TYPE_NAME (job));
 
 	if (g_cancellable_is_cancelled (job->cancellable))
 		return FALSE;
 
-	return ev_job_run (job);
+	start = g_get_monotonic_time ();
+	result = ev_job_run (job);
+	ev_scheduler_stats_add_run_time (job, g_get_monotonic_time () - start);
+
+	return result;
 }
 
 static gpointer
@@ -214,16 +840,35 @@ ev_job_thread_proxy (gpointer data)
 		}
 		g_mutex_unlock (&job_queue_mutex);
 		
-		ev_job_thread (job->job);
-		ev_scheduler_job_destroy (job);
+		if (!ev_job_thread (job)) {
+			ev_scheduler_job_finish_followers (job);
+			ev_scheduler_job_destroy (job);
+		}
 	}
 
 	return NULL;
 }
 
+/**
+ * ev_job_scheduler_push_job_full:
+ * @job: an #EvJob
+ * @priority: the #EvJobPriority of @job
+ * @distance: how far the result of @job is from being visible,
+ *   e.g. in pages from the visible range, 0 if it's visible
+ *
+ * Schedules @job. Urgent jobs run before any other. The others run in
+ * the order of a deadline computed from their @priority, @distance and
+ * the time they were pushed, so that of two jobs with the same
+ * priority the nearest to being visible runs first, and a job that has
+ * waited for long enough runs before more urgent, but not urgent, jobs
+ * pushed after it.
+ *
+ * Since: 3.32
+ */
 void
-ev_job_scheduler_push_job (EvJob         *job,
-			   EvJobPriority  priority)
+ev_job_scheduler_push_job_full (EvJob         *job,
+				EvJobPriority  priority,
+				guint          distance)
 {
 	static GOnce once_init = G_ONCE_INIT;
 	EvSchedulerJob *s_job;
@@ -235,15 +880,23 @@ ev_job_scheduler_push_job (EvJob         *job,
 	s_job = g_new0 (EvSchedulerJob, 1);
 	s_job->job = g_object_ref (job);
 	s_job->priority = priority;
+	s_job->distance = distance;
+	s_job->queue_index = -1;
+
+	G_LOCK (stats);
+	n_jobs_pushed++;
+	G_UNLOCK (stats);
 
-	ev_scheduler_job_list_add (s_job);
-	
 	switch (ev_job_get_run_mode (job)) {
 	case EV_JOB_RUN_THREAD:
+		g_mutex_lock (&job_queue_mutex);
+		g_object_set_qdata (G_OBJECT (job), scheduler_job_quark, s_job);
+		g_mutex_unlock (&job_queue_mutex);
+
 		g_signal_connect_swapped (job->cancellable, "cancelled",
 					  G_CALLBACK (ev_scheduler_thread_job_cancelled),
 					  s_job);
-		ev_job_queue_push (s_job, priority);
+		ev_job_queue_push (s_job);
 		break;
 	case EV_JOB_RUN_MAIN_LOOP:
 		g_signal_connect_swapped (job, "finished",
@@ -263,48 +916,94 @@ ev_job_scheduler_push_job (EvJob         *job,
 }
 
 void
-ev_job_scheduler_update_job (EvJob         *job,
-			     EvJobPriority  priority)
+ev_job_scheduler_push_job (EvJob         *job,
+			   EvJobPriority  priority)
+{
+	ev_job_scheduler_push_job_full (job, priority, 0);
+}
+
+static void
+ev_job_scheduler_update_job_internal (EvJob         *job,
+				      EvJobPriority  priority,
+				      gboolean       set_distance,
+				      guint          distance)
 {
-	GSList         *l;
-	EvSchedulerJob *s_job = NULL;
-	gboolean        need_resort = FALSE;
+	EvSchedulerJob *s_job;
 
 	/* Main loop jobs are scheduled inmediately */
 	if (ev_job_get_run_mode (job) == EV_JOB_RUN_MAIN_LOOP)
 		return;
 
+	/* No job has been pushed yet */
+	if (!scheduler_job_quark)
+		return;
+
 	ev_debug_message (DEBUG_JOBS, "%s pirority %d", EV_GET_TYPE_NAME (job), priority);
-	
-	G_LOCK (job_list);
 
-	for (l = job_list; l; l = l->next) {
-		s_job = (EvSchedulerJob *)l->data;
+	g_mutex_lock (&job_queue_mutex);
+
+	s_job = g_object_get_qdata (G_OBJECT (job), scheduler_job_quark);
+	if (s_job && (s_job->priority != priority ||
+		      (set_distance && s_job->distance != distance))) {
+		s_job->priority = priority;
+		if (set_distance)
+			s_job->distance = distance;
 
-		if (s_job->job == job) {
-			need_resort = (s_job->priority != priority);
-			break;
-		}
+		/* A leader is as urgent as its most urgent follower */
+		ev_job_queue_update_unlocked (s_job->leader ? s_job->leader : s_job);
 	}
-	
-	G_UNLOCK (job_list);
 
-	if (need_resort) {
-		GList *list;
-	
-		g_mutex_lock (&job_queue_mutex);
-		
-		list = g_queue_find (job_queue[s_job->priority], s_job);
-		if (list) {
-			ev_debug_message (DEBUG_JOBS, "Moving job %s from pirority %d to %d",
-					  EV_GET_TYPE_NAME (job), s_job->priority, priority);
-			g_queue_delete_link (job_queue[s_job->priority], list);
-			g_queue_push_tail (job_queue[priority], s_job);
-			g_cond_broadcast (&job_queue_cond);
-		}
-		
-		g_mutex_unlock (&job_queue_mutex);
-	}
+	g_mutex_unlock (&job_queue_mutex);
+}
+
+void
+ev_job_scheduler_update_job (EvJob         *job,
+			     EvJobPriority  priority)
+{
+	ev_job_scheduler_update_job_internal (job, priority, FALSE, 0);
+}
+
+/**
+ * ev_job_scheduler_update_job_full:
+ * @job: an #EvJob
+ * @priority: the new #EvJobPriority of @job
+ * @distance: the new distance of @job, see ev_job_scheduler_push_job_full()
+ *
+ * Since: 3.32
+ */
+void
+ev_job_scheduler_update_job_full (EvJob         *job,
+				  EvJobPriority  priority,
+				  guint          distance)
+{
+	ev_job_scheduler_update_job_internal (job, priority, TRUE, distance);
+}
+
+/**
+ * ev_job_scheduler_get_page_distance:
+ * @page: a page index
+ * @start_page: the first visible page
+ * @end_page: the last visible page
+ *
+ * Computes the distance of @page to the visible range, to be passed
+ * to ev_job_scheduler_push_job_full() for jobs rendering @page.
+ *
+ * Returns: the number of pages between @page and the visible range,
+ *   0 if @page is visible
+ *
+ * Since: 3.32
+ */
+guint
+ev_job_scheduler_get_page_distance (gint page,
+				    gint start_page,
+				    gint end_page)
+{
+	if (page < start_page)
+		return start_page - page;
+	if (page > end_page)
+		return page - end_page;
+
+	return 0;
 }
 
 /**
@@ -317,3 +1016,146 @@ ev_job_scheduler_get_running_thread_job (void)
 {
         return g_atomic_pointer_get (&running_job);
 }
+
+static GVariant *
+ev_scheduler_time_stats_to_variant (EvSchedulerTimeStats *time_stats,
+				    GVariantBuilder      *builder)
+{
+	g_variant_builder_add (builder, "{sv}", "count",
+			       g_variant_new_uint32 (time_stats->n_jobs));
+	g_variant_builder_add (builder, "{sv}", "total-time",
+			       g_variant_new_int64 (time_stats->total_time));
+	g_variant_builder_add (builder, "{sv}", "max-time",
+			       g_variant_new_int64 (time_stats->max_time));
+
+	return g_variant_builder_end (builder);
+}
+
+/**
+ * ev_job_scheduler_get_stats:
+ *
+ * Gets statistics about the jobs scheduled since the program started
+ * or since the last call to ev_job_scheduler_reset_stats(), as a
+ * dictionary with the following keys. Times are in microseconds.
+ *
+ * - "mode" (s): "deadline", or "fifo" when EV_SCHEDULER=fifo is set
+ * - "pushed" (u): number of jobs pushed
+ * - "coalesced" (u): jobs that got the result of an equivalent job
+ *   instead of being run
+ * - "cancelled-before-start" (u): jobs cancelled while still queued
+ * - "cancelled-after-start" (u): jobs cancelled while running, or
+ *   after having run at least once
+ * - "queues" (a{sv}): for every priority ("urgent", "high", "low",
+ *   "none") a dictionary with the current "depth" (u), the "max-depth" (u)
+ *   and the "count", "total-time" and "max-time" jobs waited in the queue
+ * - "jobs" (a{sv}): for every #EvJob type run, a dictionary with the
+ *   "count", "total-time" and "max-time" of its runs
+ * - "doc-mutex" (a{sv}): the number of "locks" (u) of the document
+ *   mutex, how many were "contended" (u) and the "wait-time" (x)
+ *
+ * Returns: (transfer floating): a #GVariant of type a{sv}
+ *
+ * Since: 3.32
+ */
+GVariant *
+ev_job_scheduler_get_stats (void)
+{
+	GVariantBuilder builder;
+	GVariantBuilder dict_builder;
+	GVariantBuilder item_builder;
+	GHashTableIter  iter;
+	gpointer        key, value;
+	guint           depths[EV_JOB_N_PRIORITIES];
+	guint           n_locks, n_contended;
+	gint64          wait_time;
+	gint            i;
+
+	g_mutex_lock (&job_queue_mutex);
+	for (i = 0; i < EV_JOB_N_PRIORITIES; i++)
+		depths[i] = job_queue_length[i];
+	g_mutex_unlock (&job_queue_mutex);
+
+	ev_document_doc_mutex_get_stats (&n_locks, &n_contended, &wait_time);
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+
+	G_LOCK (stats);
+
+	g_variant_builder_add (&builder, "{sv}", "mode",
+			       g_variant_new_string (fifo_mode ? "fifo" : "deadline"));
+	g_variant_builder_add (&builder, "{sv}", "pushed",
+			       g_variant_new_uint32 (n_jobs_pushed));
+	g_variant_builder_add (&builder, "{sv}", "coalesced",
+			       g_variant_new_uint32 (n_jobs_coalesced));
+	g_variant_builder_add (&builder, "{sv}", "cancelled-before-start",
+			       g_variant_new_uint32 (n_cancelled_before_start));
+	g_variant_builder_add (&builder, "{sv}", "cancelled-after-start",
+			       g_variant_new_uint32 (n_cancelled_after_start));
+
+	g_variant_builder_init (&dict_builder, G_VARIANT_TYPE_VARDICT);
+	for (i = 0; i < EV_JOB_N_PRIORITIES; i++) {
+		g_variant_builder_init (&item_builder, G_VARIANT_TYPE_VARDICT);
+		g_variant_builder_add (&item_builder, "{sv}", "depth",
+				       g_variant_new_uint32 (depths[i]));
+		g_variant_builder_add (&item_builder, "{sv}", "max-depth",
+				       g_variant_new_uint32 (queue_stats[i].max_depth));
+		g_variant_builder_add (&dict_builder, "{sv}", priority_names[i],
+				       ev_scheduler_time_stats_to_variant (&queue_stats[i].wait,
+									   &item_builder));
+	}
+	g_variant_builder_add (&builder, "{sv}", "queues",
+			       g_variant_builder_end (&dict_builder));
+
+	g_variant_builder_init (&dict_builder, G_VARIANT_TYPE_VARDICT);
+	if (run_stats) {
+		g_hash_table_iter_init (&iter, run_stats);
+		while (g_hash_table_iter_next (&iter, &key, &value)) {
+			g_variant_builder_init (&item_builder, G_VARIANT_TYPE_VARDICT);
+			g_variant_builder_add (&dict_builder, "{sv}", (const gchar *) key,
+					       ev_scheduler_time_stats_to_variant (value,
+										   &item_builder));
+		}
+	}
+	g_variant_builder_add (&builder, "{sv}", "jobs",
+			       g_variant_builder_end (&dict_builder));
+
+	g_variant_builder_init (&dict_builder, G_VARIANT_TYPE_VARDICT);
+	g_variant_builder_add (&dict_builder, "{sv}", "locks",
+			       g_variant_new_uint32 (n_locks - doc_mutex_n_locks));
+	g_variant_builder_add (&dict_builder, "{sv}", "contended",
+			       g_variant_new_uint32 (n_contended - doc_mutex_n_contended));
+	g_variant_builder_add (&dict_builder, "{sv}", "wait-time",
+			       g_variant_new_int64 (wait_time - doc_mutex_wait_time));
+	g_variant_builder_add (&builder, "{sv}", "doc-mutex",
+			       g_variant_builder_end (&dict_builder));
+
+	G_UNLOCK (stats);
+
+	return g_variant_builder_end (&builder);
+}
+
+/**
+ * ev_job_scheduler_reset_stats:
+ *
+ * Resets the statistics returned by ev_job_scheduler_get_stats().
+ *
+ * Since: 3.32
+ */
+void
+ev_job_scheduler_reset_stats (void)
+{
+	G_LOCK (stats);
+
+	memset (queue_stats, 0, sizeof (queue_stats));
+	if (run_stats)
+		g_hash_table_remove_all (run_stats);
+	n_jobs_pushed = 0;
+	n_jobs_coalesced = 0;
+	n_cancelled_before_start = 0;
+	n_cancelled_after_start = 0;
+	ev_document_doc_mutex_get_stats (&doc_mutex_n_locks,
+					 &doc_mutex_n_contended,
+					 &doc_mutex_wait_time);
+
+	G_UNLOCK (stats);
+}
@@ -40,10 +40,22 @@ typedef enum {
 
 void   ev_job_scheduler_push_job               (EvJob        *job,
                                                 EvJobPriority priority);
+void   ev_job_scheduler_push_job_full          (EvJob        *job,
+                                                EvJobPriority priority,
+                                                guint         distance);
 void   ev_job_scheduler_update_job             (EvJob        *job,
                                                 EvJobPriority priority);
+void   ev_job_scheduler_update_job_full        (EvJob        *job,
+                                                EvJobPriority priority,
+                                                guint         distance);
+guint  ev_job_scheduler_get_page_distance      (gint          page,
+                                                gint          start_page,
+                                                gint          end_page);
 EvJob *ev_job_scheduler_get_running_thread_job (void);
 
+GVariant *ev_job_scheduler_get_stats           (void);
+void      ev_job_scheduler_reset_stats         (void);
+
 G_END_DECLS
 
 #endif /* EV_JOB_SCHEDULER_H */
@@ -21,6 +21,7 @@
 #include <config.h>
 
 #include "ev-jobs.h"
+#include "ev-job-scheduler-private.h"
 #include "ev-document-links.h"
 #include "ev-document-images.h"
 #include "ev-document-forms.h"
@@ -87,15 +88,28 @@ enum {
 	FIND_LAST_SIGNAL
 };
 
+enum {
+	ANNOTS_UPDATED,
+	ANNOTS_LAST_SIGNAL
+};
+
+enum {
+	RENDER_BATCH_PAGE_READY,
+	RENDER_BATCH_LAST_SIGNAL
+};
+
 static guint job_signals[LAST_SIGNAL] = { 0 };
 static guint job_fonts_signals[FONTS_LAST_SIGNAL] = { 0 };
 static guint job_find_signals[FIND_LAST_SIGNAL] = { 0 };
+static guint job_annots_signals[ANNOTS_LAST_SIGNAL] = { 0 };
+static guint job_render_batch_signals[RENDER_BATCH_LAST_SIGNAL] = { 0 };
 
 G_DEFINE_ABSTRACT_TYPE (EvJob, ev_job, G_TYPE_OBJECT)
 G_DEFINE_TYPE (EvJobLinks, ev_job_links, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobAttachments, ev_job_attachments, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobAnnots, ev_job_annots, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobRender, ev_job_render, EV_TYPE_JOB)
+G_DEFINE_TYPE (EvJobRenderBatch, ev_job_render_batch, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobPageData, ev_job_page_data, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobThumbnail, ev_job_thumbnail, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobFonts, ev_job_fonts, EV_TYPE_JOB)
@@ -108,6 +122,34 @@ G_DEFINE_TYPE (EvJobLayers, ev_job_layers, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobExport, ev_job_export, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobPrint, ev_job_print, EV_TYPE_JOB)
 
+/* Records the start of a job in the profiler, with the page it's
+ * working on when it has one. Jobs are stopped when finished.
+ */
+static void
+ev_job_profiler_start (EvJob *job)
+{
+	gint page = -1;
+
+	if (!ev_profiler_is_enabled ())
+		return;
+
+	if (EV_IS_JOB_RENDER (job))
+		page = EV_JOB_RENDER (job)->page;
+	else if (EV_IS_JOB_PAGE_DATA (job))
+		page = EV_JOB_PAGE_DATA (job)->page;
+	else if (EV_IS_JOB_THUMBNAIL (job))
+		page = EV_JOB_THUMBNAIL (job)->page;
+	else if (EV_IS_JOB_EXPORT (job))
+		page = EV_JOB_EXPORT (job)->page;
+	else if (EV_IS_JOB_PRINT (job))
+		page = EV_JOB_PRINT (job)->page;
+	else if (EV_IS_JOB_FIND (job))
+		page = EV_JOB_FIND (job)->current_page;
+
+	ev_profiler_start_full (EV_PROFILE_JOBS, job->document, page,
+				"%s (%p)", EV_GET_TYPE_NAME (job), job);
+}
+
 /* EvJob */
 static void
 ev_job_init (EvJob *job)
@@ -197,6 +239,10 @@ ev_job_emit_finished (EvJob *job)
 	job->finished = TRUE;
 	
 	if (job->run_mode == EV_JOB_RUN_THREAD) {
+		/* Jobs coalesced with this one get their copy of the
+		 * result before it's handed to the main thread.
+		 */
+		_ev_job_scheduler_job_finishing (job);
 		job->idle_finished_id =
 			g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
 					 (GSourceFunc)emit_finished,
@@ -383,7 +429,7 @@ ev_job_links_run (EvJob *job)
 	EvJobLinks *job_links = EV_JOB_LINKS (job);
 
 	ev_debug_message (DEBUG_JOBS, NULL);
-	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+	ev_job_profiler_start (job);
 	
 	ev_document_doc_mutex_lock ();
 	job_links->model = ev_document_links_get_links_model (EV_DOCUMENT_LINKS (job->document));
@@ -466,7 +512,7 @@ ev_job_attachments_run (EvJob *job)
 	EvJobAttachments *job_attachments = EV_JOB_ATTACHMENTS (job);
 
 	ev_debug_message (DEBUG_JOBS, NULL);
-	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+	ev_job_profiler_start (job);
 
 	ev_document_doc_mutex_lock ();
 	job_attachments->attachments =
@@ -526,32 +572,89 @@ ev_job_annots_dispose (GObject *object)
 	G_OBJECT_CLASS (ev_job_annots_parent_class)->dispose (object);
 }
 
+/* Number of pages whose annotations are loaded while holding the
+ * document mutex, before letting other jobs run.
+ */
+#define ANNOTS_BATCH_SIZE 20
+
+typedef struct {
+	EvJobAnnots *job;
+	GList       *annots;
+} EvJobAnnotsUpdate;
+
+static void
+ev_job_annots_update_free (EvJobAnnotsUpdate *update)
+{
+	g_list_free_full (update->annots, (GDestroyNotify)ev_mapping_list_unref);
+	g_object_unref (update->job);
+	g_slice_free (EvJobAnnotsUpdate, update);
+}
+
+/* The annotations are only added to the job in the main thread,
+ * so that job->annots is not modified while being read there.
+ */
+static gboolean
+ev_job_annots_emit_updated (EvJobAnnotsUpdate *update)
+{
+	EvJobAnnots *job_annots = update->job;
+
+	if (EV_JOB (job_annots)->cancelled)
+		return FALSE;
+
+	g_signal_emit (job_annots, job_annots_signals[ANNOTS_UPDATED], 0, update->annots);
+	job_annots->annots = g_list_concat (job_annots->annots, update->annots);
+	update->annots = NULL;
+
+	return FALSE;
+}
+
 static gboolean
 ev_job_annots_run (EvJob *job)
 {
 	EvJobAnnots *job_annots = EV_JOB_ANNOTS (job);
-	gint         i;
+	GList       *annots = NULL;
+	gint         n_pages;
+	gint         last_page;
 
-	ev_debug_message (DEBUG_JOBS, NULL);
-	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+	ev_debug_message (DEBUG_JOBS, "page: %d", job_annots->current_page);
 
 	ev_document_doc_mutex_lock ();
-	for (i = 0; i < ev_document_get_n_pages (job->document); i++) {
+
+	if (job_annots->current_page == 0)
+		ev_job_profiler_start (job);
+
+	n_pages = ev_document_get_n_pages (job->document);
+	last_page = MIN (job_annots->current_page + ANNOTS_BATCH_SIZE, n_pages);
+	for (; job_annots->current_page < last_page; job_annots->current_page++) {
 		EvMappingList *mapping_list;
 		EvPage        *page;
 
-		page = ev_document_get_page (job->document, i);
+		page = ev_document_get_page (job->document, job_annots->current_page);
 		mapping_list = ev_document_annotations_get_annotations (EV_DOCUMENT_ANNOTATIONS (job->document),
 									page);
 		g_object_unref (page);
 
 		if (mapping_list)
-			job_annots->annots = g_list_prepend (job_annots->annots, mapping_list);
+			annots = g_list_prepend (annots, mapping_list);
 	}
 	ev_document_doc_mutex_unlock ();
 
-	job_annots->annots = g_list_reverse (job_annots->annots);
+	if (annots) {
+		EvJobAnnotsUpdate *update;
+
+		update = g_slice_new (EvJobAnnotsUpdate);
+		update->job = g_object_ref (job_annots);
+		update->annots = g_list_reverse (annots);
+		g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+				 (GSourceFunc)ev_job_annots_emit_updated,
+				 update,
+				 (GDestroyNotify)ev_job_annots_update_free);
+	}
+
+	if (job_annots->current_page < n_pages)
+		return TRUE;
 
+	/* Emitted after the last update, both are idles of the same priority */
 	ev_job_succeeded (job);
 
 	return FALSE;
@@ -565,6 +668,16 @@ ev_job_annots_class_init (EvJobAnnotsClass *class)
 
 	oclass->dispose = ev_job_annots_dispose;
 	job_class->run = ev_job_annots_run;
+
+	job_annots_signals[ANNOTS_UPDATED] =
+		g_signal_new ("updated",
+			      EV_TYPE_JOB_ANNOTS,
+			      G_SIGNAL_RUN_LAST,
+			      G_STRUCT_OFFSET (EvJobAnnotsClass, updated),
+			      NULL, NULL,
+			      g_cclosure_marshal_VOID__POINTER,
+			      G_TYPE_NONE,
+			      1, G_TYPE_POINTER);
 }
 
 EvJob *
@@ -622,11 +735,10 @@ ev_job_render_run (EvJob *job)
 	EvRenderContext *rc;
 
 	ev_debug_message (DEBUG_JOBS, "page: %d (%p)", job_render->page, job);
-	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+	ev_job_profiler_start (job);
 	
 	ev_document_doc_mutex_lock ();
 
-	ev_profiler_start (EV_PROFILE_JOBS, "Rendering page %d", job_render->page);
 		
 	ev_document_fc_mutex_lock ();
 
@@ -634,10 +746,20 @@ ev_job_render_run (EvJob *job)
 	rc = ev_render_context_new (ev_page, job_render->rotation, job_render->scale);
 	ev_render_context_set_target_size (rc,
 					   job_render->target_width, job_render->target_height);
+	ev_render_context_set_cancellable (rc, job->cancellable);
 	g_object_unref (ev_page);
 
 	job_render->surface = ev_document_render (job->document, rc);
 
+	/* Backends stop early when the job is cancelled, that's not an error */
+	if (job_render->surface == NULL && g_cancellable_is_cancelled (job->cancellable)) {
+		ev_document_fc_mutex_unlock ();
+		ev_document_doc_mutex_unlock ();
+		g_object_unref (rc);
+
+		return FALSE;
+	}
+
 	if (job_render->surface == NULL) {
 		ev_document_fc_mutex_unlock ();
 		ev_document_doc_mutex_unlock ();
@@ -737,6 +859,407 @@ ev_job_render_set_selection_info (EvJobRender     *job,
 	job->base = *base;
 }
 
+/* EvJobRenderBatch */
+
+/* The document lock is released every this many microseconds, so
+ * that the main thread is not kept waiting for a whole batch.
+ */
+#define RENDER_BATCH_SLICE (50 * 1000)
+
+typedef struct {
+	gint             page;
+	gint             rotation;
+	gdouble          scale;
+	gint             target_width;
+	gint             target_height;
+	cairo_surface_t *surface;
+	GError          *error;
+} EvJobRenderBatchItem;
+
+typedef struct {
+	EvJobRenderBatch *job;
+	guint             index;
+	cairo_surface_t  *surface;
+	GError           *error;
+} EvJobRenderBatchUpdate;
+
+static void
+ev_job_render_batch_init (EvJobRenderBatch *job)
+{
+	EV_JOB (job)->run_mode = EV_JOB_RUN_THREAD;
+
+	job->items = g_array_new (FALSE, FALSE, sizeof (EvJobRenderBatchItem));
+}
+
+static void
+ev_job_render_batch_dispose (GObject *object)
+{
+	EvJobRenderBatch *job = EV_JOB_RENDER_BATCH (object);
+	guint             i;
+
+	ev_debug_message (DEBUG_JOBS, "%d pages (%p)", job->items ? job->items->len : 0, job);
+
+	if (job->items) {
+		for (i = 0; i < job->items->len; i++) {
+			EvJobRenderBatchItem *item;
+
+			item = &g_array_index (job->items, EvJobRenderBatchItem, i);
+			g_clear_pointer (&item->surface, cairo_surface_destroy);
+			g_clear_error (&item->error);
+		}
+		g_array_free (job->items, TRUE);
+		job->items = NULL;
+	}
+
+	(* G_OBJECT_CLASS (ev_job_render_batch_parent_class)->dispose) (object);
+}
+
+static void
+ev_job_render_batch_update_free (EvJobRenderBatchUpdate *update)
+{
+	if (update->surface)
+		cairo_surface_destroy (update->surface);
+	g_clear_error (&update->error);
+	g_object_unref (update->job);
+	g_slice_free (EvJobRenderBatchUpdate, update);
+}
+
+/* Like for EvJobAnnots, the surfaces are only added to the job
+ * in the main thread, where they are read.
+ */
+static gboolean
+ev_job_render_batch_emit_page_ready (EvJobRenderBatchUpdate *update)
+{
+	EvJobRenderBatch     *job_batch = update->job;
+	EvJobRenderBatchItem *item;
+
+	if (EV_JOB (job_batch)->cancelled)
+		return FALSE;
+
+	item = &g_array_index (job_batch->items, EvJobRenderBatchItem, update->index);
+	item->surface = update->surface;
+	update->surface = NULL;
+	item->error = update->error;
+	update->error = NULL;
+
+	g_signal_emit (job_batch, job_render_batch_signals[RENDER_BATCH_PAGE_READY], 0,
+		       update->index);
+
+	return FALSE;
+}
+
+static gboolean
+ev_job_render_batch_run (EvJob *job)
+{
+	EvJobRenderBatch *job_batch = EV_JOB_RENDER_BATCH (job);
+	EvRenderContext  *rc = NULL;
+	EvPage           *ev_page = NULL;
+	gint64            start;
+
+	ev_debug_message (DEBUG_JOBS, "page %d of %d (%p)",
+			  job_batch->n_rendered, job_batch->items->len, job);
+
+	if (job_batch->n_rendered == 0)
+		ev_job_profiler_start (job);
+
+	ev_document_doc_mutex_lock ();
+	ev_document_fc_mutex_lock ();
+
+	start = g_get_monotonic_time ();
+	while (job_batch->n_rendered < job_batch->items->len) {
+		EvJobRenderBatchItem   *item;
+		EvJobRenderBatchUpdate *update;
+		cairo_surface_t        *surface;
+
+		if (g_cancellable_is_cancelled (job->cancellable))
+			break;
+
+		item = &g_array_index (job_batch->items, EvJobRenderBatchItem,
+				       job_batch->n_rendered);
+
+		/* Consecutive requests for the same page, like an export
+		 * at several sizes, share the page and its backend page.
+		 */
+		if (!ev_page || ev_page->index != item->page) {
+			g_clear_object (&ev_page);
+			ev_page = ev_document_get_page (job->document, item->page);
+		}
+
+		if (!rc) {
+			rc = ev_render_context_new (ev_page, item->rotation, item->scale);
+			ev_render_context_set_cancellable (rc, job->cancellable);
+		} else {
+			ev_render_context_set_page (rc, ev_page);
+			ev_render_context_set_rotation (rc, item->rotation);
+			ev_render_context_set_scale (rc, item->scale);
+		}
+		ev_render_context_set_target_size (rc, item->target_width, item->target_height);
+
+		/* Requests with a target size are thumbnails, which some
+		 * backends take from the document instead of rendering.
+		 */
+		if (item->target_width > 0 || item->target_height > 0)
+			surface = ev_document_get_thumbnail_surface (job->document, rc);
+		else
+			surface = ev_document_render (job->document, rc);
+		if (g_cancellable_is_cancelled (job->cancellable)) {
+			if (surface)
+				cairo_surface_destroy (surface);
+			break;
+		}
+
+		update = g_slice_new0 (EvJobRenderBatchUpdate);
+		update->job = g_object_ref (job_batch);
+		update->index = job_batch->n_rendered++;
+		update->surface = surface;
+		if (!surface) {
+			g_set_error (&update->error,
+				     EV_DOCUMENT_ERROR,
+				     EV_DOCUMENT_ERROR_INVALID,
+				     _("Failed to render page %d"),
+				     item->page);
+		}
+		g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+				 (GSourceFunc)ev_job_render_batch_emit_page_ready,
+				 update,
+				 (GDestroyNotify)ev_job_render_batch_update_free);
+
+		if (g_get_monotonic_time () - start >= RENDER_BATCH_SLICE)
+			break;
+	}
+
+	g_clear_object (&rc);
+	g_clear_object (&ev_page);
+
+	ev_document_fc_mutex_unlock ();
+	ev_document_doc_mutex_unlock ();
+
+	if (g_cancellable_is_cancelled (job->cancellable))
+		return FALSE;
+
+	if (job_batch->n_rendered < job_batch->items->len)
+		return TRUE;
+
+	/* Emitted after the last page-ready, both are idles of the same priority */
+	ev_job_succeeded (job);
+
+	return FALSE;
+}
+
+static void
+ev_job_render_batch_class_init (EvJobRenderBatchClass *class)
+{
+	GObjectClass *oclass = G_OBJECT_CLASS (class);
+	EvJobClass   *job_class = EV_JOB_CLASS (class);
+
+	oclass->dispose = ev_job_render_batch_dispose;
+	job_class->run = ev_job_render_batch_run;
+
+	/**
+	 * EvJobRenderBatch::page-ready:
+	 * @job: the #EvJobRenderBatch
+	 * @index: the index of the request that has been rendered
+	 *
+	 * Emitted in the main thread, in the order the requests were
+	 * added, as soon as each of them is rendered, or rendering it
+	 * failed. ev_job_render_batch_get_surface() and
+	 * ev_job_render_batch_get_error() return the result.
+	 *
+	 * Since: 3.32
+	 */
+	job_render_batch_signals[RENDER_BATCH_PAGE_READY] =
+		g_signal_new ("page-ready",
+			      EV_TYPE_JOB_RENDER_BATCH,
+			      G_SIGNAL_RUN_LAST,
+			      G_STRUCT_OFFSET (EvJobRenderBatchClass, page_ready),
+			      NULL, NULL,
+			      g_cclosure_marshal_VOID__UINT,
+			      G_TYPE_NONE,
+			      1, G_TYPE_UINT);
+}
+
+/**
+ * ev_job_render_batch_new:
+ * @document: an #EvDocument
+ *
+ * Creates a job rendering a list of pages, added with
+ * ev_job_render_batch_add(), in order. The pages are rendered taking
+ * the document lock once for several of them, and reusing the page
+ * objects of the backend between requests for the same page, which
+ * makes it cheaper than one #EvJobRender per page for thumbnails,
+ * prefetching or exporting.
+ *
+ * Returns: (transfer full): a new #EvJobRenderBatch
+ *
+ * Since: 3.32
+ */
+EvJob *
+ev_job_render_batch_new (EvDocument *document)
+{
+	EvJob *job;
+
+	ev_debug_message (DEBUG_JOBS, NULL);
+
+	job = g_object_new (EV_TYPE_JOB_RENDER_BATCH, NULL);
+	job->document = g_object_ref (document);
+
+	return job;
+}
+
+static guint
+ev_job_render_batch_add_item (EvJobRenderBatch *job,
+			      gint              page,
+			      gint              rotation,
+			      gdouble           scale,
+			      gint              target_width,
+			      gint              target_height)
+{
+	EvJobRenderBatchItem item;
+
+	item.page = page;
+	item.rotation = rotation;
+	item.scale = scale;
+	item.target_width = target_width;
+	item.target_height = target_height;
+	item.surface = NULL;
+	item.error = NULL;
+	g_array_append_val (job->items, item);
+
+	return job->items->len - 1;
+}
+
+/**
+ * ev_job_render_batch_add:
+ * @job: an #EvJobRenderBatch
+ * @page: the page to render
+ * @rotation: the rotation
+ * @scale: the scale
+ *
+ * Adds a request to render @page to @job. Requests can only be added
+ * before @job is scheduled.
+ *
+ * Returns: the index of the request, passed to #EvJobRenderBatch::page-ready
+ *
+ * Since: 3.32
+ */
+guint
+ev_job_render_batch_add (EvJobRenderBatch *job,
+			 gint              page,
+			 gint              rotation,
+			 gdouble           scale)
+{
+	g_return_val_if_fail (EV_IS_JOB_RENDER_BATCH (job), 0);
+	g_return_val_if_fail (job->n_rendered == 0, 0);
+
+	return ev_job_render_batch_add_item (job, page, rotation, scale, -1, -1);
+}
+
+/**
+ * ev_job_render_batch_add_with_target_size:
+ * @job: an #EvJobRenderBatch
+ * @page: the page to render
+ * @rotation: the rotation
+ * @target_width: the width of the rendered page
+ * @target_height: the height of the rendered page
+ *
+ * Like ev_job_render_batch_add(), rendering a thumbnail of @page at a
+ * given size, like #EvJobThumbnail does.
+ *
+ * Returns: the index of the request, passed to #EvJobRenderBatch::page-ready
+ *
+ * Since: 3.32
+ */
+guint
+ev_job_render_batch_add_with_target_size (EvJobRenderBatch *job,
+					  gint              page,
+					  gint              rotation,
+					  gint              target_width,
+					  gint              target_height)
+{
+	g_return_val_if_fail (EV_IS_JOB_RENDER_BATCH (job), 0);
+	g_return_val_if_fail (job->n_rendered == 0, 0);
+
+	return ev_job_render_batch_add_item (job, page, rotation, 1.,
+					     target_width, target_height);
+}
+
+/**
+ * ev_job_render_batch_get_n_items:
+ * @job: an #EvJobRenderBatch
+ *
+ * Returns: the number of requests added to @job
+ *
+ * Since: 3.32
+ */
+guint
+ev_job_render_batch_get_n_items (EvJobRenderBatch *job)
+{
+	g_return_val_if_fail (EV_IS_JOB_RENDER_BATCH (job), 0);
+
+	return job->items->len;
+}
+
+/**
+ * ev_job_render_batch_get_page:
+ * @job: an #EvJobRenderBatch
+ * @index: the index of a request
+ *
+ * Returns: the page of the request at @index
+ *
+ * Since: 3.32
+ */
+gint
+ev_job_render_batch_get_page (EvJobRenderBatch *job,
+			      guint             index)
+{
+	g_return_val_if_fail (EV_IS_JOB_RENDER_BATCH (job), -1);
+	g_return_val_if_fail (index < job->items->len, -1);
+
+	return g_array_index (job->items, EvJobRenderBatchItem, index).page;
+}
+
+/**
+ * ev_job_render_batch_get_surface:
+ * @job: an #EvJobRenderBatch
+ * @index: the index of a request
+ *
+ * Returns: (transfer none) (nullable): the rendered page of the request
+ *   at @index, or %NULL if it hasn't been rendered yet or rendering it
+ *   failed
+ *
+ * Since: 3.32
+ */
+cairo_surface_t *
+ev_job_render_batch_get_surface (EvJobRenderBatch *job,
+				 guint             index)
+{
+	g_return_val_if_fail (EV_IS_JOB_RENDER_BATCH (job), NULL);
+	g_return_val_if_fail (index < job->items->len, NULL);
+
+	return g_array_index (job->items, EvJobRenderBatchItem, index).surface;
+}
+
+/**
+ * ev_job_render_batch_get_error:
+ * @job: an #EvJobRenderBatch
+ * @index: the index of a request
+ *
+ * Returns: (transfer none) (nullable): the reason rendering the request
+ *   at @index failed, or %NULL if it didn't fail or hasn't been
+ *   rendered yet
+ *
+ * Since: 3.32
+ */
+const GError *
+ev_job_render_batch_get_error (EvJobRenderBatch *job,
+			       guint             index)
+{
+	g_return_val_if_fail (EV_IS_JOB_RENDER_BATCH (job), NULL);
+	g_return_val_if_fail (index < job->items->len, NULL);
+
+	return g_array_index (job->items, EvJobRenderBatchItem, index).error;
+}
+
 /* EvJobPageData */
 static void
 ev_job_page_data_init (EvJobPageData *job)
@@ -744,6 +1267,11 @@ ev_job_page_data_init (EvJobPageData *job)
 	EV_JOB (job)->run_mode = EV_JOB_RUN_THREAD;
 }
 
+#define EV_PAGE_DATA_INCLUDE_TEXT_MASK (EV_PAGE_DATA_INCLUDE_TEXT |		\
+					EV_PAGE_DATA_INCLUDE_TEXT_MAPPING |	\
+					EV_PAGE_DATA_INCLUDE_TEXT_LAYOUT |	\
+					EV_PAGE_DATA_INCLUDE_TEXT_ATTRS)
+
 static gboolean
 ev_job_page_data_run (EvJob *job)
 {
@@ -751,26 +1279,26 @@ ev_job_page_data_run (EvJob *job)
 	EvPage        *ev_page;
 
 	ev_debug_message (DEBUG_JOBS, "page: %d (%p)", job_pd->page, job);
-	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+	ev_job_profiler_start (job);
 
 	ev_document_doc_mutex_lock ();
 	ev_page = ev_document_get_page (job->document, job_pd->page);
 
-	if ((job_pd->flags & EV_PAGE_DATA_INCLUDE_TEXT_MAPPING) && EV_IS_DOCUMENT_TEXT (job->document))
-		job_pd->text_mapping =
-			ev_document_text_get_text_mapping (EV_DOCUMENT_TEXT (job->document), ev_page);
-	if ((job_pd->flags & EV_PAGE_DATA_INCLUDE_TEXT) && EV_IS_DOCUMENT_TEXT (job->document))
-		job_pd->text =
-			ev_document_text_get_text (EV_DOCUMENT_TEXT (job->document), ev_page);
-	if ((job_pd->flags & EV_PAGE_DATA_INCLUDE_TEXT_LAYOUT) && EV_IS_DOCUMENT_TEXT (job->document))
-		ev_document_text_get_text_layout (EV_DOCUMENT_TEXT (job->document),
-						  ev_page,
-						  &(job_pd->text_layout),
-						  &(job_pd->text_layout_length));
-	if ((job_pd->flags & EV_PAGE_DATA_INCLUDE_TEXT_ATTRS) && EV_IS_DOCUMENT_TEXT (job->document))
-		job_pd ->text_attrs =
-			ev_document_text_get_text_attrs (EV_DOCUMENT_TEXT (job->document),
-							 ev_page);
+	if ((job_pd->flags & EV_PAGE_DATA_INCLUDE_TEXT_MASK) && EV_IS_DOCUMENT_TEXT (job->document)) {
+		gboolean include_layout = (job_pd->flags & EV_PAGE_DATA_INCLUDE_TEXT_LAYOUT) != 0;
+
+		/* Get all the text data in one go, so backends extract the page text once */
+		ev_document_text_get_text_data (EV_DOCUMENT_TEXT (job->document),
+						ev_page,
+						(job_pd->flags & EV_PAGE_DATA_INCLUDE_TEXT) ?
+						&(job_pd->text) : NULL,
+						include_layout ? &(job_pd->text_layout) : NULL,
+						include_layout ? &(job_pd->text_layout_length) : NULL,
+						(job_pd->flags & EV_PAGE_DATA_INCLUDE_TEXT_MAPPING) ?
+						&(job_pd->text_mapping) : NULL,
+						(job_pd->flags & EV_PAGE_DATA_INCLUDE_TEXT_ATTRS) ?
+						&(job_pd->text_attrs) : NULL);
+	}
         if ((job_pd->flags & EV_PAGE_DATA_INCLUDE_TEXT_LOG_ATTRS) && job_pd->text) {
                 job_pd->text_log_attrs_length = g_utf8_strlen (job_pd->text, -1);
                 job_pd->text_log_attrs = g_new0 (PangoLogAttr, job_pd->text_log_attrs_length + 1);
@@ -869,7 +1397,7 @@ ev_job_thumbnail_run (EvJob *job)
 	EvPage          *page;
 
 	ev_debug_message (DEBUG_JOBS, "%d (%p)", job_thumb->page, job);
-	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+	ev_job_profiler_start (job);
 	
 	ev_document_doc_mutex_lock ();
 
@@ -877,6 +1405,7 @@ ev_job_thumbnail_run (EvJob *job)
 	rc = ev_render_context_new (page, job_thumb->rotation, job_thumb->scale);
 	ev_render_context_set_target_size (rc,
 					   job_thumb->target_width, job_thumb->target_height);
+	ev_render_context_set_cancellable (rc, job->cancellable);
 	g_object_unref (page);
 
         if (job_thumb->format == EV_JOB_THUMBNAIL_PIXBUF)
@@ -893,6 +1422,9 @@ ev_job_thumbnail_run (EvJob *job)
                 g_object_unref (pixbuf);
         }
 
+	if (g_cancellable_is_cancelled (job->cancellable))
+		return FALSE;
+
 	if ((job_thumb->format == EV_JOB_THUMBNAIL_PIXBUF && pixbuf == NULL) ||
 	     job_thumb->thumbnail_surface == NULL) {
 		ev_job_failed (job,
@@ -1009,11 +1541,8 @@ ev_job_fonts_run (EvJob *job)
 	if (!ev_document_fc_mutex_trylock ())
 		return TRUE;
 
-#ifdef EV_ENABLE_DEBUG
-	/* We use the #ifdef in this case because of the if */
 	if (ev_document_fonts_get_progress (fonts) == 0)
-		ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
-#endif
+		ev_job_profiler_start (job);
 
 	job_fonts->scan_completed = !ev_document_fonts_scan (fonts, 20);
 	g_signal_emit (job_fonts, job_fonts_signals[FONTS_UPDATED], 0,
@@ -1094,7 +1623,7 @@ ev_job_load_run (EvJob *job)
 	GError    *error = NULL;
 	
 	ev_debug_message (DEBUG_JOBS, "%s", job_load->uri);
-	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+	ev_job_profiler_start (job);
 	
 	ev_document_fc_mutex_lock ();
 
@@ -1218,7 +1747,7 @@ ev_job_load_stream_run (EvJob *job)
         EvJobLoadStream *job_load_stream = EV_JOB_LOAD_STREAM (job);
         GError *error = NULL;
 
-        ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+        ev_job_profiler_start (job);
 
         ev_document_fc_mutex_lock ();
 
@@ -1362,7 +1891,7 @@ ev_job_load_gfile_run (EvJob *job)
         EvJobLoadGFile *job_load_gfile = EV_JOB_LOAD_GFILE (job);
         GError    *error = NULL;
 
-        ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+        ev_job_profiler_start (job);
 
         ev_document_fc_mutex_lock ();
 
@@ -1501,7 +2030,7 @@ ev_job_save_run (EvJob *job)
 	GError    *error = NULL;
 	
 	ev_debug_message (DEBUG_JOBS, "uri: %s, document_uri: %s", job_save->uri, job_save->document_uri);
-	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+	ev_job_profiler_start (job);
 
         fd = ev_mkstemp ("saveacopy.XXXXXX", &tmp_filename, &error);
         if (fd == -1) {
@@ -1665,11 +2194,8 @@ ev_job_find_run (EvJob *job)
 	if (!ev_document_doc_mutex_trylock ())
 		return TRUE;
 	
-#ifdef EV_ENABLE_DEBUG
-	/* We use the #ifdef in this case because of the if */
 	if (job_find->current_page == job_find->start_page)
-		ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
-#endif
+		ev_job_profiler_start (job);
 
 	ev_page = ev_document_get_page (job->document, job_find->current_page);
 	matches = ev_document_find_find_text_with_options (find, ev_page, job_find->text,
@@ -1846,7 +2372,7 @@ ev_job_layers_run (EvJob *job)
 	EvJobLayers *job_layers = EV_JOB_LAYERS (job);
 
 	ev_debug_message (DEBUG_JOBS, NULL);
-	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+	ev_job_profiler_start (job);
 	
 	ev_document_doc_mutex_lock ();
 	job_layers->model = ev_document_layers_get_layers (EV_DOCUMENT_LAYERS (job->document));
@@ -1914,7 +2440,7 @@ ev_job_export_run (EvJob *job)
 	g_assert (job_export->page != -1);
 
 	ev_debug_message (DEBUG_JOBS, NULL);
-	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+	ev_job_profiler_start (job);
 	
 	ev_document_doc_mutex_lock ();
 	
@@ -2005,7 +2531,7 @@ ev_job_print_run (EvJob *job)
 	g_assert (job_print->cr != NULL);
 
 	ev_debug_message (DEBUG_JOBS, NULL);
-	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+	ev_job_profiler_start (job);
 
 	job->failed = FALSE;
 	job->finished = FALSE;
@@ -39,6 +39,9 @@ typedef struct _EvJobClass EvJobClass;
 typedef struct _EvJobRender EvJobRender;
 typedef struct _EvJobRenderClass EvJobRenderClass;
 
+typedef struct _EvJobRenderBatch EvJobRenderBatch;
+typedef struct _EvJobRenderBatchClass EvJobRenderBatchClass;
+
 typedef struct _EvJobPageData EvJobPageData;
 typedef struct _EvJobPageDataClass EvJobPageDataClass;
 
@@ -116,6 +119,13 @@ typedef struct _EvJobPrintClass EvJobPrintClass;
 #define EV_IS_JOB_RENDER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), EV_TYPE_JOB_RENDER))
 #define EV_JOB_RENDER_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), EV_TYPE_JOB_RENDER, EvJobRenderClass))
 
+#define EV_TYPE_JOB_RENDER_BATCH            (ev_job_render_batch_get_type())
+#define EV_JOB_RENDER_BATCH(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), EV_TYPE_JOB_RENDER_BATCH, EvJobRenderBatch))
+#define EV_IS_JOB_RENDER_BATCH(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EV_TYPE_JOB_RENDER_BATCH))
+#define EV_JOB_RENDER_BATCH_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), EV_TYPE_JOB_RENDER_BATCH, EvJobRenderBatchClass))
+#define EV_IS_JOB_RENDER_BATCH_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), EV_TYPE_JOB_RENDER_BATCH))
+#define EV_JOB_RENDER_BATCH_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), EV_TYPE_JOB_RENDER_BATCH, EvJobRenderBatchClass))
+
 #define EV_TYPE_JOB_PAGE_DATA            (ev_job_page_data_get_type())
 #define EV_JOB_PAGE_DATA(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), EV_TYPE_JOB_PAGE_DATA, EvJobPageData))
 #define EV_IS_JOB_PAGE_DATA(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EV_TYPE_JOB_PAGE_DATA))
@@ -258,11 +268,16 @@ struct _EvJobAnnots
 	EvJob parent;
 
 	GList *annots;
+	gint   current_page;
 };
 
 struct _EvJobAnnotsClass
 {
 	EvJobClass parent_class;
+
+	/* Signals */
+	void (* updated) (EvJobAnnots *job,
+			  GList       *annots);
 };
 
 struct _EvJobRender
@@ -292,6 +307,23 @@ struct _EvJobRenderClass
 	EvJobClass parent_class;
 };
 
+struct _EvJobRenderBatch
+{
+	EvJob parent;
+
+	GArray *items;
+	guint   n_rendered;
+};
+
+struct _EvJobRenderBatchClass
+{
+	EvJobClass parent_class;
+
+	/* Signals */
+	void (* page_ready) (EvJobRenderBatch *job,
+			     guint             index);
+};
+
 typedef enum {
         EV_PAGE_DATA_INCLUDE_NONE           = 0,
         EV_PAGE_DATA_INCLUDE_LINKS          = 1 << 0,
@@ -534,6 +566,28 @@ void     ev_job_render_set_selection_info (EvJobRender     *job,
 					   EvSelectionStyle selection_style,
 					   GdkColor        *text,
 					   GdkColor        *base);
+
+/* EvJobRenderBatch */
+GType           ev_job_render_batch_get_type    (void) G_GNUC_CONST;
+EvJob          *ev_job_render_batch_new         (EvDocument       *document);
+guint           ev_job_render_batch_add         (EvJobRenderBatch *job,
+						 gint              page,
+						 gint              rotation,
+						 gdouble           scale);
+guint           ev_job_render_batch_add_with_target_size
+						(EvJobRenderBatch *job,
+						 gint              page,
+						 gint              rotation,
+						 gint              target_width,
+						 gint              target_height);
+guint           ev_job_render_batch_get_n_items (EvJobRenderBatch *job);
+gint            ev_job_render_batch_get_page    (EvJobRenderBatch *job,
+						 guint             index);
+cairo_surface_t *ev_job_render_batch_get_surface (EvJobRenderBatch *job,
+						  guint             index);
+const GError    *ev_job_render_batch_get_error   (EvJobRenderBatch *job,
+						  guint             index);
+
 /* EvJobPageData */
 GType           ev_job_page_data_get_type (void) G_GNUC_CONST;
 EvJob          *ev_job_page_data_new      (EvDocument      *document,
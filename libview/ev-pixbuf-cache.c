@@ -2,6 +2,7 @@
 #include "ev-pixbuf-cache.h"
 #include "ev-job-scheduler.h"
 #include "ev-view-private.h"
+#include "ev-view-marshal.h"
 
 typedef enum {
         SCROLL_DIRECTION_DOWN,
@@ -69,7 +70,9 @@ struct _EvPixbufCacheClass
 {
 	GObjectClass parent_class;
 
-	void (* job_finished) (EvPixbufCache *pixbuf_cache);
+	void (* job_finished) (EvPixbufCache  *pixbuf_cache,
+			       cairo_region_t *region,
+			       gint            page);
 };
 
 
@@ -130,9 +133,10 @@ ev_pixbuf_cache_class_init (EvPixbufCacheClass *class)
 			      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
 			      G_STRUCT_OFFSET (EvPixbufCacheClass, job_finished),
 			      NULL, NULL,
-			      g_cclosure_marshal_VOID__POINTER,
-			      G_TYPE_NONE, 1,
-			      G_TYPE_POINTER);
+			      ev_view_marshal_VOID__POINTER_INT,
+			      G_TYPE_NONE, 2,
+			      G_TYPE_POINTER,
+			      G_TYPE_INT);
 }
 
 static void
@@ -344,7 +348,7 @@ job_finished_cb (EvJob         *job,
 	}
 
 	copy_job_to_job_info (job_render, job_info, pixbuf_cache);
-	g_signal_emit (pixbuf_cache, signals[JOB_FINISHED], 0, job_info->region);
+	g_signal_emit (pixbuf_cache, signals[JOB_FINISHED], 0, job_info->region, job_render->page);
 }
 
 /* This checks a job to see if the job would generate the right sized pixbuf
@@ -431,8 +435,9 @@ move_one_job (CacheJobInfo  *job_info,
 	job_info->region = NULL;
 	job_info->surface = NULL;
 
-	if (new_priority != priority && target_page->job) {
-		ev_job_scheduler_update_job (target_page->job, new_priority);
+	if (target_page->job) {
+		ev_job_scheduler_update_job_full (target_page->job, new_priority,
+						  ev_job_scheduler_get_page_distance (page, start_page, end_page));
 	}
 }
 
@@ -707,7 +712,10 @@ add_job (EvPixbufCache  *pixbuf_cache,
 	g_signal_connect (job_info->job, "finished",
 			  G_CALLBACK (job_finished_cb),
 			  pixbuf_cache);
-	ev_job_scheduler_push_job (job_info->job, priority);
+	ev_job_scheduler_push_job_full (job_info->job, priority,
+					ev_job_scheduler_get_page_distance (page,
+									    pixbuf_cache->start_page,
+									    pixbuf_cache->end_page));
 }
 
 static void
@@ -919,7 +927,7 @@ ev_pixbuf_cache_get_surface (EvPixbufCache *pixbuf_cache,
 	if (job_info->job &&
 	    EV_JOB_RENDER (job_info->job)->page_ready) {
 		copy_job_to_job_info (EV_JOB_RENDER (job_info->job), job_info, pixbuf_cache);
-		g_signal_emit (pixbuf_cache, signals[JOB_FINISHED], 0, job_info->region);
+		g_signal_emit (pixbuf_cache, signals[JOB_FINISHED], 0, job_info->region, page);
 	}
 
 	return job_info->surface;
@@ -203,7 +203,8 @@ static AtkObject *ev_view_get_accessible                     (GtkWidget *widget)
 /*** Drawing ***/
 static void       highlight_find_results                     (EvView             *view,
                                                               cairo_t            *cr,
-							      int                 page);
+							      int                 page,
+							      GdkRectangle       *clip);
 static void       highlight_forward_search_results           (EvView             *view,
                                                               cairo_t            *cr,
 							      int                 page);
@@ -222,6 +223,7 @@ static void       ev_view_change_page                        (EvView
 							      gint                new_page);
 static void       job_finished_cb                            (EvPixbufCache      *pixbuf_cache,
 							      cairo_region_t     *region,
+							      gint                page,
 							      EvView             *view);
 static void       ev_view_page_changed_cb                    (EvDocumentModel    *model,
 							      gint                old_page,
@@ -4645,12 +4647,23 @@ ev_view_draw (GtkWidget *widget,
 		page_area.x -= view->scroll_x;
 		page_area.y -= view->scroll_y;
 
+		/* Pages outside of the damaged area are left alone, with
+		 * their overlays, so that redrawing a page costs the same
+		 * however many pages are visible. Their annotation windows
+		 * are still positioned, since they aren't drawn here.
+		 */
+		if (!gdk_rectangle_intersect (&page_area, &clip_rect, NULL)) {
+			if (EV_IS_DOCUMENT_ANNOTATIONS (view->document))
+				show_annotation_windows (view, i);
+			continue;
+		}
+
 		draw_one_page (view, i, cr, &page_area, &border, &clip_rect, &page_ready);
 
 		if (page_ready && should_draw_caret_cursor (view, i))
 			draw_caret_cursor (view, cr);
 		if (page_ready && view->find_pages && view->highlight_find_results)
-			highlight_find_results (view, cr, i);
+			highlight_find_results (view, cr, i, &clip_rect);
 		if (page_ready && EV_IS_DOCUMENT_ANNOTATIONS (view->document))
 			show_annotation_windows (view, i);
 		if (page_ready && view->focused_element)
@@ -6739,9 +6752,10 @@ draw_rubberband (EvView             *view,
 
 
 static void
-highlight_find_results (EvView *view,
-                        cairo_t *cr,
-                        int page)
+highlight_find_results (EvView       *view,
+                        cairo_t      *cr,
+                        int           page,
+                        GdkRectangle *clip)
 {
 	gint i, n_results = 0;
 
@@ -6750,16 +6764,27 @@ highlight_find_results (EvView *view,
 	for (i = 0; i < n_results; i++) {
 		EvRectangle *rectangle;
 		GdkRectangle view_rectangle;
+		GdkRectangle area;
 		gdouble      alpha;
 
+		rectangle = ev_view_find_get_result (view, page, i);
+		_ev_view_transform_doc_rect_to_view_rect (view, page, rectangle, &view_rectangle);
+
+		/* Results outside of the damaged area are not drawn, the
+		 * border of the rubberband is included. */
+		area.x = view_rectangle.x - view->scroll_x - 1;
+		area.y = view_rectangle.y - view->scroll_y - 1;
+		area.width = view_rectangle.width + 2;
+		area.height = view_rectangle.height + 2;
+		if (!gdk_rectangle_intersect (&area, clip, NULL))
+			continue;
+
 		if (i == view->find_result && page == view->find_page) {
 			alpha = 0.6;
 		} else {
 			alpha = 0.3;
 		}
 
-		rectangle = ev_view_find_get_result (view, page, i);
-		_ev_view_transform_doc_rect_to_view_rect (view, page, rectangle, &view_rectangle);
 		draw_rubberband (view, cr, &view_rectangle, alpha);
         }
 }
@@ -7939,13 +7964,30 @@ ev_view_change_page (EvView *view,
 static void
 job_finished_cb (EvPixbufCache  *pixbuf_cache,
 		 cairo_region_t *region,
+		 gint            page,
 		 EvView         *view)
 {
+	GdkRectangle page_area;
+	GtkBorder    border;
+
 	if (region) {
 		gdk_window_invalidate_region (gtk_widget_get_window (GTK_WIDGET (view)), region, TRUE);
-	} else {
+		return;
+	}
+
+	/* Only the page that has been rendered needs to be redrawn */
+	if (view->start_page >= 0 && (page < view->start_page || page > view->end_page))
+		return;
+
+	if (!ev_view_get_page_extents (view, page, &page_area, &border)) {
 		gtk_widget_queue_draw (GTK_WIDGET (view));
+		return;
 	}
+
+	gtk_widget_queue_draw_area (GTK_WIDGET (view),
+				    page_area.x - view->scroll_x,
+				    page_area.y - view->scroll_y,
+				    page_area.width, page_area.height);
 }
 
 static void
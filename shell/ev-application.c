@@ -36,6 +36,7 @@
 #include <unistd.h>
 
 #include "ev-application.h"
+#include "ev-debug.h"
 #include "ev-file-helpers.h"
 #include "ev-stock-icons.h"
 
@@ -785,6 +786,26 @@ handle_reload_cb (EvEvinceApplication   *object,
 
         return TRUE;
 }
+
+static gboolean
+handle_write_profiler_trace_cb (EvEvinceApplication   *object,
+                                GDBusMethodInvocation *invocation,
+                                const gchar           *filename,
+                                EvApplication         *application)
+{
+        GError *error = NULL;
+
+        /* An empty filename writes to the default file, see ev-debug.h */
+        if (!ev_profiler_write_trace (filename[0] != '\0' ? filename : NULL, &error)) {
+                g_dbus_method_invocation_take_error (invocation, error);
+
+                return TRUE;
+        }
+
+        ev_evince_application_complete_write_profiler_trace (object, invocation);
+
+        return TRUE;
+}
 #endif /* ENABLE_DBUS */
 
 void
@@ -1135,6 +1156,9 @@ ev_application_dbus_register (GApplication    *gapplication,
         g_signal_connect (skeleton, "handle-reload",
                           G_CALLBACK (handle_reload_cb),
                           application);
+        g_signal_connect (skeleton, "handle-write-profiler-trace",
+                          G_CALLBACK (handle_write_profiler_trace_cb),
+                          application);
         application->keys = ev_media_player_keys_new ();
 
         return TRUE;
@@ -58,11 +58,26 @@ struct _EvSidebarAnnotationsPrivate {
 	GtkWidget   *popup;
 
 	EvJob       *job;
+	GtkTreeStore *model;
 	guint        selection_changed_id;
+
+	/* Created on demand while loading */
+	GdkPixbuf   *text_icon;
+	GdkPixbuf   *attachment_icon;
+	GdkPixbuf   *highlight_icon;
+	GdkPixbuf   *strike_out_icon;
+	GdkPixbuf   *underline_icon;
+	GdkPixbuf   *squiggly_icon;
 };
 
 static void ev_sidebar_annotations_page_iface_init (EvSidebarPageInterface *iface);
 static void ev_sidebar_annotations_load            (EvSidebarAnnotations   *sidebar_annots);
+static void ev_sidebar_annotations_clear_icons     (EvSidebarAnnotations   *sidebar_annots);
+static void job_updated_callback                    (EvJobAnnots            *job,
+						    GList                  *annots,
+						    EvSidebarAnnotations   *sidebar_annots);
+static void job_finished_callback                   (EvJobAnnots            *job,
+						    EvSidebarAnnotations   *sidebar_annots);
 static gboolean ev_sidebar_annotations_popup_menu (GtkWidget *widget);
 static gboolean ev_sidebar_annotations_popup_menu_show (EvSidebarAnnotations *sidebar_annots,
 							GdkWindow            *rect_window,
@@ -92,6 +107,19 @@ ev_sidebar_annotations_dispose (GObject *object)
 		priv->document = NULL;
 	}
 
+	if (priv->job) {
+		g_signal_handlers_disconnect_by_func (priv->job,
+						      job_updated_callback,
+						      sidebar_annots);
+		g_signal_handlers_disconnect_by_func (priv->job,
+						      job_finished_callback,
+						      sidebar_annots);
+		ev_job_cancel (priv->job);
+		g_clear_object (&priv->job);
+	}
+
+	g_clear_object (&priv->model);
+	ev_sidebar_annotations_clear_icons (sidebar_annots);
 	g_clear_object (&priv->popup_model);
 	G_OBJECT_CLASS (ev_sidebar_annotations_parent_class)->dispose (object);
 }
@@ -336,34 +364,23 @@ sidebar_tree_button_press_cb (GtkTreeView    *view,
 }
 
 static void
-job_finished_callback (EvJobAnnots          *job,
-		       EvSidebarAnnotations *sidebar_annots)
+ev_sidebar_annotations_clear_icons (EvSidebarAnnotations *sidebar_annots)
 {
-	EvSidebarAnnotationsPrivate *priv;
-	GtkTreeStore *model;
-	GtkTreeSelection *selection;
-	GList *l;
-	GdkPixbuf *text_icon = NULL;
-	GdkPixbuf *attachment_icon = NULL;
-        GdkPixbuf *highlight_icon = NULL;
-        GdkPixbuf *strike_out_icon = NULL;
-        GdkPixbuf *underline_icon = NULL;
-        GdkPixbuf *squiggly_icon = NULL;
-
-	priv = sidebar_annots->priv;
-
-	if (!job->annots) {
-		GtkTreeModel *list;
-
-		list = ev_sidebar_annotations_create_simple_model (_("Document contains no annotations"));
-		gtk_tree_view_set_model (GTK_TREE_VIEW (priv->tree_view), list);
-		g_object_unref (list);
+	EvSidebarAnnotationsPrivate *priv = sidebar_annots->priv;
 
-		g_object_unref (job);
-		priv->job = NULL;
+	g_clear_object (&priv->text_icon);
+	g_clear_object (&priv->attachment_icon);
+	g_clear_object (&priv->highlight_icon);
+	g_clear_object (&priv->strike_out_icon);
+	g_clear_object (&priv->underline_icon);
+	g_clear_object (&priv->squiggly_icon);
+}
 
-		return;
-	}
+static void
+ev_sidebar_annotations_create_model (EvSidebarAnnotations *sidebar_annots)
+{
+	EvSidebarAnnotationsPrivate *priv = sidebar_annots->priv;
+	GtkTreeSelection *selection;
 
 	selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (priv->tree_view));
 	gtk_tree_selection_set_mode (selection, GTK_SELECTION_SINGLE);
@@ -378,12 +395,30 @@ job_finished_callback (EvJobAnnots          *job,
                       sidebar_annots);
 
 
-	model = gtk_tree_store_new (N_COLUMNS,
-				    G_TYPE_STRING,
-				    GDK_TYPE_PIXBUF,
-				    G_TYPE_POINTER);
+	priv->model = gtk_tree_store_new (N_COLUMNS,
+					  G_TYPE_STRING,
+					  GDK_TYPE_PIXBUF,
+					  G_TYPE_POINTER);
+	gtk_tree_view_set_model (GTK_TREE_VIEW (priv->tree_view),
+				 GTK_TREE_MODEL (priv->model));
+}
 
-	for (l = job->annots; l; l = g_list_next (l)) {
+/* Appends the annotations of the pages loaded so far, so that the
+ * sidebar fills while the rest of the document is still loading.
+ */
+static void
+ev_sidebar_annotations_add_annots (EvSidebarAnnotations *sidebar_annots,
+				   GList                *annots)
+{
+	EvSidebarAnnotationsPrivate *priv = sidebar_annots->priv;
+	GtkTreeStore *model;
+	GList *l;
+
+	if (!priv->model)
+		ev_sidebar_annotations_create_model (sidebar_annots);
+	model = priv->model;
+
+	for (l = annots; l; l = g_list_next (l)) {
 		EvMappingList *mapping_list;
 		GList         *ll;
 		gchar         *page_label;
@@ -421,55 +456,55 @@ job_finished_callback (EvJobAnnots          *job,
 			}
 
 			if (EV_IS_ANNOTATION_TEXT (annot)) {
-				if (!text_icon) {
+				if (!priv->text_icon) {
 					/* FIXME: use a better icon than EDIT */
-					text_icon = gtk_widget_render_icon_pixbuf (priv->tree_view,
-                                                                                   GTK_STOCK_EDIT,
-                                                                                   GTK_ICON_SIZE_BUTTON);
+					priv->text_icon = gtk_widget_render_icon_pixbuf (priv->tree_view,
+                                                                                         GTK_STOCK_EDIT,
+                                                                                         GTK_ICON_SIZE_BUTTON);
 				}
-				pixbuf = text_icon;
+				pixbuf = priv->text_icon;
 			} else if (EV_IS_ANNOTATION_ATTACHMENT (annot)) {
-				if (!attachment_icon) {
-					attachment_icon = gtk_widget_render_icon_pixbuf (priv->tree_view,
+				if (!priv->attachment_icon) {
+					priv->attachment_icon = gtk_widget_render_icon_pixbuf (priv->tree_view,
                                                                                          EV_STOCK_ATTACHMENT,
                                                                                          GTK_ICON_SIZE_BUTTON);
 				}
-				pixbuf = attachment_icon;
+				pixbuf = priv->attachment_icon;
 			} else if (EV_IS_ANNOTATION_TEXT_MARKUP (annot)) {
                                 switch (ev_annotation_text_markup_get_markup_type (EV_ANNOTATION_TEXT_MARKUP (annot))) {
                                 case EV_ANNOTATION_TEXT_MARKUP_HIGHLIGHT:
-                                        if (!highlight_icon) {
+                                        if (!priv->highlight_icon) {
                                                 /* FIXME: use better icon than select all */
-                                                highlight_icon = gtk_widget_render_icon_pixbuf (priv->tree_view,
-                                                                                                GTK_STOCK_SELECT_ALL,
-                                                                                                GTK_ICON_SIZE_BUTTON);
+                                                priv->highlight_icon = gtk_widget_render_icon_pixbuf (priv->tree_view,
+                                                                                                      GTK_STOCK_SELECT_ALL,
+                                                                                                      GTK_ICON_SIZE_BUTTON);
                                         }
-                                        pixbuf = highlight_icon;
+                                        pixbuf = priv->highlight_icon;
 
                                         break;
                                 case EV_ANNOTATION_TEXT_MARKUP_STRIKE_OUT:
-                                        if (!strike_out_icon) {
-                                                strike_out_icon = gtk_widget_render_icon_pixbuf (priv->tree_view,
-                                                                                                 GTK_STOCK_STRIKETHROUGH,
-                                                                                                 GTK_ICON_SIZE_BUTTON);
+                                        if (!priv->strike_out_icon) {
+                                                priv->strike_out_icon = gtk_widget_render_icon_pixbuf (priv->tree_view,
+                                                                                                       GTK_STOCK_STRIKETHROUGH,
+                                                                                                       GTK_ICON_SIZE_BUTTON);
                                         }
-                                        pixbuf = strike_out_icon;
+                                        pixbuf = priv->strike_out_icon;
                                         break;
                                 case EV_ANNOTATION_TEXT_MARKUP_UNDERLINE:
-                                        if (!underline_icon) {
-                                                underline_icon = gtk_widget_render_icon_pixbuf (priv->tree_view,
-                                                                                                GTK_STOCK_UNDERLINE,
-                                                                                                GTK_ICON_SIZE_BUTTON);
+                                        if (!priv->underline_icon) {
+                                                priv->underline_icon = gtk_widget_render_icon_pixbuf (priv->tree_view,
+                                                                                                      GTK_STOCK_UNDERLINE,
+                                                                                                      GTK_ICON_SIZE_BUTTON);
                                         }
-                                        pixbuf = underline_icon;
+                                        pixbuf = priv->underline_icon;
                                         break;
                                 case EV_ANNOTATION_TEXT_MARKUP_SQUIGGLY:
-                                        if (!squiggly_icon) {
-                                                squiggly_icon = gtk_widget_render_icon_pixbuf (priv->tree_view,
-                                                                                               GTK_STOCK_UNDERLINE,
-                                                                                               GTK_ICON_SIZE_BUTTON);
+                                        if (!priv->squiggly_icon) {
+                                                priv->squiggly_icon = gtk_widget_render_icon_pixbuf (priv->tree_view,
+                                                                                                     GTK_STOCK_UNDERLINE,
+                                                                                                     GTK_ICON_SIZE_BUTTON);
                                         }
-                                        pixbuf = squiggly_icon;
+                                        pixbuf = priv->squiggly_icon;
                                         break;
                                 }
                         }
@@ -487,23 +522,32 @@ job_finished_callback (EvJobAnnots          *job,
 		if (!found)
 			gtk_tree_store_remove (model, &iter);
 	}
+}
 
-	gtk_tree_view_set_model (GTK_TREE_VIEW (priv->tree_view),
-				 GTK_TREE_MODEL (model));
-	g_object_unref (model);
-
-	if (text_icon)
-		g_object_unref (text_icon);
-	if (attachment_icon)
-		g_object_unref (attachment_icon);
-        if (highlight_icon)
-                g_object_unref (highlight_icon);
-        if (strike_out_icon)
-                g_object_unref (strike_out_icon);
-        if (underline_icon)
-                g_object_unref (underline_icon);
-        if (squiggly_icon)
-                g_object_unref (squiggly_icon);
+static void
+job_updated_callback (EvJobAnnots          *job,
+		      GList                *annots,
+		      EvSidebarAnnotations *sidebar_annots)
+{
+	ev_sidebar_annotations_add_annots (sidebar_annots, annots);
+}
+
+static void
+job_finished_callback (EvJobAnnots          *job,
+		       EvSidebarAnnotations *sidebar_annots)
+{
+	EvSidebarAnnotationsPrivate *priv = sidebar_annots->priv;
+
+	if (!job->annots) {
+		GtkTreeModel *list;
+
+		list = ev_sidebar_annotations_create_simple_model (_("Document contains no annotations"));
+		gtk_tree_view_set_model (GTK_TREE_VIEW (priv->tree_view), list);
+		g_object_unref (list);
+	}
+
+	g_clear_object (&priv->model);
+	ev_sidebar_annotations_clear_icons (sidebar_annots);
 
 	g_object_unref (job);
 	priv->job = NULL;
@@ -515,13 +559,24 @@ ev_sidebar_annotations_load (EvSidebarAnnotations *sidebar_annots)
 	EvSidebarAnnotationsPrivate *priv = sidebar_annots->priv;
 
 	if (priv->job) {
+		g_signal_handlers_disconnect_by_func (priv->job,
+						      job_updated_callback,
+						      sidebar_annots);
 		g_signal_handlers_disconnect_by_func (priv->job,
 						      job_finished_callback,
 						      sidebar_annots);
+		ev_job_cancel (priv->job);
 		g_object_unref (priv->job);
 	}
 
+	/* The annotations of the previous job are replaced by the first ones loaded */
+	g_clear_object (&priv->model);
+	ev_sidebar_annotations_clear_icons (sidebar_annots);
+
 	priv->job = ev_job_annots_new (priv->document);
+	g_signal_connect (priv->job, "updated",
+			  G_CALLBACK (job_updated_callback),
+			  sidebar_annots);
 	g_signal_connect (priv->job, "finished",
 			  G_CALLBACK (job_finished_callback),
 			  sidebar_annots);
@@ -46,6 +46,10 @@
  * limit its use */
 #define MAX_ICON_VIEW_PAGE_COUNT 1500
 
+/* Thumbnails are rendered in batches of this many pages, nearest to
+ * the visible ones first */
+#define THUMBNAIL_BATCH_SIZE 8
+
 typedef struct _EvThumbsSize
 {
 	gint width;
@@ -100,7 +104,8 @@ static void         ev_sidebar_thumbnails_page_iface_init  (EvSidebarPageInterfa
 static const gchar* ev_sidebar_thumbnails_get_label        (EvSidebarPage           *sidebar_page);
 static void         ev_sidebar_thumbnails_set_current_page (EvSidebarThumbnails *sidebar,
 							    gint     page);
-static void         thumbnail_job_completed_callback       (EvJobThumbnail          *job,
+static void         thumbnail_page_ready_callback          (EvJobRenderBatch        *job,
+							    guint                    index,
 							    EvSidebarThumbnails     *sidebar_thumbnails);
 static void         ev_sidebar_thumbnails_reload           (EvSidebarThumbnails     *sidebar_thumbnails);
 static void         adjustment_changed_cb                  (EvSidebarThumbnails     *sidebar_thumbnails);
@@ -432,6 +437,39 @@ ev_sidebar_thumbnails_get_loading_icon (EvSidebarThumbnails *sidebar_thumbnails,
 	return icon;
 }
 
+/* Cancels @job and forgets it in the rows of all its pages, the
+ * ones still in range get a new job from add_range().
+ */
+static void
+cancel_job (EvSidebarThumbnails *sidebar_thumbnails,
+	    EvJobRenderBatch    *job)
+{
+	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
+	guint i;
+
+	g_signal_handlers_disconnect_by_func (job, thumbnail_page_ready_callback, sidebar_thumbnails);
+	ev_job_cancel (EV_JOB (job));
+
+	for (i = 0; i < ev_job_render_batch_get_n_items (job); i++) {
+		GtkTreeIter iter;
+		EvJob *row_job;
+
+		if (!gtk_tree_model_iter_nth_child (GTK_TREE_MODEL (priv->list_store), &iter, NULL,
+						    ev_job_render_batch_get_page (job, i)))
+			continue;
+
+		gtk_tree_model_get (GTK_TREE_MODEL (priv->list_store), &iter,
+				    COLUMN_JOB, &row_job,
+				    -1);
+		if (row_job == EV_JOB (job))
+			gtk_list_store_set (priv->list_store, &iter,
+					    COLUMN_JOB, NULL,
+					    -1);
+		if (row_job)
+			g_object_unref (row_job);
+	}
+}
+
 static void
 cancel_running_jobs (EvSidebarThumbnails *sidebar_thumbnails,
 		     gint                 start_page,
@@ -448,7 +486,7 @@ cancel_running_jobs (EvSidebarThumbnails *sidebar_thumbnails,
 	for (result = gtk_tree_model_get_iter (GTK_TREE_MODEL (priv->list_store), &iter, path);
 	     result && start_page <= end_page;
 	     result = gtk_tree_model_iter_next (GTK_TREE_MODEL (priv->list_store), &iter), start_page ++) {
-		EvJobThumbnail *job;
+		EvJobRenderBatch *job;
 		gboolean thumbnail_set;
 
 		gtk_tree_model_get (GTK_TREE_MODEL (priv->list_store),
@@ -463,15 +501,9 @@ cancel_running_jobs (EvSidebarThumbnails *sidebar_thumbnails,
 		}
 
 		if (job) {
-			g_signal_handlers_disconnect_by_func (job, thumbnail_job_completed_callback, sidebar_thumbnails);
-			ev_job_cancel (EV_JOB (job));
+			cancel_job (sidebar_thumbnails, job);
 			g_object_unref (job);
 		}
-
-		gtk_list_store_set (priv->list_store, &iter,
-				    COLUMN_JOB, NULL,
-				    COLUMN_THUMBNAIL_SET, FALSE,
-				    -1);
 	}
 	gtk_tree_path_free (path);
 }
@@ -502,58 +534,134 @@ get_size_for_page (EvSidebarThumbnails *sidebar_thumbnails,
         }
 }
 
+typedef struct {
+	gint  page;
+	guint distance;
+} PendingThumbnail;
+
+static int
+compare_pending_thumbnails (gconstpointer a,
+			    gconstpointer b)
+{
+	const PendingThumbnail *pa = a;
+	const PendingThumbnail *pb = b;
+
+	if (pa->distance != pb->distance)
+		return pa->distance < pb->distance ? -1 : 1;
+
+	return pa->page - pb->page;
+}
+
+static void
+push_jobs (EvSidebarThumbnails *sidebar_thumbnails,
+	   GArray              *pending)
+{
+	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
+	EvJob *job = NULL;
+	guint distance = 0;
+	guint i;
+
+	g_array_sort (pending, compare_pending_thumbnails);
+
+	for (i = 0; i < pending->len; i++) {
+		PendingThumbnail *thumbnail = &g_array_index (pending, PendingThumbnail, i);
+		GtkTreeIter iter;
+		gint thumbnail_width, thumbnail_height;
+
+		/* Pages are sorted, the first one of a job is its nearest */
+		if (!job) {
+			job = ev_job_render_batch_new (priv->document);
+			g_signal_connect (job, "page-ready",
+					  G_CALLBACK (thumbnail_page_ready_callback),
+					  sidebar_thumbnails);
+			distance = thumbnail->distance;
+		}
+
+		get_size_for_page (sidebar_thumbnails, thumbnail->page,
+				   &thumbnail_width, &thumbnail_height);
+		ev_job_render_batch_add_with_target_size (EV_JOB_RENDER_BATCH (job),
+							  thumbnail->page, priv->rotation,
+							  thumbnail_width, thumbnail_height);
+
+		gtk_tree_model_iter_nth_child (GTK_TREE_MODEL (priv->list_store), &iter, NULL,
+					       thumbnail->page);
+		gtk_list_store_set (priv->list_store, &iter,
+				    COLUMN_JOB, job,
+				    -1);
+
+		if (ev_job_render_batch_get_n_items (EV_JOB_RENDER_BATCH (job)) == THUMBNAIL_BATCH_SIZE ||
+		    i == pending->len - 1) {
+			ev_job_scheduler_push_job_full (job, EV_JOB_PRIORITY_HIGH, distance);
+
+			/* The queue and the list own a ref to the job now */
+			g_object_unref (job);
+			job = NULL;
+		}
+	}
+}
+
 static void
 add_range (EvSidebarThumbnails *sidebar_thumbnails,
 	   gint                 start_page,
-	   gint                 end_page)
+	   gint                 end_page,
+	   gint                 visible_start_page,
+	   gint                 visible_end_page)
 {
 	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
 	GtkTreePath *path;
 	GtkTreeIter iter;
 	gboolean result;
 	gint page = start_page;
+	GArray *pending;
+	GHashTable *running;
+	GHashTableIter running_iter;
+	gpointer job, distance;
 
 	g_assert (start_page <= end_page);
 
+	pending = g_array_new (FALSE, FALSE, sizeof (PendingThumbnail));
+	/* Running jobs, with the distance of their nearest page plus one */
+	running = g_hash_table_new (g_direct_hash, g_direct_equal);
+
 	path = gtk_tree_path_new_from_indices (start_page, -1);
 	for (result = gtk_tree_model_get_iter (GTK_TREE_MODEL (priv->list_store), &iter, path);
 	     result && page <= end_page;
 	     result = gtk_tree_model_iter_next (GTK_TREE_MODEL (priv->list_store), &iter), page ++) {
-		EvJob *job;
+		PendingThumbnail thumbnail;
+		EvJob *row_job;
 		gboolean thumbnail_set;
 
 		gtk_tree_model_get (GTK_TREE_MODEL (priv->list_store), &iter,
-				    COLUMN_JOB, &job,
+				    COLUMN_JOB, &row_job,
 				    COLUMN_THUMBNAIL_SET, &thumbnail_set,
 				    -1);
 
-		if (job == NULL && !thumbnail_set) {
-			gint thumbnail_width, thumbnail_height;
-			get_size_for_page (sidebar_thumbnails, page, &thumbnail_width, &thumbnail_height);
-
-			job = ev_job_thumbnail_new_with_target_size (priv->document,
-								     page, priv->rotation,
-								     thumbnail_width, thumbnail_height);
-                        ev_job_thumbnail_set_has_frame (EV_JOB_THUMBNAIL (job), FALSE);
-                        ev_job_thumbnail_set_output_format (EV_JOB_THUMBNAIL (job), EV_JOB_THUMBNAIL_SURFACE);
-			g_object_set_data_full (G_OBJECT (job), "tree_iter",
-						gtk_tree_iter_copy (&iter),
-						(GDestroyNotify) gtk_tree_iter_free);
-			g_signal_connect (job, "finished",
-					  G_CALLBACK (thumbnail_job_completed_callback),
-					  sidebar_thumbnails);
-			gtk_list_store_set (priv->list_store, &iter,
-					    COLUMN_JOB, job,
-					    -1);
-			ev_job_scheduler_push_job (EV_JOB (job), EV_JOB_PRIORITY_HIGH);
-			
-			/* The queue and the list own a ref to the job now */
-			g_object_unref (job);
-		} else if (job) {
-			g_object_unref (job);
+		thumbnail.page = page;
+		thumbnail.distance = ev_job_scheduler_get_page_distance (page,
+									 visible_start_page,
+									 visible_end_page);
+
+		if (row_job == NULL && !thumbnail_set) {
+			g_array_append_val (pending, thumbnail);
+		} else if (row_job) {
+			distance = g_hash_table_lookup (running, row_job);
+			if (!distance || GPOINTER_TO_UINT (distance) - 1 > thumbnail.distance)
+				g_hash_table_insert (running, row_job,
+						     GUINT_TO_POINTER (thumbnail.distance + 1));
+			g_object_unref (row_job);
 		}
 	}
 	gtk_tree_path_free (path);
+
+	g_hash_table_iter_init (&running_iter, running);
+	while (g_hash_table_iter_next (&running_iter, &job, &distance))
+		ev_job_scheduler_update_job_full (EV_JOB (job), EV_JOB_PRIORITY_HIGH,
+						  GPOINTER_TO_UINT (distance) - 1);
+	g_hash_table_destroy (running);
+
+	if (pending->len > 0)
+		push_jobs (sidebar_thumbnails, pending);
+	g_array_free (pending, TRUE);
 }
 
 /* This modifies start */
@@ -565,6 +673,8 @@ update_visible_range (EvSidebarThumbnails *sidebar_thumbnails,
 	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
 	int old_start_page, old_end_page;
 	int n_pages_in_visible_range;
+	int visible_start_page = start_page;
+	int visible_end_page = end_page;
 
 	/* Preload before and after current visible scrolling range, the same amount of
 	 * thumbs in it, to help prevent thumbnail creation happening in the user's sight.
@@ -587,7 +697,8 @@ update_visible_range (EvSidebarThumbnails *sidebar_thumbnails,
 	if (old_end_page > 0 && old_end_page > end_page)
 		cancel_running_jobs (sidebar_thumbnails, MAX (end_page + 1, old_start_page), old_end_page);
 
-	add_range (sidebar_thumbnails, start_page, end_page);
+	add_range (sidebar_thumbnails, start_page, end_page,
+		   visible_start_page, visible_end_page);
 	
 	priv->start_page = start_page;
 	priv->end_page = end_page;
@@ -966,34 +1077,43 @@ ev_sidebar_thumbnails_inverted_colors_changed_cb (EvDocumentModel     *model,
 }
 
 static void
-thumbnail_job_completed_callback (EvJobThumbnail      *job,
-				  EvSidebarThumbnails *sidebar_thumbnails)
+thumbnail_page_ready_callback (EvJobRenderBatch    *job,
+			       guint                index,
+			       EvSidebarThumbnails *sidebar_thumbnails)
 {
         GtkWidget                  *widget = GTK_WIDGET (sidebar_thumbnails);
 	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
-	GtkTreeIter                *iter;
+	GtkTreeIter                 iter;
+        cairo_surface_t            *thumbnail;
         cairo_surface_t            *surface;
 #ifdef HAVE_HIDPI_SUPPORT
         gint                        device_scale;
 #endif
 
-        if (ev_job_is_failed (EV_JOB (job)))
+	/* Like a failed thumbnail job, the row keeps the job so that
+	 * the page is not tried again.
+	 */
+	thumbnail = ev_job_render_batch_get_surface (job, index);
+        if (!thumbnail)
           return;
 
+	if (!gtk_tree_model_iter_nth_child (GTK_TREE_MODEL (priv->list_store), &iter, NULL,
+					    ev_job_render_batch_get_page (job, index)))
+		return;
+
 #ifdef HAVE_HIDPI_SUPPORT
         device_scale = gtk_widget_get_scale_factor (widget);
-        cairo_surface_set_device_scale (job->thumbnail_surface, device_scale, device_scale);
+        cairo_surface_set_device_scale (thumbnail, device_scale, device_scale);
 #endif
 
         surface = ev_document_misc_render_thumbnail_surface_with_frame (widget,
-                                                                        job->thumbnail_surface,
+                                                                        thumbnail,
                                                                         -1, -1);
 
-	iter = (GtkTreeIter *) g_object_get_data (G_OBJECT (job), "tree_iter");
 	if (priv->inverted_colors)
 		ev_document_misc_invert_surface (surface);
 	gtk_list_store_set (priv->list_store,
-			    iter,
+			    &iter,
 			    COLUMN_SURFACE, surface,
 			    COLUMN_THUMBNAIL_SET, TRUE,
 			    COLUMN_JOB, NULL,
@@ -1106,7 +1226,7 @@ ev_sidebar_thumbnails_clear_job (GtkTreeModel *model,
 	
 	if (job != NULL) {
 		ev_job_cancel (job);
-		g_signal_handlers_disconnect_by_func (job, thumbnail_job_completed_callback, data);
+		g_signal_handlers_disconnect_by_func (job, thumbnail_page_ready_callback, data);
 		g_object_unref (job);
 	}
 	
@@ -6896,6 +6896,21 @@ handle_sync_view_cb (EvEvinceWindow        *object,
 
 	return TRUE;
 }
+
+/* The job scheduler is shared by all windows, so are its stats */
+static gboolean
+handle_get_scheduler_stats_cb (EvEvinceWindow        *object,
+			       GDBusMethodInvocation *invocation,
+			       gboolean               reset,
+			       EvWindow              *window)
+{
+	ev_evince_window_complete_get_scheduler_stats (object, invocation,
+						       ev_job_scheduler_get_stats ());
+	if (reset)
+		ev_job_scheduler_reset_stats ();
+
+	return TRUE;
+}
 #endif /* ENABLE_DBUS */
 
 static gboolean
@@ -6983,6 +6998,9 @@ ev_window_init (EvWindow *ev_window)
 			g_signal_connect (skeleton, "handle-sync-view",
 					  G_CALLBACK (handle_sync_view_cb),
 					  ev_window);
+			g_signal_connect (skeleton, "handle-get-scheduler-stats",
+					  G_CALLBACK (handle_get_scheduler_stats_cb),
+					  ev_window);
                 } else {
                         g_printerr ("Failed to register bus object %s: %s\n",
 				    ev_window->priv->dbus_object_path, error->message);
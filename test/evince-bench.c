@@ -0,0 +1,531 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; c-indent-level: 8 -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Renders every page of the given documents at the given scales and
+ * rotations, and writes the throughput, the latency per page, the
+ * peak RSS and the number of allocations per document and per backend
+ * as JSON. The backends are loaded from the installed backends dir.
+ *
+ * Usage: evince-bench [--scales=1,2] [--rotations=0,90] [--threads=N]
+ *                     [--unlocked] [--output=FILE] FILE...
+ */
+
+#include <config.h>
+
+#include <evince-document.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+static gchar        *scales_option = NULL;
+static gchar        *rotations_option = NULL;
+static gint          n_threads = 1;
+static gboolean      unlocked = FALSE;
+static gchar        *output = NULL;
+static const gchar **file_arguments = NULL;
+
+static const GOptionEntry goption_options[] = {
+	{ "scales", 's', 0, G_OPTION_ARG_STRING, &scales_option,
+	  "Comma separated scales to render every page at (default 1)", "SCALES" },
+	{ "rotations", 'r', 0, G_OPTION_ARG_STRING, &rotations_option,
+	  "Comma separated rotations to render every page with (default 0)", "ROTATIONS" },
+	{ "threads", 't', 0, G_OPTION_ARG_INT, &n_threads,
+	  "Number of threads rendering at the same time (default 1)", "N" },
+	{ "unlocked", 'u', 0, G_OPTION_ARG_NONE, &unlocked,
+	  "Don't hold the document mutex while rendering, only for backends that can render concurrently", NULL },
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+	  "Write the results to FILE instead of the standard output", "FILE" },
+	{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &file_arguments, NULL, "FILE..." },
+	{ NULL }
+};
+
+/* Allocation counting: the program's definitions of the allocator
+ * functions take precedence over the libc ones for every library,
+ * so all the allocations of the backends are counted.
+ */
+#ifdef __GLIBC__
+extern void *__libc_malloc  (size_t size);
+extern void *__libc_calloc  (size_t n_members, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static volatile gint n_allocations = 0;
+
+void *
+malloc (size_t size)
+{
+	g_atomic_int_inc (&n_allocations);
+	return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n_members,
+	size_t size)
+{
+	g_atomic_int_inc (&n_allocations);
+	return __libc_calloc (n_members, size);
+}
+
+void *
+realloc (void  *ptr,
+	 size_t size)
+{
+	if (!ptr)
+		g_atomic_int_inc (&n_allocations);
+	return __libc_realloc (ptr, size);
+}
+
+#define HAVE_ALLOCATION_COUNT 1
+
+static guint
+get_n_allocations (void)
+{
+	return (guint) g_atomic_int_get (&n_allocations);
+}
+#else
+#define HAVE_ALLOCATION_COUNT 0
+
+static guint
+get_n_allocations (void)
+{
+	return 0;
+}
+#endif /* __GLIBC__ */
+
+/* Resets the peak RSS of the process, so that it can be measured
+ * for every document. Only supported on Linux, elsewhere the peak
+ * of the whole run is reported.
+ */
+static void
+reset_peak_rss (void)
+{
+	FILE *file;
+
+	file = fopen ("/proc/self/clear_refs", "w");
+	if (!file)
+		return;
+
+	fputs ("5", file);
+	fclose (file);
+}
+
+/* In KiB */
+static glong
+get_peak_rss (void)
+{
+	struct rusage usage;
+	gchar        *status;
+
+	if (g_file_get_contents ("/proc/self/status", &status, NULL, NULL)) {
+		const gchar *hwm = strstr (status, "VmHWM:");
+		glong        retval = -1;
+
+		if (hwm)
+			retval = atol (hwm + strlen ("VmHWM:"));
+		g_free (status);
+
+		if (retval >= 0)
+			return retval;
+	}
+
+	if (getrusage (RUSAGE_SELF, &usage) != 0)
+		return 0;
+
+	return usage.ru_maxrss;
+}
+
+typedef struct {
+	gchar  *name;
+	guint   n_documents;
+	guint   n_renders;
+	gdouble render_time;
+	GArray *latencies;
+	glong   peak_rss;
+	guint   n_allocations;
+} BenchBackend;
+
+typedef struct {
+	EvDocument *document;
+	gdouble    *scales;
+	gint       *rotations;
+	guint       n_scales;
+	guint       n_rotations;
+	gint        n_pages;
+	gdouble    *latencies;
+	gint        n_failures;
+} BenchDocument;
+
+static void
+bench_backend_free (BenchBackend *backend)
+{
+	g_free (backend->name);
+	g_array_free (backend->latencies, TRUE);
+	g_free (backend);
+}
+
+static void
+render_func (gpointer data,
+	     gpointer user_data)
+{
+	BenchDocument   *bench = (BenchDocument *) user_data;
+	gint             index = GPOINTER_TO_INT (data) - 1;
+	gint             page_index = index % bench->n_pages;
+	gint             variant = index / bench->n_pages;
+	gdouble          scale = bench->scales[variant % bench->n_scales];
+	gint             rotation = bench->rotations[variant / bench->n_scales];
+	EvPage          *page;
+	EvRenderContext *rc;
+	cairo_surface_t *surface;
+	gint64           start;
+
+	start = g_get_monotonic_time ();
+
+	/* Like EvJobRender does */
+	if (!unlocked) {
+		ev_document_doc_mutex_lock ();
+		ev_document_fc_mutex_lock ();
+	}
+
+	page = ev_document_get_page (bench->document, page_index);
+	rc = ev_render_context_new (page, rotation, scale);
+	surface = ev_document_render (bench->document, rc);
+	g_object_unref (rc);
+	g_object_unref (page);
+
+	if (!unlocked) {
+		ev_document_fc_mutex_unlock ();
+		ev_document_doc_mutex_unlock ();
+	}
+
+	bench->latencies[index] = (g_get_monotonic_time () - start) / 1000.0;
+
+	if (surface)
+		cairo_surface_destroy (surface);
+	else
+		g_atomic_int_inc (&bench->n_failures);
+}
+
+static gint
+compare_doubles (gconstpointer a,
+		 gconstpointer b)
+{
+	gdouble da = *(const gdouble *) a;
+	gdouble db = *(const gdouble *) b;
+
+	return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+/* Nearest rank percentile of the sorted @latencies */
+static gdouble
+percentile (const gdouble *latencies,
+	    guint          n_latencies,
+	    guint          p)
+{
+	guint rank;
+
+	if (n_latencies == 0)
+		return 0;
+
+	rank = (p * n_latencies + 99) / 100;
+	rank = CLAMP (rank, 1, n_latencies);
+
+	return latencies[rank - 1];
+}
+
+static void
+append_stats (GString *str,
+	      guint    n_renders,
+	      gdouble  render_time,
+	      GArray  *latencies,
+	      glong    peak_rss,
+	      guint    n_allocations)
+{
+	g_array_sort (latencies, compare_doubles);
+
+	g_string_append_printf (str,
+				"\"renders\": %u, "
+				"\"pages_per_second\": %.2f, "
+				"\"p50_ms\": %.3f, "
+				"\"p99_ms\": %.3f, "
+				"\"peak_rss_kb\": %ld",
+				n_renders,
+				render_time > 0 ? n_renders / render_time : 0,
+				percentile ((gdouble *) latencies->data, latencies->len, 50),
+				percentile ((gdouble *) latencies->data, latencies->len, 99),
+				peak_rss);
+	if (HAVE_ALLOCATION_COUNT)
+		g_string_append_printf (str, ", \"allocations\": %u", n_allocations);
+}
+
+static void
+append_json_string (GString     *str,
+		    const gchar *value)
+{
+	const gchar *p;
+
+	g_string_append_c (str, '"');
+	for (p = value; *p; p++) {
+		if (*p == '"' || *p == '\\')
+			g_string_append_printf (str, "\\%c", *p);
+		else if ((guchar) *p < 0x20)
+			g_string_append_printf (str, "\\u%04x", (guint) *p);
+		else
+			g_string_append_c (str, *p);
+	}
+	g_string_append_c (str, '"');
+}
+
+/* Rotations must be multiples of 90 and scales positive */
+static gboolean
+parse_list (const gchar *option,
+	    const gchar *default_value,
+	    gboolean     rotations,
+	    GArray      *values)
+{
+	gchar  **items;
+	gboolean retval = TRUE;
+	gint     i;
+
+	items = g_strsplit (option ? option : default_value, ",", -1);
+	for (i = 0; items[i] && retval; i++) {
+		gchar *end;
+
+		if (rotations) {
+			gint value = (gint) g_ascii_strtoll (items[i], &end, 10);
+
+			retval = value % 90 == 0;
+			value = ((value % 360) + 360) % 360;
+			g_array_append_val (values, value);
+		} else {
+			gdouble value = g_ascii_strtod (items[i], &end);
+
+			retval = value > 0;
+			g_array_append_val (values, value);
+		}
+
+		retval = retval && end != items[i] && *end == '\0';
+	}
+	g_strfreev (items);
+
+	return retval && values->len > 0;
+}
+
+static BenchBackend *
+get_backend (GHashTable  *backends,
+	     GPtrArray   *backends_order,
+	     const gchar *name)
+{
+	BenchBackend *backend;
+
+	backend = g_hash_table_lookup (backends, name);
+	if (backend)
+		return backend;
+
+	backend = g_new0 (BenchBackend, 1);
+	backend->name = g_strdup (name);
+	backend->latencies = g_array_new (FALSE, FALSE, sizeof (gdouble));
+	g_hash_table_insert (backends, backend->name, backend);
+	g_ptr_array_add (backends_order, backend);
+
+	return backend;
+}
+
+static gboolean
+bench_file (const gchar *filename,
+	    GArray      *scales,
+	    GArray      *rotations,
+	    GHashTable  *backends,
+	    GPtrArray   *backends_order,
+	    GString     *str)
+{
+	BenchDocument  bench;
+	BenchBackend  *backend;
+	GFile         *file;
+	gchar         *uri;
+	GThreadPool   *pool;
+	GArray        *latencies;
+	GError        *error = NULL;
+	gint64         start;
+	gdouble        load_time, render_time;
+	guint          n_allocations;
+	glong          peak_rss;
+	gint           n_renders, i;
+
+	reset_peak_rss ();
+	n_allocations = get_n_allocations ();
+
+	file = g_file_new_for_commandline_arg (filename);
+	uri = g_file_get_uri (file);
+	g_object_unref (file);
+
+	start = g_get_monotonic_time ();
+	bench.document = ev_document_factory_get_document (uri, &error);
+	load_time = (g_get_monotonic_time () - start) / 1000.0;
+	g_free (uri);
+
+	if (!bench.document) {
+		g_printerr ("Failed to load %s: %s\n", filename, error->message);
+		g_error_free (error);
+
+		return FALSE;
+	}
+
+	bench.scales = (gdouble *) scales->data;
+	bench.n_scales = scales->len;
+	bench.rotations = (gint *) rotations->data;
+	bench.n_rotations = rotations->len;
+	bench.n_pages = ev_document_get_n_pages (bench.document);
+	bench.n_failures = 0;
+	n_renders = bench.n_pages * bench.n_scales * bench.n_rotations;
+	bench.latencies = g_new0 (gdouble, n_renders);
+
+	start = g_get_monotonic_time ();
+	pool = g_thread_pool_new (render_func, &bench, n_threads, TRUE, NULL);
+	for (i = 0; i < n_renders; i++)
+		g_thread_pool_push (pool, GINT_TO_POINTER (i + 1), NULL);
+	g_thread_pool_free (pool, FALSE, TRUE);
+	render_time = (g_get_monotonic_time () - start) / (gdouble) G_USEC_PER_SEC;
+
+	peak_rss = get_peak_rss ();
+	n_allocations = get_n_allocations () - n_allocations;
+
+	backend = get_backend (backends, backends_order, G_OBJECT_TYPE_NAME (bench.document));
+	backend->n_documents++;
+	backend->n_renders += n_renders;
+	backend->render_time += render_time;
+	backend->peak_rss = MAX (backend->peak_rss, peak_rss);
+	backend->n_allocations += n_allocations;
+	g_array_append_vals (backend->latencies, bench.latencies, n_renders);
+
+	latencies = g_array_sized_new (FALSE, FALSE, sizeof (gdouble), n_renders);
+	g_array_append_vals (latencies, bench.latencies, n_renders);
+
+	g_string_append (str, "    { \"file\": ");
+	append_json_string (str, filename);
+	g_string_append (str, ", \"backend\": ");
+	append_json_string (str, backend->name);
+	g_string_append_printf (str, ", \"pages\": %d, \"load_ms\": %.3f, \"failures\": %d, ",
+				bench.n_pages, load_time, bench.n_failures);
+	append_stats (str, n_renders, render_time, latencies, peak_rss, n_allocations);
+	g_string_append (str, " }");
+
+	g_array_free (latencies, TRUE);
+	g_free (bench.latencies);
+	g_object_unref (bench.document);
+
+	return TRUE;
+}
+
+gint
+main (gint argc, gchar **argv)
+{
+	GOptionContext *context;
+	GArray         *scales;
+	GArray         *rotations;
+	GHashTable     *backends;
+	GPtrArray      *backends_order;
+	GString        *str;
+	GError         *error = NULL;
+	gboolean        first = TRUE;
+	gint            retval = EXIT_SUCCESS;
+	guint           i;
+
+	context = g_option_context_new ("- Benchmark document rendering");
+	g_option_context_add_main_entries (context, goption_options, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		g_option_context_free (context);
+
+		return EXIT_FAILURE;
+	}
+
+	scales = g_array_new (FALSE, FALSE, sizeof (gdouble));
+	rotations = g_array_new (FALSE, FALSE, sizeof (gint));
+	if (!file_arguments || n_threads < 1 ||
+	    !parse_list (scales_option, "1", FALSE, scales) ||
+	    !parse_list (rotations_option, "0", TRUE, rotations)) {
+		gchar *help;
+
+		help = g_option_context_get_help (context, TRUE, NULL);
+		g_printerr ("%s", help);
+		g_free (help);
+		g_option_context_free (context);
+
+		return EXIT_FAILURE;
+	}
+	g_option_context_free (context);
+
+	if (!ev_init ()) {
+		g_printerr ("No backends found\n");
+
+		return EXIT_FAILURE;
+	}
+
+	backends = g_hash_table_new (g_str_hash, g_str_equal);
+	backends_order = g_ptr_array_new_with_free_func ((GDestroyNotify) bench_backend_free);
+
+	str = g_string_new ("{\n");
+	g_string_append_printf (str, "  \"threads\": %d,\n  \"locked\": %s,\n  \"documents\": [\n",
+				n_threads, unlocked ? "false" : "true");
+	for (i = 0; file_arguments[i]; i++) {
+		gsize len = str->len;
+
+		if (!first)
+			g_string_append (str, ",\n");
+		if (!bench_file (file_arguments[i], scales, rotations, backends, backends_order, str)) {
+			g_string_truncate (str, len);
+			retval = EXIT_FAILURE;
+			continue;
+		}
+		first = FALSE;
+	}
+
+	g_string_append (str, "\n  ],\n  \"backends\": [\n");
+	for (i = 0; i < backends_order->len; i++) {
+		BenchBackend *backend = g_ptr_array_index (backends_order, i);
+
+		g_string_append (str, "    { \"backend\": ");
+		append_json_string (str, backend->name);
+		g_string_append_printf (str, ", \"documents\": %u, ", backend->n_documents);
+		append_stats (str, backend->n_renders, backend->render_time,
+			      backend->latencies, backend->peak_rss, backend->n_allocations);
+		g_string_append (str, i + 1 < backends_order->len ? " },\n" : " }\n");
+	}
+	g_string_append (str, "  ]\n}\n");
+
+	if (output) {
+		if (!g_file_set_contents (output, str->str, str->len, &error)) {
+			g_printerr ("Failed to write %s: %s\n", output, error->message);
+			g_error_free (error);
+			retval = EXIT_FAILURE;
+		}
+	} else {
+		g_print ("%s", str->str);
+	}
+
+	g_string_free (str, TRUE);
+	g_ptr_array_free (backends_order, TRUE);
+	g_hash_table_destroy (backends);
+	g_array_free (scales, TRUE);
+	g_array_free (rotations, TRUE);
+
+	ev_shutdown ();
+
+	return retval;
+}
@@ -0,0 +1,549 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; c-indent-level: 8 -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Shows a document in an EvView inside an offscreen window and plays
+ * scripted scroll, zoom and page jump sequences at a fixed frame rate.
+ * Every frame the view is drawn to an image surface, and the draw time,
+ * whether a visible page had nothing to draw yet, and the time it took
+ * every page to be ready since it became visible are recorded and
+ * written as JSON, with the draw time of every frame in order and
+ * percentiles. It needs a display, use xvfb-run in CI.
+ *
+ * Usage: evince-view-bench [--scripts=scroll,zoom,jump] [--output=FILE] FILE
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtk/gtk.h>
+#include <evince-document.h>
+#include <evince-view.h>
+
+#include "ev-view-private.h"
+
+#define FRAME_TIME    (G_USEC_PER_SEC / 60)
+#define VIEW_WIDTH    1024
+#define VIEW_HEIGHT   768
+#define SCROLL_STEP   40    /* pixels per frame */
+#define SCROLL_FRAMES 600
+#define HOLD_FRAMES   30    /* frames between zooms or page jumps */
+#define N_JUMPS       20
+#define SETTLE_TIME   (5 * G_USEC_PER_SEC)
+
+static const gdouble zoom_scales[] = { 1.0, 2.0, 0.5, 1.5, 1.0 };
+
+static gchar        *scripts_option = NULL;
+static gchar        *output = NULL;
+static const gchar **file_arguments = NULL;
+
+static const GOptionEntry goption_options[] = {
+	{ "scripts", 's', 0, G_OPTION_ARG_STRING, &scripts_option,
+	  "Comma separated sequences to play: scroll, zoom, jump (default all)", "SCRIPTS" },
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+	  "Write the results to FILE instead of the standard output", "FILE" },
+	{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &file_arguments, NULL, "FILE" },
+	{ NULL }
+};
+
+/* The surface a page had before a zoom is kept alive, so that a new
+ * surface can't be allocated at the same address and be mistaken for
+ * it.
+ */
+typedef struct {
+	gint64           since;
+	cairo_surface_t *stale;
+	gboolean         pending;
+} PageState;
+
+typedef struct {
+	EvDocumentModel *model;
+	EvView          *view;
+	GtkAdjustment   *vadjustment;
+	gint             n_pages;
+
+	PageState       *pages;
+	gint             start_page;
+	gint             end_page;
+
+	/* Results of the script being played */
+	GArray          *draw_times;
+	GArray          *ready_times;
+	guint            n_blank_frames;
+} Bench;
+
+static void
+process_events (void)
+{
+	while (gtk_events_pending ())
+		gtk_main_iteration_do (FALSE);
+}
+
+/* Keeps the main loop running until @deadline, so that the render jobs
+ * finish as they would while the user waits for the next frame.
+ */
+static void
+run_until (gint64 deadline)
+{
+	while (g_get_monotonic_time () < deadline) {
+		if (!g_main_context_iteration (NULL, FALSE))
+			g_usleep (MIN (1000, MAX (0, deadline - g_get_monotonic_time ())));
+	}
+}
+
+static void
+page_state_set_stale (PageState       *state,
+		      cairo_surface_t *stale)
+{
+	if (stale)
+		cairo_surface_reference (stale);
+	if (state->stale)
+		cairo_surface_destroy (state->stale);
+	state->stale = stale;
+}
+
+static gboolean
+page_is_ready (Bench *bench,
+	       gint   page)
+{
+	cairo_surface_t *surface;
+
+	surface = ev_pixbuf_cache_get_surface (bench->view->pixbuf_cache, page);
+
+	return surface && surface != bench->pages[page].stale;
+}
+
+static void
+check_pending_pages (Bench *bench)
+{
+	gint64 now = g_get_monotonic_time ();
+	gint   i;
+
+	for (i = 0; i < bench->n_pages; i++) {
+		PageState *state = &bench->pages[i];
+		gdouble    ready_time;
+
+		if (!state->pending || !page_is_ready (bench, i))
+			continue;
+
+		ready_time = (now - state->since) / 1000.0;
+		g_array_append_val (bench->ready_times, ready_time);
+		state->pending = FALSE;
+		page_state_set_stale (state, NULL);
+	}
+}
+
+static void
+pixbuf_cache_job_finished_cb (EvPixbufCache  *pixbuf_cache,
+			      cairo_region_t *region,
+			      gint            page,
+			      Bench          *bench)
+{
+	check_pending_pages (bench);
+}
+
+/* Pages that become visible without a surface are waited for. Pages
+ * that stop being visible before being ready are not counted.
+ */
+static void
+update_visible_pages (Bench *bench)
+{
+	gint64 now = g_get_monotonic_time ();
+	gint   i;
+
+	for (i = 0; i < bench->n_pages; i++) {
+		PageState *state = &bench->pages[i];
+		gboolean   visible = i >= bench->view->start_page && i <= bench->view->end_page;
+		gboolean   was_visible = i >= bench->start_page && i <= bench->end_page;
+
+		if (!visible) {
+			state->pending = FALSE;
+			continue;
+		}
+
+		if (!was_visible && !state->pending && !page_is_ready (bench, i)) {
+			state->pending = TRUE;
+			state->since = now;
+		}
+	}
+
+	bench->start_page = bench->view->start_page;
+	bench->end_page = bench->view->end_page;
+}
+
+/* After a zoom every surface in the cache is stale, visible pages
+ * are ready when they get a surface rendered at the new scale.
+ */
+static void
+zoom (Bench  *bench,
+      gdouble scale)
+{
+	gint i;
+
+	for (i = 0; i < bench->n_pages; i++) {
+		page_state_set_stale (&bench->pages[i],
+				      ev_pixbuf_cache_get_surface (bench->view->pixbuf_cache, i));
+		bench->pages[i].pending = FALSE;
+	}
+	bench->start_page = bench->end_page = -1;
+
+	ev_document_model_set_scale (bench->model, scale);
+}
+
+static void
+draw_frame (Bench *bench)
+{
+	cairo_surface_t *surface;
+	cairo_t         *cr;
+	gint64           start;
+	gdouble          draw_time;
+	gint             i;
+
+	process_events ();
+	update_visible_pages (bench);
+	check_pending_pages (bench);
+
+	surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, VIEW_WIDTH, VIEW_HEIGHT);
+	cr = cairo_create (surface);
+
+	start = g_get_monotonic_time ();
+	gtk_widget_draw (GTK_WIDGET (bench->view), cr);
+	draw_time = (g_get_monotonic_time () - start) / 1000.0;
+	g_array_append_val (bench->draw_times, draw_time);
+
+	cairo_destroy (cr);
+	cairo_surface_destroy (surface);
+
+	/* A frame is blank when a visible page is drawn as loading */
+	for (i = MAX (bench->view->start_page, 0); i <= bench->view->end_page; i++) {
+		if (!ev_pixbuf_cache_get_surface (bench->view->pixbuf_cache, i)) {
+			bench->n_blank_frames++;
+			break;
+		}
+	}
+}
+
+static void
+play_frames (Bench *bench,
+	     guint  n_frames)
+{
+	guint i;
+
+	for (i = 0; i < n_frames; i++) {
+		gint64 frame_start = g_get_monotonic_time ();
+
+		draw_frame (bench);
+		run_until (frame_start + FRAME_TIME);
+	}
+}
+
+static void
+script_scroll (Bench *bench)
+{
+	guint i;
+
+	for (i = 0; i < SCROLL_FRAMES; i++) {
+		gint64  frame_start = g_get_monotonic_time ();
+		gdouble value;
+
+		value = gtk_adjustment_get_value (bench->vadjustment) + SCROLL_STEP;
+		if (value > gtk_adjustment_get_upper (bench->vadjustment) -
+		    gtk_adjustment_get_page_size (bench->vadjustment))
+			break;
+		gtk_adjustment_set_value (bench->vadjustment, value);
+
+		draw_frame (bench);
+		run_until (frame_start + FRAME_TIME);
+	}
+}
+
+static void
+script_zoom (Bench *bench)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (zoom_scales); i++) {
+		zoom (bench, zoom_scales[i]);
+		play_frames (bench, HOLD_FRAMES);
+	}
+}
+
+static void
+script_jump (Bench *bench)
+{
+	GRand *rand;
+	guint  i;
+
+	/* The same pages every run */
+	rand = g_rand_new_with_seed (1);
+	for (i = 0; i < N_JUMPS; i++) {
+		ev_document_model_set_page (bench->model,
+					    g_rand_int_range (rand, 0, bench->n_pages));
+		play_frames (bench, HOLD_FRAMES);
+	}
+	g_rand_free (rand);
+}
+
+static void
+append_json_string (GString     *str,
+		    const gchar *value)
+{
+	const gchar *p;
+
+	g_string_append_c (str, '"');
+	for (p = value; *p; p++) {
+		if (*p == '"' || *p == '\\')
+			g_string_append_printf (str, "\\%c", *p);
+		else if ((guchar) *p < 0x20)
+			g_string_append_printf (str, "\\u%04x", (guint) *p);
+		else
+			g_string_append_c (str, *p);
+	}
+	g_string_append_c (str, '"');
+}
+
+static gint
+compare_doubles (gconstpointer a,
+		 gconstpointer b)
+{
+	gdouble da = *(const gdouble *) a;
+	gdouble db = *(const gdouble *) b;
+
+	return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+static gdouble
+percentile (GArray *values,
+	    guint   p)
+{
+	guint rank;
+
+	if (values->len == 0)
+		return 0;
+
+	rank = (p * values->len + 99) / 100;
+	rank = CLAMP (rank, 1, values->len);
+
+	return g_array_index (values, gdouble, rank - 1);
+}
+
+/* Times in frame order, to see when the slow frames happen */
+static void
+append_frame_times (GString     *str,
+		    const gchar *name,
+		    GArray      *times)
+{
+	guint i;
+
+	g_string_append_printf (str, "\"%s\": [", name);
+	for (i = 0; i < times->len; i++) {
+		g_string_append_printf (str, "%s%.3f", i > 0 ? ", " : "",
+					g_array_index (times, gdouble, i));
+	}
+	g_string_append_c (str, ']');
+}
+
+static void
+append_times (GString     *str,
+	      const gchar *name,
+	      GArray      *times)
+{
+	g_array_sort (times, compare_doubles);
+	g_string_append_printf (str,
+				"\"%s\": { \"count\": %u, \"p50_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f }",
+				name, times->len,
+				percentile (times, 50), percentile (times, 99),
+				times->len ? g_array_index (times, gdouble, times->len - 1) : 0);
+}
+
+static void
+play_script (Bench       *bench,
+	     const gchar *name,
+	     GString     *str)
+{
+	gint i;
+
+	/* Every script starts from the first page at 100% */
+	zoom (bench, 1.0);
+	ev_document_model_set_page (bench->model, 0);
+	gtk_adjustment_set_value (bench->vadjustment, 0);
+	process_events ();
+	run_until (g_get_monotonic_time () + FRAME_TIME);
+
+	for (i = 0; i < bench->n_pages; i++) {
+		bench->pages[i].pending = FALSE;
+		page_state_set_stale (&bench->pages[i], NULL);
+	}
+	bench->start_page = bench->end_page = -1;
+	g_array_set_size (bench->draw_times, 0);
+	g_array_set_size (bench->ready_times, 0);
+	bench->n_blank_frames = 0;
+
+	if (g_strcmp0 (name, "scroll") == 0)
+		script_scroll (bench);
+	else if (g_strcmp0 (name, "zoom") == 0)
+		script_zoom (bench);
+	else if (g_strcmp0 (name, "jump") == 0)
+		script_jump (bench);
+
+	g_string_append_printf (str, "    { \"script\": \"%s\", \"frames\": %u, \"blank_frames\": %u, ",
+				name, bench->draw_times->len, bench->n_blank_frames);
+	append_frame_times (str, "frame_draw_ms", bench->draw_times);
+	g_string_append (str, ", ");
+	append_times (str, "draw", bench->draw_times);
+	g_string_append (str, ", ");
+	append_times (str, "page_ready", bench->ready_times);
+	g_string_append (str, " }");
+}
+
+gint
+main (gint argc, gchar **argv)
+{
+	GOptionContext *context;
+	GtkWidget      *window;
+	GtkWidget      *swindow;
+	EvDocument     *document;
+	Bench           bench;
+	GFile          *file;
+	GString        *str;
+	gchar          *uri;
+	gchar         **scripts;
+	GError         *error = NULL;
+	gint64          deadline;
+	gint            retval = EXIT_SUCCESS;
+	gint            i;
+
+	context = g_option_context_new ("- Measure EvView frame times");
+	g_option_context_add_main_entries (context, goption_options, NULL);
+	g_option_context_add_group (context, gtk_get_option_group (TRUE));
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		g_option_context_free (context);
+
+		return EXIT_FAILURE;
+	}
+
+	if (!file_arguments || !file_arguments[0]) {
+		gchar *help;
+
+		help = g_option_context_get_help (context, TRUE, NULL);
+		g_printerr ("%s", help);
+		g_free (help);
+		g_option_context_free (context);
+
+		return EXIT_FAILURE;
+	}
+	g_option_context_free (context);
+
+	if (!ev_init ()) {
+		g_printerr ("No backends found\n");
+
+		return EXIT_FAILURE;
+	}
+
+	file = g_file_new_for_commandline_arg (file_arguments[0]);
+	uri = g_file_get_uri (file);
+	g_object_unref (file);
+
+	document = ev_document_factory_get_document (uri, &error);
+	g_free (uri);
+	if (!document) {
+		g_printerr ("Failed to load %s: %s\n", file_arguments[0], error->message);
+		g_error_free (error);
+		ev_shutdown ();
+
+		return EXIT_FAILURE;
+	}
+
+	memset (&bench, 0, sizeof (Bench));
+	bench.n_pages = ev_document_get_n_pages (document);
+	bench.pages = g_new0 (PageState, bench.n_pages);
+	bench.start_page = bench.end_page = -1;
+	bench.draw_times = g_array_new (FALSE, FALSE, sizeof (gdouble));
+	bench.ready_times = g_array_new (FALSE, FALSE, sizeof (gdouble));
+
+	bench.model = ev_document_model_new_with_document (document);
+	ev_document_model_set_sizing_mode (bench.model, EV_SIZING_FREE);
+	ev_document_model_set_continuous (bench.model, TRUE);
+
+	window = gtk_offscreen_window_new ();
+	gtk_window_set_default_size (GTK_WINDOW (window), VIEW_WIDTH, VIEW_HEIGHT);
+	swindow = gtk_scrolled_window_new (NULL, NULL);
+	gtk_container_add (GTK_CONTAINER (window), swindow);
+	bench.view = EV_VIEW (ev_view_new ());
+	ev_view_set_model (bench.view, bench.model);
+	gtk_container_add (GTK_CONTAINER (swindow), GTK_WIDGET (bench.view));
+	gtk_widget_show_all (window);
+
+	bench.vadjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (bench.view));
+	g_signal_connect (bench.view->pixbuf_cache, "job-finished",
+			  G_CALLBACK (pixbuf_cache_job_finished_cb),
+			  &bench);
+
+	/* Wait for the first page, so scripts don't measure the load */
+	deadline = g_get_monotonic_time () + SETTLE_TIME;
+	while (!ev_pixbuf_cache_get_surface (bench.view->pixbuf_cache, 0) &&
+	       g_get_monotonic_time () < deadline)
+		run_until (g_get_monotonic_time () + FRAME_TIME);
+
+	str = g_string_new ("{\n  \"file\": ");
+	append_json_string (str, file_arguments[0]);
+	g_string_append_printf (str, ",\n  \"pages\": %d,\n  \"scripts\": [\n", bench.n_pages);
+	scripts = g_strsplit (scripts_option ? scripts_option : "scroll,zoom,jump", ",", -1);
+	for (i = 0; scripts[i]; i++) {
+		if (g_strcmp0 (scripts[i], "scroll") != 0 &&
+		    g_strcmp0 (scripts[i], "zoom") != 0 &&
+		    g_strcmp0 (scripts[i], "jump") != 0) {
+			g_printerr ("Unknown script %s\n", scripts[i]);
+			retval = EXIT_FAILURE;
+			continue;
+		}
+
+		if (str->str[str->len - 2] == '}')
+			g_string_append (str, ",\n");
+		play_script (&bench, scripts[i], str);
+		g_string_append (str, "\n");
+	}
+	g_strfreev (scripts);
+	g_string_append (str, "  ]\n}\n");
+
+	if (output) {
+		if (!g_file_set_contents (output, str->str, str->len, &error)) {
+			g_printerr ("Failed to write %s: %s\n", output, error->message);
+			g_error_free (error);
+			retval = EXIT_FAILURE;
+		}
+	} else {
+		g_print ("%s", str->str);
+	}
+
+	g_string_free (str, TRUE);
+	gtk_widget_destroy (window);
+	g_object_unref (bench.model);
+	g_object_unref (document);
+	g_array_free (bench.draw_times, TRUE);
+	g_array_free (bench.ready_times, TRUE);
+	for (i = 0; i < bench.n_pages; i++)
+		page_state_set_stale (&bench.pages[i], NULL);
+	g_free (bench.pages);
+
+	ev_shutdown ();
+
+	return retval;
+}
@@ -0,0 +1,340 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8; c-indent-level: 8 -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <evince-document.h>
+#include <evince-view.h>
+
+/* Time the main loop keeps running after the last callback, to catch
+ * operations calling back more than once.
+ */
+#define SETTLE_TIME_MS 200
+
+typedef enum {
+	OP_LOAD,
+	OP_RENDER,
+	OP_PAGE_DATA,
+	OP_TEXT
+} OpType;
+
+typedef struct {
+	const gchar *name;
+	OpType       type;
+	gint         n_calls;
+	gpointer     result;
+	GError      *error;
+} Op;
+
+static GMainLoop  *loop;
+static gint        n_pending;
+static EvDocument *document;
+
+static void
+check (gboolean     condition,
+       const gchar *name,
+       const gchar *message)
+{
+	if (condition)
+		return;
+
+	g_printerr ("%s: %s\n", name, message);
+	g_test_fail ();
+}
+
+static void
+op_init (Op          *op,
+	 const gchar *name,
+	 OpType       type)
+{
+	op->name = name;
+	op->type = type;
+	op->n_calls = 0;
+	op->result = NULL;
+	op->error = NULL;
+	n_pending++;
+}
+
+static void
+op_clear (Op *op)
+{
+	if (op->result) {
+		switch (op->type) {
+		case OP_LOAD:
+			g_object_unref (op->result);
+			break;
+		case OP_RENDER:
+			cairo_surface_destroy (op->result);
+			break;
+		case OP_PAGE_DATA:
+			ev_page_data_free (op->result);
+			break;
+		case OP_TEXT:
+			g_free (op->result);
+			break;
+		}
+		op->result = NULL;
+	}
+	g_clear_error (&op->error);
+}
+
+static void
+op_done_cb (GObject      *source,
+	    GAsyncResult *result,
+	    Op           *op)
+{
+	EvDocument *document = EV_IS_DOCUMENT (source) ? EV_DOCUMENT (source) : NULL;
+
+	op->n_calls++;
+	if (op->n_calls > 1)
+		return;
+
+	switch (op->type) {
+	case OP_LOAD:
+		op->result = ev_document_new_for_gfile_finish (result, &op->error);
+		break;
+	case OP_RENDER:
+		op->result = ev_document_render_finish (document, result, &op->error);
+		break;
+	case OP_PAGE_DATA:
+		op->result = ev_document_get_page_data_finish (document, result, &op->error);
+		break;
+	case OP_TEXT:
+		op->result = ev_document_get_text_finish (document, result, &op->error);
+		break;
+	}
+
+	if (--n_pending == 0)
+		g_main_loop_quit (loop);
+}
+
+static gboolean
+settle_timeout_cb (gpointer data)
+{
+	g_main_loop_quit (loop);
+
+	return FALSE;
+}
+
+/* Runs the main loop until all the pending operations called back */
+static void
+wait_for_ops (void)
+{
+	if (n_pending > 0)
+		g_main_loop_run (loop);
+
+	g_timeout_add (SETTLE_TIME_MS, settle_timeout_cb, NULL);
+	g_main_loop_run (loop);
+}
+
+static void
+check_completed (Op *op)
+{
+	check (op->n_calls == 1, op->name, "callback not called exactly once");
+	check (op->error == NULL, op->name, op->error ? op->error->message : "");
+}
+
+static void
+check_cancelled (Op *op)
+{
+	check (op->n_calls == 1, op->name, "callback not called exactly once");
+	check (g_error_matches (op->error, G_IO_ERROR, G_IO_ERROR_CANCELLED),
+	       op->name, "did not fail with G_IO_ERROR_CANCELLED");
+	check (op->result == NULL, op->name, "returned a result although cancelled");
+}
+
+static EvDocument *
+test_load (GFile *file)
+{
+	EvDocument *document;
+	Op          op;
+
+	op_init (&op, "load", OP_LOAD);
+	ev_document_new_for_gfile_async (file, EV_DOCUMENT_LOAD_FLAG_NONE,
+					 EV_JOB_PRIORITY_URGENT, NULL,
+					 (GAsyncReadyCallback) op_done_cb, &op);
+	wait_for_ops ();
+
+	check_completed (&op);
+	document = op.result ? g_object_ref (op.result) : NULL;
+	op_clear (&op);
+
+	return document;
+}
+
+static void
+test_completion (void)
+{
+	Op render, page_data, text;
+
+	/* Queued at once, without waiting for each other */
+	op_init (&render, "render", OP_RENDER);
+	ev_document_render_async (document, 0, 0, 1.0, EV_JOB_PRIORITY_URGENT, NULL,
+				  (GAsyncReadyCallback) op_done_cb, &render);
+	op_init (&page_data, "page data", OP_PAGE_DATA);
+	ev_document_get_page_data_async (document, 0,
+					 EV_PAGE_DATA_INCLUDE_LINKS | EV_PAGE_DATA_INCLUDE_TEXT,
+					 EV_JOB_PRIORITY_HIGH, NULL,
+					 (GAsyncReadyCallback) op_done_cb, &page_data);
+	op_init (&text, "text", OP_TEXT);
+	ev_document_get_text_async (document, 0, EV_JOB_PRIORITY_LOW, NULL,
+				    (GAsyncReadyCallback) op_done_cb, &text);
+	wait_for_ops ();
+
+	check_completed (&render);
+	check (render.result != NULL, render.name, "no surface");
+	if (render.result) {
+		check (cairo_image_surface_get_width (render.result) > 0 &&
+		       cairo_image_surface_get_height (render.result) > 0,
+		       render.name, "empty surface");
+	}
+
+	check_completed (&page_data);
+	check (page_data.result != NULL, page_data.name, "no page data");
+	if (page_data.result) {
+		EvPageData *data = page_data.result;
+		EvPageData *copy;
+
+		check (data->page == 0, page_data.name, "wrong page");
+		check (data->image_mapping == NULL && data->annot_mapping == NULL,
+		       page_data.name, "got data that was not requested");
+
+		copy = ev_page_data_copy (data);
+		check (g_strcmp0 (copy->text, data->text) == 0, page_data.name, "copy differs");
+		ev_page_data_free (copy);
+	}
+
+	check_completed (&text);
+
+	op_clear (&render);
+	op_clear (&page_data);
+	op_clear (&text);
+}
+
+static void
+test_cancellation (void)
+{
+	GCancellable *cancellable;
+	Op            before, queued, running, others[2], after;
+
+	/* Cancelled before the operation starts */
+	cancellable = g_cancellable_new ();
+	g_cancellable_cancel (cancellable);
+	op_init (&before, "cancelled before", OP_RENDER);
+	ev_document_render_async (document, 0, 0, 1.0, EV_JOB_PRIORITY_URGENT, cancellable,
+				  (GAsyncReadyCallback) op_done_cb, &before);
+	wait_for_ops ();
+	check_cancelled (&before);
+	op_clear (&before);
+	g_object_unref (cancellable);
+
+	/* Cancelled while running or about to run, the operations
+	 * queued with it are not affected
+	 */
+	cancellable = g_cancellable_new ();
+	op_init (&running, "cancelled while running", OP_RENDER);
+	ev_document_render_async (document, 0, 0, 2.0, EV_JOB_PRIORITY_URGENT, cancellable,
+				  (GAsyncReadyCallback) op_done_cb, &running);
+	op_init (&others[0], "queued with a cancelled render", OP_RENDER);
+	ev_document_render_async (document, 0, 0, 0.5, EV_JOB_PRIORITY_HIGH, NULL,
+				  (GAsyncReadyCallback) op_done_cb, &others[0]);
+	g_cancellable_cancel (cancellable);
+	wait_for_ops ();
+	check_cancelled (&running);
+	check_completed (&others[0]);
+	op_clear (&running);
+	op_clear (&others[0]);
+	g_object_unref (cancellable);
+
+	/* Cancelled while waiting in the queue */
+	cancellable = g_cancellable_new ();
+	op_init (&others[0], "queued before", OP_RENDER);
+	ev_document_render_async (document, 0, 0, 1.0, EV_JOB_PRIORITY_URGENT, NULL,
+				  (GAsyncReadyCallback) op_done_cb, &others[0]);
+	op_init (&queued, "cancelled while queued", OP_PAGE_DATA);
+	ev_document_get_page_data_async (document, 0, EV_PAGE_DATA_INCLUDE_LINKS,
+					 EV_JOB_PRIORITY_NONE, cancellable,
+					 (GAsyncReadyCallback) op_done_cb, &queued);
+	op_init (&others[1], "queued after", OP_TEXT);
+	ev_document_get_text_async (document, 0, EV_JOB_PRIORITY_NONE, NULL,
+				    (GAsyncReadyCallback) op_done_cb, &others[1]);
+	g_cancellable_cancel (cancellable);
+	wait_for_ops ();
+	check_completed (&others[0]);
+	check_cancelled (&queued);
+	check_completed (&others[1]);
+	op_clear (&others[0]);
+	op_clear (&queued);
+	op_clear (&others[1]);
+	g_object_unref (cancellable);
+
+	/* Cancelled once completed: nothing happens */
+	cancellable = g_cancellable_new ();
+	op_init (&after, "cancelled after completion", OP_RENDER);
+	ev_document_render_async (document, 0, 0, 1.0, EV_JOB_PRIORITY_URGENT, cancellable,
+				  (GAsyncReadyCallback) op_done_cb, &after);
+	wait_for_ops ();
+	g_cancellable_cancel (cancellable);
+	wait_for_ops ();
+	check_completed (&after);
+	check (after.result != NULL, after.name, "no surface");
+	op_clear (&after);
+	g_object_unref (cancellable);
+}
+
+/* The document is given with the EV_TEST_DOCUMENT environment
+ * variable or as argument. Without one, there is nothing to test,
+ * and the test is skipped.
+ */
+gint
+main (gint argc, gchar **argv)
+{
+	const gchar *filename;
+	GFile       *file;
+	gint         retval;
+
+	g_test_init (&argc, &argv, NULL);
+
+	filename = argc > 1 ? argv[1] : g_getenv ("EV_TEST_DOCUMENT");
+	if (!filename) {
+		g_print ("No document given with EV_TEST_DOCUMENT, skipping\n");
+		return 77;
+	}
+
+	if (!ev_init ())
+		return 1;
+
+	loop = g_main_loop_new (NULL, FALSE);
+
+	file = g_file_new_for_commandline_arg (filename);
+	document = test_load (file);
+	g_object_unref (file);
+	if (!document) {
+		g_printerr ("Failed to load %s\n", filename);
+		return 1;
+	}
+
+	g_test_add_func ("/document-async/completion", test_completion);
+	g_test_add_func ("/document-async/cancellation", test_cancellation);
+	retval = g_test_run ();
+
+	g_object_unref (document);
+	g_main_loop_unref (loop);
+	ev_shutdown ();
+
+	return retval;
+}